@@ -0,0 +1,386 @@
+// Times each stage of das_editor over synthetic saves and prints one JSON
+// line per stage, so runs can be compared across versions.
+// Linux: gcc -O2 bench.c das.c das_io.c -o das_bench -Wall -pthread -lm
+//        ./das_bench [--saves N] [--size BYTES] [--items N] [--xmls N]
+//                    [--xml-size BYTES] [--seed N] [--iters N] [--dir DIR] [--keep]
+
+// Standard C libs
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+// The core and the editor's file side, the same code das_editor runs
+#include "das_internal.h"
+#include "das_io.h"
+
+#define BENCH_FACE_AT 2000
+#define BENCH_XML_GAP 5000
+
+struct bench_opts {
+	int         saves;
+	int         size;     // Random payload bytes per save
+	int         items;    // FBHEADER items
+	int         xmls;
+	int         xml_size;
+	unsigned    seed;
+	int         iters;
+	const char* dir;
+	int         keep;
+};
+
+struct bench_stage {
+	const char* name;
+	double      best;     // Fastest pass over every save, in seconds
+	double      total;
+	long long   bytes;    // Bytes one pass reads, the header only for read_header
+};
+
+// The items das_read_header knows, the rest get random hashes
+static const struct {
+	unsigned int hash;
+	const char*  value;
+} bench_items[] = {
+	{ 0x92796772, "Bench" },            { 0x926E6FA0, "1" },
+	{ 0x06AE718A, "1" },                { 0x979CAD3D, "12345.5" },
+	{ 0xB615BDD8, "0123456789abcdef0123456789abcdef" },
+	{ 0xE17097FB, "3" },                { 0xE1CA2F03, "17" },
+	{ 0xA521BDF0, "1.0,2.0,3.0" },      { 0x5F500F34, "area51" },
+	{ 0x2F852FB8, "Skyhold" },          { 0xB3991F9F, "thumb.png" },
+	{ 0x9A832D89, "maps/skyhold" },     { 0x39AA8AB0, "212788000000" },
+	{ 0x8509F5B0, "123456" },           { 0x0346EAF1, "10" },
+	{ 0x4D86FB47, "addonA~addonB~" }
+};
+#define BENCH_NUM_ITEMS (int)( sizeof( bench_items ) / sizeof( bench_items[0] ) )
+
+static unsigned long long bench_rand( unsigned long long* state ) {
+
+	// splitmix64, the same stream for the same seed on every machine
+	unsigned long long z = ( *state += 0x9E3779B97F4A7C15ull );
+	z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+	z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBull;
+	return( z ^ ( z >> 31 ) );
+
+}
+
+static double bench_now( void ) {
+
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return( ts.tv_sec + ts.tv_nsec / 1e9 );
+
+}
+
+static void bench_be32( unsigned char* p, unsigned int v ) {
+
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+
+}
+
+static void bench_le32( unsigned char* p, unsigned int v ) {
+
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+
+}
+
+// Save number n: a valid prefix and FBHEADER, then random data holding
+// the 18 face anchors and the XMLs, all of it after the header rotated
+// by a random bit shift the way the game writes it
+unsigned char* bench_gen( const struct bench_opts* opts, int n, size_t* out_size ) {
+
+	unsigned long long rng = opts->seed * 0x100000001B3ull + (unsigned)n;
+	int shift = bench_rand( &rng ) % 8;
+	int i = 0, k = 0, body = 14;
+
+	// FBHEADER: magic, item count, the items, the data checksum
+	for ( i = 0; i < opts->items; i++ )
+		body += 6 + ( i < BENCH_NUM_ITEMS ? (int)strlen( bench_items[i].value ) : 16 );
+	body += 4;
+	int head = DAS_HEADER_START + body;
+
+	// Face block, then the XMLs with their size in front
+	char xml_head[160];
+	const char* xml_unit = "<a>text</a>";
+	const char* xml_tail = "</Head></root>";
+	int face_end = BENCH_FACE_AT;
+	for ( i = 0; i < DAS_NUM_ANCHORS; i++ )
+		face_end += 4 + das_anchors[i].stride * das_anchors[i].count + 37;
+	int need = face_end + BENCH_XML_GAP + opts->xmls * ( opts->xml_size + BENCH_XML_GAP );
+	int payload = opts->size > need ? opts->size : need;
+	size_t size = head + 8 + payload;
+	unsigned char* view = (unsigned char*)malloc( size );
+	unsigned char* data = (unsigned char*)malloc( size );
+	if ( view == NULL || data == NULL ) {
+		fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+		free( view );
+		free( data );
+		return( NULL );
+	}
+	memset( view, 0, head + 8 );
+	unsigned char* p = view + head + 8;
+	for ( i = 0; i + 8 <= payload; i += 8 ) {
+		unsigned long long r = bench_rand( &rng );
+		memcpy( p + i, &r, 8 );
+	}
+	for ( ; i < payload; i++ )
+		p[i] = bench_rand( &rng );
+
+	// Anchors, each followed by its values at its stride
+	int pos = BENCH_FACE_AT;
+	for ( i = 0; i < DAS_NUM_ANCHORS; i++ ) {
+		const struct das_anchor* an = &das_anchors[i];
+		bench_be32( p + pos, an->hash );
+		for ( k = 0; k < an->count; k++ ) {
+			float value = ( bench_rand( &rng ) % 1000 ) / 1000.0f;
+			unsigned int bits;
+			memcpy( &bits, &value, 4 );
+			bench_le32( p + pos + an->stride * ( k + 1 ), bits );
+		}
+		pos += 4 + an->stride * an->count + 37;
+	}
+
+	// XMLs of xml_size bytes, padded with whole <a>text</a> elements
+	pos = face_end + BENCH_XML_GAP;
+	for ( i = 0; i < opts->xmls; i++ ) {
+		int len = snprintf( xml_head, sizeof( xml_head ), "<?xml version=\"1.0\"?><root><Head id=\"%d\">"
+			"<TintDetailWeights x=\"0.5\" y=\"0.0\" z=\"0.0\" w=\"0.25\"/>", i );
+		int at = pos;
+		memcpy( p + at, xml_head, len );
+		at += len;
+		while ( at - pos + 11 + 14 <= opts->xml_size ) {
+			memcpy( p + at, xml_unit, 11 );
+			at += 11;
+		}
+		memcpy( p + at, xml_tail, 14 );
+		at += 14;
+		bench_be32( p + pos - 4, at - pos );
+		pos += opts->xml_size + BENCH_XML_GAP;
+	}
+
+	// The file is the view rotated left by the shift
+	for ( i = 0; i < (int)size; i++ )
+		data[i] = shift ? ( view[i] << shift ) | ( view[( i + 1 ) % size] >> ( 8 - shift ) ) : view[i];
+	free( view );
+
+	// The prefix and header are never shifted
+	memcpy( data, "FBCHUNKS\x01\x00", 10 );
+	bench_le32( data + 0xA, body );
+	bench_le32( data + 0xE, size - head );
+	bench_le32( data + DAS_PREFIX_SIZE, 0 );
+	p = data + DAS_HEADER_START;
+	memcpy( p, "FBHEADER\x00\x01", 10 );
+	bench_be32( p + 10, opts->items );
+	p += 14;
+	for ( i = 0; i < opts->items; i++ ) {
+		int len = i < BENCH_NUM_ITEMS ? (int)strlen( bench_items[i].value ) : 16;
+		bench_be32( p, i < BENCH_NUM_ITEMS ? bench_items[i].hash : (unsigned int)bench_rand( &rng ) );
+		p[4] = len >> 8;
+		p[5] = len;
+		if ( i < BENCH_NUM_ITEMS )
+			memcpy( p + 6, bench_items[i].value, len );
+		else
+			for ( k = 0; k < len; k++ )
+				p[6+k] = "0123456789abcdef"[bench_rand( &rng ) % 16];
+		p += 6 + len;
+	}
+
+	struct das_file file = { .data = data, .size = size, .fd = -1, .mapped = 0, .writable = 1 };
+	das_checksum_fix( &file );
+	*out_size = size;
+	return( data );
+
+}
+
+static void bench_report( const struct bench_opts* opts, const struct bench_stage* stage ) {
+
+	printf( "{\"stage\":\"%s\",\"saves\":%d,\"bytes\":%lld,\"iters\":%d,"
+		"\"best_s\":%.6f,\"mean_s\":%.6f,\"mb_s\":%.2f,\"saves_s\":%.2f}\n",
+		stage->name, opts->saves, stage->bytes, opts->iters, stage->best,
+		stage->total / opts->iters, stage->bytes / stage->best / 1e6, opts->saves / stage->best );
+
+}
+
+int main( int argc, char* argv[] ) {
+
+	struct bench_opts opts = {
+		.saves    = 50,
+		.size     = 1500000,
+		.items    = 17,
+		.xmls     = 3,
+		.xml_size = 20000,
+		.seed     = 1,
+		.iters    = 5,
+		.dir      = NULL,
+		.keep     = 0
+	};
+	struct bench_stage stages[] = {
+		{ .name = "read_header" }, { .name = "align" }, { .name = "anchors" },
+		{ .name = "import" }, { .name = "xml_dump" }, { .name = "write" }
+	};
+	int stage_count = (int)( sizeof( stages ) / sizeof( stages[0] ) );
+	char dir[3072], path[4096], out[4096];
+	int i = 0, n = 0, s = 0, it = 0, failed = 0;
+	volatile int sink = 0;
+	das_quiet = 1;
+
+	for ( i = 1; i < argc; i++ ) {
+		if ( strcmp( argv[i], "--saves" ) == 0 && i + 1 < argc ) {
+			opts.saves = atoi( argv[++i] );
+		} else if ( strcmp( argv[i], "--size" ) == 0 && i + 1 < argc ) {
+			opts.size = atoi( argv[++i] );
+		} else if ( strcmp( argv[i], "--items" ) == 0 && i + 1 < argc ) {
+			opts.items = atoi( argv[++i] );
+		} else if ( strcmp( argv[i], "--xmls" ) == 0 && i + 1 < argc ) {
+			opts.xmls = atoi( argv[++i] );
+		} else if ( strcmp( argv[i], "--xml-size" ) == 0 && i + 1 < argc ) {
+			opts.xml_size = atoi( argv[++i] );
+		} else if ( strcmp( argv[i], "--seed" ) == 0 && i + 1 < argc ) {
+			opts.seed = (unsigned)strtoul( argv[++i], NULL, 10 );
+		} else if ( strcmp( argv[i], "--iters" ) == 0 && i + 1 < argc ) {
+			opts.iters = atoi( argv[++i] );
+		} else if ( strcmp( argv[i], "--dir" ) == 0 && i + 1 < argc ) {
+			opts.dir = argv[++i];
+		} else if ( strcmp( argv[i], "--keep" ) == 0 ) {
+			opts.keep = 1;
+		} else {
+			fprintf( stderr, ":: ERROR: Unknown option \"%s\".\n", argv[i] );
+			fprintf( stderr, "::  USAGE: ./das_bench [--saves N] [--size BYTES] [--items N] [--xmls N]\n" );
+			fprintf( stderr, "::                     [--xml-size BYTES] [--seed N] [--iters N] [--dir DIR] [--keep]\n" );
+			return( 2 );
+		}
+	}
+	if ( opts.saves < 1 || opts.iters < 1 || opts.size < 0 || opts.xmls < 1 || opts.xmls > DAS_XML_HITS_MAX ||
+			opts.items < 0 || opts.xml_size < 256 ) {
+		fprintf( stderr, ":: ERROR: Bad benchmark size.\n" );
+		return( 2 );
+	}
+	if ( opts.dir != NULL ) {
+		snprintf( dir, sizeof( dir ), "%s", opts.dir );
+		if ( das_mkdir( dir ) == -1 )
+			return( EXIT_FAILURE );
+	} else {
+		snprintf( dir, sizeof( dir ), "/tmp/das_bench.XXXXXX" );
+		if ( mkdtemp( dir ) == NULL ) {
+			fprintf( stderr, ":: ERROR: Cannot create a directory in /tmp\n" );
+			return( EXIT_FAILURE );
+		}
+	}
+
+	// Generate the saves to disk, every stage then works on them mapped
+	// the way the editor opens them
+	struct das_file* files = (struct das_file*)calloc( opts.saves, sizeof( struct das_file ) );
+	struct handle* values = (struct handle*)malloc( (size_t)opts.saves * DAS_NUM_VALUES * sizeof( struct handle ) );
+	struct das_view* views = (struct das_view*)malloc( opts.saves * sizeof( struct das_view ) );
+	if ( files == NULL || values == NULL || views == NULL ) {
+		fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+		return( EXIT_FAILURE );
+	}
+	long long total = 0;
+	for ( n = 0; n < opts.saves; n++ ) {
+		size_t size = 0;
+		unsigned char* data = bench_gen( &opts, n, &size );
+		snprintf( path, sizeof( path ), "%s/bench%.4d.DAS", dir, n );
+		if ( data == NULL || char_to_file( path, data, size ) == -1 ||
+				das_file_open( &files[n], path, 1 ) == -1 )
+			return( EXIT_FAILURE );
+		free( data );
+		total += size;
+	}
+	for ( s = 1; s < stage_count; s++ )
+		stages[s].bytes = total;
+	for ( n = 0; n < opts.saves; n++ )
+		stages[0].bytes += DAS_HEADER_START + das_read_header( files[n].data, files[n].size ).size;
+
+	// Import the first save's face into every save
+	struct das_face_preset preset;
+	struct das_face_write writes[DAS_NUM_VALUES];
+	if ( das_find_values( &files[0], values, &views[0] ) == -1 )
+		return( EXIT_FAILURE );
+	preset.count = DAS_NUM_VALUES;
+	for ( i = 0; i < DAS_NUM_VALUES; i++ ) {
+		preset.field[i] = i;
+		preset.value[i] = values[i].fp_val;
+	}
+
+	printf( "{\"bench\":\"das_editor\",\"saves\":%d,\"bytes\":%lld,\"items\":%d,\"xmls\":%d,"
+		"\"xml_size\":%d,\"seed\":%u,\"iters\":%d}\n",
+		opts.saves, total, opts.items, opts.xmls, opts.xml_size, opts.seed, opts.iters );
+	fflush( stdout );
+	for ( s = 0; s < stage_count && !failed; s++ ) {
+		for ( it = 0; it < opts.iters && !failed; it++ ) {
+			double start = bench_now();
+			for ( n = 0; n < opts.saves && !failed; n++ ) {
+				struct das_file* file = &files[n];
+				struct handle* value = values + n * DAS_NUM_VALUES;
+				struct xml_hit* hits = NULL;
+				switch ( s ) {
+					case 0: // read_header
+						sink += das_read_header( file->data, file->size ).item_count;
+						break;
+					case 1: // align, every "<?xml" at every bit shift
+						sink += das_find_xmls( file->data, (int)file->size, &hits );
+						free( hits );
+						break;
+					case 2: // anchors, the alignment again and then the face values
+						failed = das_find_values( file, value, &views[n] ) == -1;
+						break;
+					case 3: { // import, resolve against the save and write the values
+						int count = das_face_resolve( &preset, value, writes );
+						if ( count != DAS_NUM_VALUES ) {
+							fprintf( stderr, ":: ERROR: Save %d has %d of %d fields.\n", n, count, DAS_NUM_VALUES );
+							failed = 1;
+						}
+						das_face_apply( &views[n], writes, count );
+						break;
+					}
+					case 4: // xml_dump, raw so only the reading and writing is timed
+						snprintf( out, sizeof( out ), "%s/bench_", dir );
+						failed = das_dump_xmls( file->data, (int)file->size, out, DAS_XML_RAW, NULL, 0 ) == -1;
+						break;
+					case 5: // write, the imported save as a new file
+						snprintf( out, sizeof( out ), "%s/bench.NEW", dir );
+						failed = das_file_write( file, out ) == -1;
+						break;
+				}
+			}
+			double took = bench_now() - start;
+			if ( it == 0 || took < stages[s].best )
+				stages[s].best = took;
+			stages[s].total += took;
+		}
+		if ( !failed ) {
+			bench_report( &opts, &stages[s] );
+			fflush( stdout );
+		}
+	}
+
+	// Leave nothing behind unless asked to
+	for ( n = 0; n < opts.saves; n++ ) {
+		das_file_close( &files[n] );
+		snprintf( path, sizeof( path ), "%s/bench%.4d.DAS", dir, n );
+		if ( !opts.keep )
+			remove( path );
+	}
+	if ( !opts.keep ) {
+		for ( i = 1; i <= opts.xmls; i++ ) {
+			snprintf( path, sizeof( path ), "%s/bench_xml_file%.2d.xml", dir, i );
+			remove( path );
+		}
+		snprintf( path, sizeof( path ), "%s/bench.NEW", dir );
+		remove( path );
+		if ( opts.dir == NULL )
+			rmdir( dir );
+	}
+	free( files );
+	free( values );
+	free( views );
+	return( failed ? EXIT_FAILURE : EXIT_SUCCESS );
+
+}
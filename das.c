@@ -0,0 +1,1428 @@
+// libdas, see das.h, and the save parsing core of das_internal.h that
+// das_editor and das_bench link. libdas checks a save before handing it
+// to the core, so the core's error messages are never printed from here.
+
+// Standard C libs
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "das_internal.h"
+#include "das.h"
+
+#ifdef DAS_MMAP
+#	include <sys/mman.h>
+#endif
+
+// Counters of the file this thread is working on, NULL without --stats
+__thread struct das_stats* das_stats_cur = NULL;
+
+int das_item_next( const unsigned char* data, size_t size, size_t* offset, struct das_item* item ) {
+
+	// Each item starts with 4 bytes (unknown hash) 2 bytes length, item data
+	size_t at = *offset;
+	if ( at + 6 > size )
+		return( -1 );
+	item->hash = ( (unsigned int)data[at] << 24 ) | ( data[at+1] << 16 ) |
+		( data[at+2] << 8 ) | data[at+3];
+	item->value.len = ( data[at+4] << 8 ) | data[at+5];
+	item->value.ptr = data + at + 6;
+	if ( at + 6 + item->value.len > size )
+		return( -1 );
+	*offset = at + 6 + item->value.len;
+	return( 0 );
+
+}
+
+int das_header_find( const unsigned char* data, size_t size, unsigned int hash, struct das_item* item ) {
+
+	// Walk the items in place, nothing is copied
+	int i = 0, item_count = 0;
+	size_t offset = 0x20;
+	if ( size < 0x24 )
+		return( -1 );
+	item_count = ( data[0x20] << 24 ) | ( data[0x21] << 16 ) | ( data[0x22] << 8 ) | data[0x23];
+	offset += 4;
+	for ( i = 0; i < item_count; i++ ) {
+		if ( das_item_next( data, size, &offset, item ) == -1 )
+			return( -1 );
+		if ( item->hash == hash )
+			return( 1 );
+	}
+	return( 0 );
+
+}
+
+void das_slice_str( char* dst, size_t dst_size, struct das_slice slice ) {
+
+	// Bounded copy, stops at the first \0 like "%s" did
+	size_t i = 0;
+	for ( i = 0; i + 1 < dst_size && i < (size_t)slice.len && slice.ptr[i] != '\0'; i++ )
+		dst[i] = slice.ptr[i];
+	dst[i] = '\0';
+
+}
+
+long long das_slice_ll( struct das_slice slice ) {
+
+	char tmp[32];
+	das_slice_str( tmp, sizeof( tmp ), slice );
+	return( atoll( tmp ) );
+
+}
+
+double das_slice_double( struct das_slice slice ) {
+
+	char tmp[32];
+	das_slice_str( tmp, sizeof( tmp ), slice );
+	return( atof( tmp ) );
+
+}
+
+struct header das_read_header( const unsigned char* data, size_t size ) {
+
+	// Initialize struct
+	struct header header = {
+		.size            = 0,
+		.data_size       = 0,
+		.checksum        = 0,
+		.item_count      = 0,
+		.player_name     = "",
+		.player_race     = "",
+		.player_gender   = "",
+		.total_play_time = 0,
+		.player_id       = "",
+		.player_class    = "",
+		.player_level    = 0,
+		.player_pos      = "",
+		.area_id         = "",
+		.player_location = "",
+		.thumbnail       = "",
+		.assets          = "",
+		.timestamp       = 0,
+		.build_number    = "",
+		.patch_number    = 0,
+		.addon_count     = 0,
+		.data_checksum   = 0
+	};
+
+	// Vars
+	int i = 0, d = 0, ind = 0;
+	size_t offset = 0;
+	struct das_item item;
+
+	// Start reading file and printing info.
+	// Check first 10 bytes for FBCHUNKS file
+	if (	size < 0x24 ||
+			data[0] != 0x46 ||  // F
+			data[1] != 0x42 ||  // B
+			data[2] != 0x43 ||  // C
+			data[3] != 0x48 ||  // H
+			data[4] != 0x55 ||  // U
+			data[5] != 0x4E ||  // N
+			data[6] != 0x4B ||  // K
+			data[7] != 0x53 ||  // S
+			data[8] != 0x01 ||  // <SOH>
+			data[9] != 0x00 ) { // \0
+		fprintf( stderr, "  ERROR: Not a valid save file.\n" );
+		return( header );
+	}
+	offset += 10;
+
+	// At offset 0xA, 4 bytes, size of header in bytes
+	for ( i = 3; i >= 0; i-- )
+		header.size = ( header.size << 8 ) + data[offset+i];
+	offset += 4;
+
+	// At offset 0xE, 4 bytes, size of data in bytes
+	for ( i = 3; i >= 0; i-- )
+		header.data_size = ( header.data_size << 8 ) + data[offset+i];
+	offset += 4;
+
+	// At offset 0x12, 4 bytes, header checksum
+	for ( i = 3; i >= 0; i-- )
+		header.checksum = ( header.checksum << 8 ) + data[offset+i];
+	offset += 4;
+
+	// We don't care about these 10 bytes, so move on
+	// 46 42 48 45 41 44 45 52 00 01
+	// F  B  H  E  A  D  E  R  \0 SOH
+	offset += 10;
+
+	// At offset 0x20, 4 bytes, number of items to loop (big endian)
+	for ( i = 0; i < 4; i++ )
+		header.item_count = ( header.item_count << 8 ) + data[offset+i];
+	offset += 4;
+
+	// At offset 0x24, start loop item_count times
+	// Items are decoded straight from the file, no copies are made
+	for ( i = 0; i < header.item_count; i++ ) {
+		if ( das_item_next( data, size, &offset, &item ) == -1 ) {
+			fprintf( stderr, "  ERROR: Header item %d is truncated.\n", i );
+			header.size = 0;
+			return( header );
+		}
+		switch ( item.hash ) {
+			case 0x92796772: // Player Name
+				das_slice_str( header.player_name, 24, item.value );
+				break;
+			case 0x926E6FA0: // Race, 0 = human, 1 = elf, 2 = dwarf, 3 = qunari
+				switch ( item.value.len > 0 ? item.value.ptr[0] : 0 ) {
+					case 0x30:
+						snprintf( header.player_race, 8, "Human" );
+						break;
+					case 0x31:
+						snprintf( header.player_race, 8, "Elf" );
+						break;
+					case 0x32:
+						snprintf( header.player_race, 8, "Dwarf" );
+						break;
+					case 0x33:
+						snprintf( header.player_race, 8, "Qunari" );
+						break;
+					default:
+						snprintf( header.player_race, 8, "Unknown" );
+						break;
+				}
+				break;
+			case 0x06AE718A: // Gender, 0 = male, 1 = female
+				switch ( item.value.len > 0 ? item.value.ptr[0] : 0 ) {
+					case 0x30:
+						snprintf( header.player_gender, 8, "Male" );
+						break;
+					case 0x31:
+						snprintf( header.player_gender, 8, "Female" );
+						break;
+					default:
+						snprintf( header.player_gender, 8, "Unknown" );
+						break;
+				}
+				break;
+			case 0x979CAD3D: // Total play time in seconds (float)
+				header.total_play_time = das_slice_double( item.value );
+				break;
+			case 0xB615BDD8: // 128 bit character id
+				das_slice_str( header.player_id, 64, item.value );
+				break;
+			case 0xE17097FB: // Class, 1 = warrior, 2 = rogue, 3 = mage
+				switch ( item.value.len > 0 ? item.value.ptr[0] : 0 ) {
+					case 0x31:
+						snprintf( header.player_class, 16, "Warrior" );
+						break;
+					case 0x32:
+						snprintf( header.player_class, 16, "Rogue" );
+						break;
+					case 0x33:
+						snprintf( header.player_class, 16, "Mage" );
+						break;
+					default:
+						snprintf( header.player_class, 16, "Unknown" );
+						break;
+				}
+				break;
+			case 0xE1CA2F03: // Level
+				header.player_level = (int)das_slice_ll( item.value );
+				break;
+			case 0xA521BDF0: // Position in world
+				das_slice_str( header.player_pos, 32, item.value );
+				break;
+			case 0x5F500F34: //  This may be some location code (area id)
+				das_slice_str( header.area_id, 16, item.value );
+				break;
+			case 0x2F852FB8: // Location
+				das_slice_str( header.player_location, 64, item.value );
+				break;
+			case 0xB3991F9F: // Save thumbnail image
+				das_slice_str( header.thumbnail, 64, item.value );
+				break;
+			case 0x9A832D89: // Map assets
+				das_slice_str( header.assets, 128, item.value );
+				break;
+			case 0x39AA8AB0: // Time of save
+				header.timestamp = das_slice_ll( item.value );
+				break;
+			case 0x8509F5B0: // Game exe build number (version.json)
+				das_slice_str( header.build_number, 16, item.value );
+				break;
+			case 0x0346EAF1: // Patch level
+				header.patch_number = (int)das_slice_ll( item.value );
+				break;
+			case 0x4D86FB47: // Loaded addons with ~ as seperator
+				ind = 0;
+				for ( d = 0; d < item.value.len - 1 && header.addon_count < 32; d++ ) {
+					if ( item.value.ptr[d] == 0x7E ) {
+						header.addons[header.addon_count][ind] = '\0';
+						header.addon_count++;
+						ind = 0;
+					} else if ( ind < 127 ) {
+						header.addons[header.addon_count][ind] = item.value.ptr[d];
+						header.addons[header.addon_count][ind+1] = '\0';
+						ind++;
+					}
+				}
+				break;
+			default: // Something I don't know, das_header_find can get it
+				break;
+		}
+	}
+
+	// At current offset, 4 bytes,
+	if ( offset + 4 <= size )
+		for ( i = 3; i >= 0; i-- )
+			header.data_checksum = ( header.data_checksum << 8 ) + data[offset+i];
+
+	return( header );
+
+}
+
+// Every face value we know about, indexed the same as struct handle arrays
+const struct das_field das_fields[DAS_NUM_VALUES] = {
+	{ "EYELINER_INTENSITY",      0.0f, 1.0f }, // 00
+	{ "EYELINER COLOR RED",      0.0f, 1.0f }, // 01
+	{ "EYELINER COLOR GREEN",    0.0f, 1.0f }, // 02
+	{ "EYELINER COLOR BLUE",     0.0f, 1.0f }, // 03
+	{ "EYE SHADOW INTENSITY",    0.0f, 1.0f }, // 04
+	{ "EYE SHADOW COLOR RED",    0.0f, 1.0f }, // 05
+	{ "EYE SHADOW COLOR GREEN",  0.0f, 1.0f }, // 06
+	{ "EYE SHADOW COLOR BLUE",   0.0f, 1.0f }, // 07
+	{ "UNDER-EYE COLOR RED",     0.0f, 1.0f }, // 08
+	{ "UNDER-EYE COLOR GREEN",   0.0f, 1.0f }, // 09
+	{ "UNDER-EYE COLOR BLUE",    0.0f, 1.0f }, // 10
+	{ "BLUSH INTENSITY",         0.0f, 1.0f }, // 11
+	{ "BLUSH COLOR RED",         0.0f, 1.0f }, // 12
+	{ "BLUSH COLOR GREEN",       0.0f, 1.0f }, // 13
+	{ "BLUSH COLOR BLUE",        0.0f, 1.0f }, // 14
+	{ "LIP SHINE",               0.0f, 1.0f }, // 15
+	{ "LIP INTENSITY",           0.0f, 1.0f }, // 16
+	{ "LIP COLOR RED",           0.0f, 1.0f }, // 17
+	{ "LIP COLOR GREEN",         0.0f, 1.0f }, // 18
+	{ "LIP COLOR BLUE",          0.0f, 1.0f }, // 19
+	{ "LIP LINER COLOR RED",     0.0f, 1.0f }, // 20
+	{ "LIP LINER COLOR GREEN",   0.0f, 1.0f }, // 21
+	{ "LIP LINER COLOR BLUE",    0.0f, 1.0f }, // 22
+	{ "UNDER-BROW INTENSITY",    0.0f, 1.0f }, // 23
+	{ "UNDER-BROW COLOR RED",    0.0f, 1.0f }, // 24
+	{ "UNDER-BROW COLOR GREEN",  0.0f, 1.0f }, // 25
+	{ "UNDER-BROW COLOR BLUE",   0.0f, 1.0f }, // 26
+	{ "EYEBROW COLOR RED",       0.0f, 1.0f }, // 27
+	{ "EYEBROW COLOR GREEN",     0.0f, 1.0f }, // 28
+	{ "EYEBROW COLOR BLUE",      0.0f, 1.0f }, // 29
+	{ "EYELASH COLOR RED",       0.0f, 1.0f }, // 30
+	{ "EYELASH COLOR GREEN",     0.0f, 1.0f }, // 31
+	{ "EYELASH COLOR BLUE",      0.0f, 1.0f }, // 32
+	{ "HAIR COLOR RED",          0.0f, 1.0f }, // 33
+	{ "HAIR COLOR GREEN",        0.0f, 1.0f }, // 34
+	{ "HAIR COLOR BLUE",         0.0f, 1.0f }, // 35
+	{ "HAIR SPEC1 COLOR RED",    0.0f, 1.0f }, // 36
+	{ "HAIR SPEC1 COLOR GREEN",  0.0f, 1.0f }, // 37
+	{ "HAIR SPEC1 COLOR BLUE",   0.0f, 1.0f }, // 38
+	{ "HAIR SPEC2 COLOR RED",    0.0f, 1.0f }, // 39
+	{ "HAIR SPEC2 COLOR GREEN",  0.0f, 1.0f }, // 40
+	{ "HAIR SPEC2 COLOR BLUE",   0.0f, 1.0f }, // 41
+	{ "SCALP HAIR COLOR RED",    0.0f, 1.0f }, // 42
+	{ "SCALP HAIR COLOR GREEN",  0.0f, 1.0f }, // 43
+	{ "SCALP HAIR COLOR BLUE",   0.0f, 1.0f }, // 44
+	{ "FACIAL HAIR COLOR RED",   0.0f, 1.0f }, // 45
+	{ "FACIAL HAIR COLOR GREEN", 0.0f, 1.0f }, // 46
+	{ "FACIAL HAIR COLOR BLUE",  0.0f, 1.0f }, // 47
+	{ "INNER IRIS COLOR RED",    0.0f, 1.0f }, // 48
+	{ "INNER IRIS COLOR GREEN",  0.0f, 1.0f }, // 49
+	{ "INNER IRIS COLOR BLUE",   0.0f, 1.0f }, // 50
+	{ "OUTER IRIS COLOR RED",    0.0f, 1.0f }, // 51
+	{ "OUTER IRIS COLOR GREEN",  0.0f, 1.0f }, // 52
+	{ "OUTER IRIS COLOR BLUE",   0.0f, 1.0f }  // 53
+};
+
+// Hashes in the face block, each followed by count values stride bytes apart
+const struct das_anchor das_anchors[DAS_NUM_ANCHORS] = {
+	{ 0x4560EB1D, 4, 4, { 0, 4, 11, 16 } }, // 00 Eyeliner/Eye Shadow/Blush/Lip Intensity
+	{ 0xB4E2B58B, 2, 8, { 15, 23 } },       // 01 Lip Shine, Under-Brow Intensity
+	{ 0x982C9069, 3, 4, { 27, 28, 29 } },   // 02 Eyebrow Color
+	{ 0x5923F86C, 3, 4, { 12, 13, 14 } },   // 03 Blush Color
+	{ 0x27E256DA, 3, 4, { 1, 2, 3 } },      // 04 Eyeliner Color
+	{ 0xCBF6A094, 3, 4, { 8, 9, 10 } },     // 05 Under-Eye Color
+	{ 0xCBF6A097, 3, 4, { 5, 6, 7 } },      // 06 Eye Shadow Color
+	{ 0x181A7B16, 3, 4, { 20, 21, 22 } },   // 07 Lip Liner Color
+	{ 0x3C775B99, 3, 4, { 17, 18, 19 } },   // 08 Lip Color
+	{ 0x319BF572, 3, 4, { 42, 43, 44 } },   // 09 Scalp Color
+	{ 0x99631BDF, 3, 4, { 24, 25, 26 } },   // 10 Under-Brow Color
+	{ 0x860AD2A3, 3, 4, { 45, 46, 47 } },   // 11 Facial Hair Color
+	{ 0x3BD3FFDC, 3, 4, { 48, 49, 50 } },   // 12 Inner Iris Color
+	{ 0x75D44C82, 3, 4, { 51, 52, 53 } },   // 13 Outer Iris Color
+	{ 0x0C2A5CEE, 3, 4, { 30, 31, 32 } },   // 14 Eyelash Color
+	{ 0x6B2444AA, 3, 4, { 33, 34, 35 } },   // 15 Hair Color
+	{ 0x4BFD7239, 3, 4, { 36, 37, 38 } },   // 16 Hair Spec1 Color
+	{ 0xF63C0CBA, 3, 4, { 39, 40, 41 } }    // 17 Hair Spec2 Color
+};
+
+// Perfect hash of the anchors: ( hash * DAS_ANCHOR_MUL ) >> 27 is unique
+// for every anchor, this maps the 32 slots back to das_anchors (-1 = none)
+#define DAS_ANCHOR_MUL 0x6DDA0B39u
+static const signed char das_anchor_slot[32] = {
+	14,  6, 11, 10, -1,  0, -1, -1, 15,  9, -1, 16,  4, -1, 17,  2,
+	-1, -1, -1, -1, -1,  7, -1,  8,  5,  1, -1, 13, -1,  3, -1, 12
+};
+
+int das_anchor_lookup( unsigned int hash ) {
+
+	int slot = das_anchor_slot[( hash * DAS_ANCHOR_MUL ) >> 27];
+	if ( slot == -1 || das_anchors[slot].hash != hash )
+		return( -1 );
+	return( slot );
+
+}
+
+const char* das_str_lookup( int index ) {
+
+	if ( index < 0 || index >= DAS_NUM_VALUES )
+		return( NULL );
+	return( das_fields[index].name );
+
+}
+
+int das_face_scan( struct das_file* file, const struct xml_hit* hits, int hit_count,
+		struct handle* value, struct das_view* view ) {
+
+	// Variables
+	unsigned char* data = file->data;
+	int filesize = (int)file->size;
+	int offset = 0, shift_count = -1, d = 0, i = 0;
+
+	// Use the smallest shift that has a readable XML file, no XML means
+	// no face data. Nothing is printed, libdas calls this too.
+	for ( i = 0; i < hit_count; i++ )
+		if ( shift_count == -1 || hits[i].shift < shift_count )
+			shift_count = hits[i].shift;
+	if ( shift_count == -1 )
+		return( -1 );
+
+	// Read the file through a bit aligned view instead of shifting it
+	double start = das_stats_start();
+	*view = das_view_init( data, filesize, shift_count );
+	view->file = file;
+
+	// Initalize structs that hold the data
+	for ( i = 0; i < DAS_NUM_VALUES; i++ ) {
+		value[i].hash   = 0;
+		value[i].offset = -1;
+		value[i].fp_val = 0;
+		value[i].min    = 0;
+		value[i].max    = 0;
+		memcpy( value[i].name, das_fields[i].name, sizeof( value[i].name ) );
+	}
+
+	// The face block ends where the first xml file starts
+	// We need to do this because custom Hawkes
+	int end = filesize - 4;
+	for ( i = 0; i < hit_count; i++ )
+		if ( hits[i].shift == shift_count && hits[i].offset >= 4 && hits[i].offset < end )
+			end = hits[i].offset;
+
+	// Search for values and store location & value
+	// Only offsets whose lead bytes fit an anchor at this shift are hashed.
+	// The first occurrence of an anchor wins, later copies are stepped over
+	// without being read, so the scan can stop once every anchor was seen
+	struct das_scan scan = { .count = 0 };
+	memset( scan.first, 0, sizeof( scan.first ) );
+	for ( i = 0; i < DAS_NUM_ANCHORS; i++ ) {
+		unsigned char tbytes[4] = {
+			das_anchors[i].hash >> 24, das_anchors[i].hash >> 16,
+			das_anchors[i].hash >> 8, das_anchors[i].hash
+		};
+		das_scan_add( &scan, tbytes, shift_count );
+	}
+	int found[DAS_NUM_ANCHORS] = { 0 };
+	int found_count = 0, anchor = -1;
+	for ( offset = das_scan_next( &scan, data, 4, end );
+			offset < end && found_count < DAS_NUM_ANCHORS;
+			offset = das_scan_next( &scan, data, offset + 1, end ) ) {
+		if ( ( anchor = das_anchor_lookup( das_view_read_u32( view, offset ) ) ) == -1 )
+			continue;
+		// Values follow the hash, stride bytes apart
+		const struct das_anchor* an = &das_anchors[anchor];
+		if ( offset + an->count * an->stride + 4 > filesize )
+			continue;
+		if ( found[anchor] ) {
+			offset += an->count * an->stride;
+			continue;
+		}
+		for ( d = 0; d < an->count; d++ ) {
+			int index = an->index[d];
+			offset += an->stride;
+			value[index] = das_set_struct( view, value[index].name, offset,
+				das_fields[index].min, das_fields[index].max );
+		}
+		found[anchor] = 1;
+		found_count++;
+	}
+
+	if ( das_stats_cur ) {
+		das_stats_cur->bytes_scanned += end - 4;
+		das_stats_cur->anchors = found_count;
+		das_stats_cur->shift = shift_count;
+	}
+	das_stats_stop( DAS_STAGE_VALUES, start );
+	return( 0 );
+
+}
+
+struct handle
+das_set_struct(	const struct das_view* view, const char title[32], int ioffset, float imin, float imax ) {
+
+	// Initialize struct with in values
+	struct handle hb = {
+		.hash = 0,
+		.offset = ioffset,
+		.fp_val = 0,
+		.min = imin,
+		.max = imax,
+		.name = "(NULL)"
+	};
+
+	// Set title
+	snprintf( hb.name, 32, "%s", title );
+
+	// Set hash and float value
+	hb.hash = (int)das_view_read_u32( view, hb.offset );
+	hb.fp_val = das_view_read_f32( view, hb.offset );
+
+	// Return the new struct
+	return( hb );
+
+}
+
+void das_xml_iter_init( struct das_xml_iter* it, const unsigned char* data, int filesize ) {
+
+	// Rotating the file right by d bits turns byte i into
+	// ( data[i-1] << 8 | data[i] ) >> d, so "<?xml" at (i, d) means the
+	// 48 bit window data[i-1..i+4] shifted right by d equals the pattern.
+	// Let the scanner find offsets whose lead pair fits any shift first.
+	unsigned char xmlstr[5] = { 0x3C, 0x3F, 0x78, 0x6D, 0x6C };
+	int d = 0;
+	it->data = data;
+	it->size = filesize;
+	it->pos = 0;
+	it->at = 0;
+	it->pending = 0;
+	it->scan.count = 0;
+	memset( it->scan.first, 0, sizeof( it->scan.first ) );
+	for ( d = 0; d < 8; d++ )
+		das_scan_add( &it->scan, xmlstr, d );
+	if ( data == NULL || filesize < 6 )
+		it->pos = it->size = 0;
+
+}
+
+int das_xml_iter_next( struct das_xml_iter* it, struct xml_hit* hit ) {
+
+	// "<?xml" as a 40 bit big endian pattern
+	const unsigned long long pattern = 0x3C3F786D6CULL;
+	const unsigned long long mask = 0xFFFFFFFFFFULL;
+	const unsigned char* data = it->data;
+	unsigned long long window = 0;
+	int end = it->size - 5, d = 0;
+
+	for ( ;; ) {
+		// Shifts still to report at the last offset, smallest first
+		for ( d = 0; d < 8; d++ )
+			if ( it->pending & ( 1 << d ) ) {
+				it->pending &= ~( 1 << d );
+				hit->offset = it->at;
+				hit->shift = d;
+				return( 1 );
+			}
+		if ( it->pos >= end )
+			return( 0 );
+		it->at = das_scan_next( &it->scan, data, it->pos, end );
+		if ( it->at >= end ) {
+			it->pos = end;
+			return( 0 );
+		}
+		it->pos = it->at + 1;
+		// Window holds data[i-1..i+4], data[-1] wraps around like the rotation
+		window = ( it->at == 0 ) ? data[it->size-1] : data[it->at-1];
+		for ( d = 0; d < 5; d++ )
+			window = ( window << 8 ) | data[it->at+d];
+		// Check all 8 shifts at once
+		for ( d = 0; d < 8; d++ )
+			if ( ( ( window >> d ) & mask ) == pattern )
+				it->pending |= 1 << d;
+	}
+
+}
+
+int das_find_xmls( const unsigned char* data, int filesize, struct xml_hit** hits ) {
+
+	// Every hit in one array, for callers that need them all up front
+	struct das_xml_iter it;
+	struct xml_hit hit;
+	int hit_count = 0, hit_alloc = 0;
+	double start = das_stats_start();
+	*hits = NULL;
+	das_xml_iter_init( &it, data, filesize );
+	while ( das_xml_iter_next( &it, &hit ) ) {
+		if ( hit_count == hit_alloc ) {
+			hit_alloc = hit_alloc ? hit_alloc * 2 : 16;
+			struct xml_hit* tmp =
+				(struct xml_hit*)realloc( *hits, hit_alloc * sizeof( struct xml_hit ) );
+			if ( tmp == NULL ) {
+				fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+				free( *hits );
+				*hits = NULL;
+				return( -1 );
+			}
+			*hits = tmp;
+			if ( das_stats_cur )
+				das_stats_cur->allocs++;
+		}
+		(*hits)[hit_count++] = hit;
+	}
+
+	if ( das_stats_cur ) {
+		das_stats_cur->bytes_scanned += filesize;
+		das_stats_cur->xmls = hit_count;
+	}
+	das_stats_stop( DAS_STAGE_ALIGN, start );
+	return( hit_count );
+
+}
+
+struct das_view das_view_init( unsigned char* base, int size, int shift ) {
+
+	struct das_view view = {
+		.base  = base,
+		.size  = size,
+		.shift = shift & 7,
+		.file  = NULL
+	};
+	return( view );
+
+}
+
+unsigned char das_view_u8( const struct das_view* view, int offset ) {
+
+	// Top shift bits come from the previous byte, the rest from this one.
+	// Byte -1 wraps around to the end of the file, same as a rotation.
+	if ( view->shift == 0 )
+		return( view->base[offset] );
+	int prev = ( offset == 0 ) ? view->size - 1 : offset - 1;
+	return( (unsigned char)( ( ( view->base[prev] << 8 ) | view->base[offset] ) >> view->shift ) );
+
+}
+
+void das_view_read( const struct das_view* view, int offset, unsigned char* dst, int size ) {
+
+	int i = 0;
+	if ( view->shift == 0 ) {
+		memcpy( dst, view->base + offset, size );
+		return;
+	}
+	// Only byte 0 wraps, the rest is a straight two byte window
+	if ( size > 0 && offset == 0 ) {
+		dst[0] = das_view_u8( view, 0 );
+		i = 1;
+	}
+	for ( ; i < size; i++ )
+		dst[i] = (unsigned char)( ( ( view->base[offset+i-1] << 8 ) |
+			view->base[offset+i] ) >> view->shift );
+
+}
+
+void das_view_write( struct das_view* view, int offset, const unsigned char* src, int size ) {
+
+	int i = 0;
+	if ( view->shift == 0 ) {
+		memcpy( view->base + offset, src, size );
+		if ( view->file != NULL )
+			das_file_touch( view->file, offset, size );
+		return;
+	}
+
+	// Remember the file bytes this write lands on
+	if ( view->file != NULL ) {
+		if ( offset == 0 ) {
+			das_file_touch( view->file, view->size - 1, 1 );
+			das_file_touch( view->file, 0, size );
+		} else {
+			das_file_touch( view->file, offset - 1, size + 1 );
+		}
+	}
+
+	// Each view byte straddles two file bytes, only touch its own bits
+	unsigned char low_mask = (unsigned char)( ( 1 << view->shift ) - 1 );
+	for ( i = 0; i < size; i++ ) {
+		int cur = offset + i;
+		int prev = ( cur == 0 ) ? view->size - 1 : cur - 1;
+		view->base[prev] = ( view->base[prev] & ~low_mask ) | ( src[i] >> ( 8 - view->shift ) );
+		view->base[cur] = ( view->base[cur] & low_mask ) | (unsigned char)( src[i] << view->shift );
+	}
+
+}
+
+unsigned int das_view_read_u32( const struct das_view* view, int offset ) {
+
+	// Big endian, the order hashes are stored in
+	unsigned char tbytes[4] = { 0, 0, 0, 0 };
+	das_view_read( view, offset, tbytes, 4 );
+	return( ( (unsigned int)tbytes[0] << 24 ) | ( tbytes[1] << 16 ) | ( tbytes[2] << 8 ) | tbytes[3] );
+
+}
+
+float das_view_read_f32( const struct das_view* view, int offset ) {
+
+	// Floats are stored little endian, same as the machine
+	float val = 0;
+	unsigned char tbytes[4] = { 0, 0, 0, 0 };
+	das_view_read( view, offset, tbytes, 4 );
+	memcpy( &val, tbytes, sizeof( float ) );
+	return( val );
+
+}
+
+void das_view_write_f32( struct das_view* view, int offset, float val ) {
+
+	unsigned char tbytes[4] = { 0, 0, 0, 0 };
+	memcpy( tbytes, &val, sizeof( float ) );
+	das_view_write( view, offset, tbytes, 4 );
+
+}
+
+int das_view_memcmp( const struct das_view* view, int offset, const unsigned char* str, int size ) {
+
+	int i = 0;
+	for ( i = 0; i < size; i++ ) {
+		unsigned char c = das_view_u8( view, offset + i );
+		if ( c != str[i] )
+			return( c < str[i] ? -1 : 1 );
+	}
+	return( 0 );
+
+}
+
+void das_sax_init( struct das_sax* sax, const struct das_view* view, int offset, int size ) {
+
+	sax->view = view;
+	sax->pos = offset;
+	sax->end = offset + size;
+	sax->in_tag = 0;
+	sax->close = 0;
+	sax->tag_end = -1;
+	sax->depth = 0;
+	sax->name.offset = sax->name.len = 0;
+	sax->value.offset = sax->value.len = 0;
+
+}
+
+static int das_sax_space( unsigned char c ) {
+
+	return( c == ' ' || c == '\t' || c == '\r' || c == '\n' );
+
+}
+
+static int das_sax_skip( struct das_sax* sax, const char* until ) {
+
+	// Past the next until, or fail at the end of the span
+	int len = (int)strlen( until );
+	for ( ; sax->pos + len <= sax->end; sax->pos++ )
+		if ( das_view_memcmp( sax->view, sax->pos, (const unsigned char*)until, len ) == 0 ) {
+			sax->pos += len;
+			return( 0 );
+		}
+	return( -1 );
+
+}
+
+static void das_sax_name( struct das_sax* sax ) {
+
+	unsigned char c = 0;
+	sax->name.offset = sax->pos;
+	while ( sax->pos < sax->end ) {
+		c = das_view_u8( sax->view, sax->pos );
+		if ( das_sax_space( c ) || c == '=' || c == '/' || c == '>' )
+			break;
+		sax->pos++;
+	}
+	sax->name.len = sax->pos - sax->name.offset;
+
+}
+
+int das_sax_next( struct das_sax* sax ) {
+
+	const struct das_view* view = sax->view;
+	unsigned char c = 0;
+	for ( ;; ) {
+		// <x/> reports its close right after the open
+		if ( sax->close ) {
+			sax->close = 0;
+			sax->name = sax->stack[--sax->depth];
+			return( DAS_SAX_CLOSE );
+		}
+
+		// Attributes of the last start tag
+		if ( sax->in_tag ) {
+			while ( sax->pos < sax->end && das_sax_space( das_view_u8( view, sax->pos ) ) )
+				sax->pos++;
+			if ( sax->pos >= sax->end )
+				return( DAS_SAX_ERROR );
+			c = das_view_u8( view, sax->pos );
+			if ( c == '/' || c == '>' ) {
+				sax->pos += c == '/' ? 2 : 1;
+				sax->close = c == '/';
+				sax->in_tag = 0;
+				sax->tag_end = sax->pos;
+				continue;
+			}
+			das_sax_name( sax );
+			while ( sax->pos < sax->end && das_sax_space( das_view_u8( view, sax->pos ) ) )
+				sax->pos++;
+			if ( sax->name.len == 0 || sax->pos >= sax->end || das_view_u8( view, sax->pos ) != '=' )
+				return( DAS_SAX_ERROR );
+			sax->pos++;
+			while ( sax->pos < sax->end && das_sax_space( das_view_u8( view, sax->pos ) ) )
+				sax->pos++;
+			if ( sax->pos >= sax->end )
+				return( DAS_SAX_ERROR );
+			c = das_view_u8( view, sax->pos++ );
+			if ( c != '"' && c != '\'' )
+				return( DAS_SAX_ERROR );
+			sax->value.offset = sax->pos;
+			while ( sax->pos < sax->end && das_view_u8( view, sax->pos ) != c )
+				sax->pos++;
+			if ( sax->pos >= sax->end )
+				return( DAS_SAX_ERROR );
+			sax->value.len = sax->pos++ - sax->value.offset;
+			return( DAS_SAX_ATTR );
+		}
+
+		if ( sax->pos >= sax->end )
+			return( DAS_SAX_END );
+
+		// Text up to the next tag, whitespace only text is skipped
+		if ( das_view_u8( view, sax->pos ) != '<' ) {
+			int blank = 1;
+			sax->value.offset = sax->pos;
+			for ( ; sax->pos < sax->end && ( c = das_view_u8( view, sax->pos ) ) != '<'; sax->pos++ )
+				blank = blank && das_sax_space( c );
+			sax->value.len = sax->pos - sax->value.offset;
+			if ( blank )
+				continue;
+			if ( sax->depth > 0 )
+				sax->name = sax->stack[sax->depth-1];
+			return( DAS_SAX_TEXT );
+		}
+
+		// Declarations and comments are skipped
+		c = sax->pos + 1 < sax->end ? das_view_u8( view, sax->pos + 1 ) : 0;
+		if ( c == '?' || c == '!' ) {
+			int comment = c == '!' && das_view_memcmp( view, sax->pos, (const unsigned char*)"<!--", 4 ) == 0;
+			if ( das_sax_skip( sax, c == '?' ? "?>" : comment ? "-->" : ">" ) == -1 )
+				return( DAS_SAX_ERROR );
+			continue;
+		}
+		if ( c == '/' ) {
+			sax->pos += 2;
+			das_sax_name( sax );
+			if ( sax->depth == 0 || das_sax_skip( sax, ">" ) == -1 )
+				return( DAS_SAX_ERROR );
+			sax->name = sax->stack[--sax->depth];
+			return( DAS_SAX_CLOSE );
+		}
+		sax->pos++;
+		das_sax_name( sax );
+		if ( sax->name.len == 0 || sax->depth == DAS_SAX_DEPTH )
+			return( DAS_SAX_ERROR );
+		sax->stack[sax->depth++] = sax->name;
+		sax->in_tag = 1;
+		return( DAS_SAX_OPEN );
+	}
+
+}
+
+int das_sax_is( const struct das_sax* sax, struct das_span span, const char* str, int len ) {
+
+	return( span.len == len && das_view_memcmp( sax->view, span.offset, (const unsigned char*)str, len ) == 0 );
+
+}
+
+void das_scan_add( struct das_scan* scan, const unsigned char* pattern, int shift ) {
+
+	// A pattern of 3+ bytes at view offset i with this shift fully
+	// determines file bytes i and i+1, so those make the lead pair
+	int i = 0;
+	unsigned char a = (unsigned char)( ( pattern[0] << shift ) | ( pattern[1] >> ( 8 - shift ) ) );
+	unsigned char b = (unsigned char)( ( pattern[1] << shift ) | ( pattern[2] >> ( 8 - shift ) ) );
+	for ( i = 0; i < scan->count; i++ )
+		if ( scan->lead[i][0] == a && scan->lead[i][1] == b )
+			return;
+	if ( scan->count >= DAS_SCAN_MAX )
+		return;
+	scan->lead[scan->count][0] = a;
+	scan->lead[scan->count][1] = b;
+	scan->first[a] = 1;
+	scan->count++;
+
+}
+
+static int das_scan_next_scalar( const struct das_scan* scan, const unsigned char* data,
+		int pos, int end ) {
+
+	int i = 0, d = 0;
+	for ( i = pos; i < end; i++ ) {
+		if ( !scan->first[data[i]] )
+			continue;
+		for ( d = 0; d < scan->count; d++ )
+			if ( scan->lead[d][0] == data[i] && scan->lead[d][1] == data[i+1] )
+				return( i );
+	}
+	return( end );
+
+}
+
+#ifdef DAS_SCAN_SIMD
+__attribute__(( target( "sse2" ) ))
+static int das_scan_next_sse2( const struct das_scan* scan, const unsigned char* data,
+		int pos, int end ) {
+
+	// Compare 16 lanes against every lead pair at once
+	int i = pos, d = 0;
+	for ( ; i + 16 <= end; i += 16 ) {
+		__m128i v0 = _mm_loadu_si128( (const __m128i*)( data + i ) );
+		__m128i v1 = _mm_loadu_si128( (const __m128i*)( data + i + 1 ) );
+		__m128i hit = _mm_setzero_si128();
+		for ( d = 0; d < scan->count; d++ )
+			hit = _mm_or_si128( hit, _mm_and_si128(
+				_mm_cmpeq_epi8( v0, _mm_set1_epi8( (char)scan->lead[d][0] ) ),
+				_mm_cmpeq_epi8( v1, _mm_set1_epi8( (char)scan->lead[d][1] ) ) ) );
+		int mask = _mm_movemask_epi8( hit );
+		if ( mask )
+			return( i + __builtin_ctz( mask ) );
+	}
+	return( das_scan_next_scalar( scan, data, i, end ) );
+
+}
+
+__attribute__(( target( "avx2" ) ))
+static int das_scan_next_avx2( const struct das_scan* scan, const unsigned char* data,
+		int pos, int end ) {
+
+	// Same as sse2, 32 lanes at a time
+	int i = pos, d = 0;
+	for ( ; i + 32 <= end; i += 32 ) {
+		__m256i v0 = _mm256_loadu_si256( (const __m256i*)( data + i ) );
+		__m256i v1 = _mm256_loadu_si256( (const __m256i*)( data + i + 1 ) );
+		__m256i hit = _mm256_setzero_si256();
+		for ( d = 0; d < scan->count; d++ )
+			hit = _mm256_or_si256( hit, _mm256_and_si256(
+				_mm256_cmpeq_epi8( v0, _mm256_set1_epi8( (char)scan->lead[d][0] ) ),
+				_mm256_cmpeq_epi8( v1, _mm256_set1_epi8( (char)scan->lead[d][1] ) ) ) );
+		unsigned int mask = (unsigned int)_mm256_movemask_epi8( hit );
+		if ( mask )
+			return( i + __builtin_ctz( mask ) );
+	}
+	return( das_scan_next_sse2( scan, data, i, end ) );
+
+}
+#endif
+
+static int ( *das_scan_next_fn )( const struct das_scan*, const unsigned char*, int, int ) = NULL;
+
+void das_scan_init( void ) {
+
+	// Pick the widest scanner this cpu has
+	if ( das_scan_next_fn != NULL )
+		return;
+#ifdef DAS_SCAN_SIMD
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "avx2" ) )
+		das_scan_next_fn = das_scan_next_avx2;
+	else if ( __builtin_cpu_supports( "sse2" ) )
+		das_scan_next_fn = das_scan_next_sse2;
+	else
+#endif
+		das_scan_next_fn = das_scan_next_scalar;
+
+}
+
+int das_scan_next( const struct das_scan* scan, const unsigned char* data, int pos, int end ) {
+
+	if ( das_scan_next_fn == NULL )
+		das_scan_init();
+	if ( pos >= end )
+		return( end );
+	return( das_scan_next_fn( scan, data, pos, end ) );
+
+}
+
+void das_file_close( struct das_file* file ) {
+
+	if ( file->data == NULL )
+		return;
+#ifdef DAS_MMAP
+	if ( file->mapped ) {
+		munmap( file->data, file->size );
+		close( file->fd );
+	} else
+#endif
+		free( file->data );
+	file->data = NULL;
+	file->size = 0;
+	file->fd = -1;
+
+}
+
+void das_file_touch( struct das_file* file, size_t offset, size_t size ) {
+
+	// Remember which bytes changed, merging overlapping or adjacent ranges
+	int i = 0;
+	size_t end = offset + size;
+	for ( i = 0; i < file->dirty_count; i++ ) {
+		if ( offset <= file->dirty[i].end && end >= file->dirty[i].start ) {
+			if ( offset < file->dirty[i].start )
+				file->dirty[i].start = offset;
+			if ( end > file->dirty[i].end )
+				file->dirty[i].end = end;
+			return;
+		}
+	}
+
+	// Out of slots, grow the last range over the gap instead
+	if ( file->dirty_count == DAS_DIRTY_MAX ) {
+		i = DAS_DIRTY_MAX - 1;
+		if ( offset < file->dirty[i].start )
+			file->dirty[i].start = offset;
+		if ( end > file->dirty[i].end )
+			file->dirty[i].end = end;
+		return;
+	}
+	file->dirty[file->dirty_count].start = offset;
+	file->dirty[file->dirty_count].end = end;
+	file->dirty_count++;
+
+}
+
+// CRC-32 (IEEE 802.3, reflected), sliced eight bytes at a time
+static unsigned int das_crc_table[8][256];
+static pthread_once_t das_crc_once = PTHREAD_ONCE_INIT;
+
+static void das_crc32_init( void ) {
+
+	unsigned int i = 0, k = 0, c = 0;
+	for ( i = 0; i < 256; i++ ) {
+		c = i;
+		for ( k = 0; k < 8; k++ )
+			c = c & 1 ? ( c >> 1 ) ^ 0xEDB88320u : c >> 1;
+		das_crc_table[0][i] = c;
+	}
+	// Table k is the crc of a byte followed by k zero bytes
+	for ( i = 0; i < 256; i++ )
+		for ( k = 1; k < 8; k++ )
+			das_crc_table[k][i] = ( das_crc_table[k-1][i] >> 8 ) ^
+				das_crc_table[0][das_crc_table[k-1][i] & 0xFF];
+
+}
+
+unsigned int das_crc32( unsigned int crc, const unsigned char* data, size_t size ) {
+
+	// Little endian only, like the rest of the program
+	pthread_once( &das_crc_once, das_crc32_init );
+	crc = ~crc;
+	while ( size >= 8 ) {
+		unsigned int lo = 0, hi = 0;
+		memcpy( &lo, data, 4 );
+		memcpy( &hi, data + 4, 4 );
+		lo ^= crc;
+		crc = das_crc_table[7][lo & 0xFF] ^ das_crc_table[6][( lo >> 8 ) & 0xFF] ^
+			das_crc_table[5][( lo >> 16 ) & 0xFF] ^ das_crc_table[4][lo >> 24] ^
+			das_crc_table[3][hi & 0xFF] ^ das_crc_table[2][( hi >> 8 ) & 0xFF] ^
+			das_crc_table[1][( hi >> 16 ) & 0xFF] ^ das_crc_table[0][hi >> 24];
+		data += 8;
+		size -= 8;
+	}
+	while ( size-- )
+		crc = ( crc >> 8 ) ^ das_crc_table[0][( crc ^ *data++ ) & 0xFF];
+	return( ~crc );
+
+}
+
+int das_checksum_compute( const unsigned char* data, size_t size, const struct header* header,
+		unsigned int* header_crc, unsigned int* data_crc ) {
+
+	// data_checksum covers the data after the FBHEADER block, the header
+	// checksum covers the FBHEADER block itself, data_checksum included
+	size_t start = (size_t)DAS_HEADER_START + header->size;
+	if ( header->size < 4 || header->data_size < 0 || start + header->data_size > size ) {
+		fprintf( stderr, ":: ERROR: Checksummed ranges are outside the file.\n" );
+		return( -1 );
+	}
+	*data_crc = das_crc32( 0, data + start, header->data_size );
+	*header_crc = das_crc32( 0, data + DAS_HEADER_START, header->size );
+	return( 0 );
+
+}
+
+int das_checksum_fix( struct das_file* file ) {
+
+	// data_checksum first, it is part of what the header checksum covers
+	struct header header = das_read_header( file->data, file->size );
+	unsigned int header_crc = 0, data_crc = 0;
+	int i = 0;
+	if ( header.size == 0 || !file->writable ||
+			das_checksum_compute( file->data, file->size, &header, &header_crc, &data_crc ) == -1 )
+		return( -1 );
+	size_t at = DAS_HEADER_START + header.size - 4;
+	for ( i = 0; i < 4; i++ )
+		file->data[at+i] = data_crc >> ( 8 * i );
+	das_file_touch( file, at, 4 );
+	header_crc = das_crc32( 0, file->data + DAS_HEADER_START, header.size );
+	for ( i = 0; i < 4; i++ )
+		file->data[DAS_PREFIX_SIZE+i] = header_crc >> ( 8 * i );
+	das_file_touch( file, DAS_PREFIX_SIZE, 4 );
+	return( 0 );
+
+}
+
+double das_stats_start( void ) {
+
+	struct timespec ts;
+	if ( das_stats_cur == NULL )
+		return( 0 );
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return( ts.tv_sec + ts.tv_nsec / 1e9 );
+
+}
+
+void das_stats_stop( int stage, double start ) {
+
+	struct timespec ts;
+	if ( das_stats_cur == NULL )
+		return;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	das_stats_cur->time[stage] += ts.tv_sec + ts.tv_nsec / 1e9 - start;
+
+}
+
+// One XML of a save, offset and size in view bytes at its shift
+struct das_save_xml {
+	int offset;
+	int shift;
+	int size;
+};
+
+struct das_save {
+	struct das_file      file;
+	struct header        header;
+	struct das_item*     item;
+	int                  face;      // The face values were found
+	struct das_view      view;
+	struct handle        value[DAS_NUM_VALUES];
+	struct das_save_xml* xml;
+	int                  xml_count;
+};
+
+static pthread_once_t das_lib_once = PTHREAD_ONCE_INIT;
+
+static int das_save_parse( das_save* save ) {
+
+	// The same checks das_read_header makes, done first so it never
+	// gets to print about them
+	const unsigned char* data = save->file.data;
+	size_t size = save->file.size, offset = 0x24;
+	int count = 0, i = 0;
+	if ( size < 0x24 || memcmp( data, "FBCHUNKS\x01\x00", 10 ) != 0 )
+		return( DAS_EFORMAT );
+	count = ( data[0x20] << 24 ) | ( data[0x21] << 16 ) | ( data[0x22] << 8 ) | data[0x23];
+	if ( count < 0 || (size_t)count > size / 6 )
+		return( DAS_EFORMAT );
+	if ( ( save->item = (struct das_item*)malloc( ( count + 1 ) * sizeof( struct das_item ) ) ) == NULL )
+		return( DAS_ENOMEM );
+	for ( i = 0; i < count; i++ )
+		if ( das_item_next( data, size, &offset, &save->item[i] ) == -1 )
+			return( DAS_EFORMAT );
+	save->header = das_read_header( data, size );
+	if ( save->header.size < 4 || (size_t)DAS_HEADER_START + save->header.size > size )
+		return( DAS_EFORMAT );
+
+	// Every "<?xml" at every shift, the face values are read at the smallest
+	struct das_xml_iter it;
+	struct xml_hit hit;
+	struct xml_hit* hits = NULL;
+	int hit_count = 0, hit_alloc = 0;
+	das_xml_iter_init( &it, save->file.data, (int)size );
+	while ( das_xml_iter_next( &it, &hit ) ) {
+		if ( hit_count == hit_alloc ) {
+			hit_alloc = hit_alloc ? hit_alloc * 2 : 16;
+			struct xml_hit* tmp = (struct xml_hit*)realloc( hits, hit_alloc * sizeof( struct xml_hit ) );
+			if ( tmp == NULL ) {
+				free( hits );
+				return( DAS_ENOMEM );
+			}
+			hits = tmp;
+		}
+		hits[hit_count++] = hit;
+	}
+	save->face = das_face_scan( &save->file, hits, hit_count, save->value, &save->view ) == 0;
+
+	// Only hits with a size that fits the file are XMLs, like das_dump_xmls
+	if ( ( save->xml = (struct das_save_xml*)malloc( ( hit_count + 1 ) * sizeof( struct das_save_xml ) ) ) == NULL ) {
+		free( hits );
+		return( DAS_ENOMEM );
+	}
+	for ( i = 0; i < hit_count; i++ ) {
+		struct das_view view = das_view_init( save->file.data, (int)size, hits[i].shift );
+		int xml_size = hits[i].offset >= 4 ? (int)das_view_read_u32( &view, hits[i].offset - 4 ) : 0;
+		if ( xml_size <= 0 || xml_size > (int)size - hits[i].offset )
+			continue;
+		save->xml[save->xml_count].offset = hits[i].offset;
+		save->xml[save->xml_count].shift = hits[i].shift;
+		save->xml[save->xml_count].size = xml_size;
+		save->xml_count++;
+	}
+	free( hits );
+	return( DAS_OK );
+
+}
+
+static int das_save_adopt( unsigned char* data, size_t size, das_save** save ) {
+
+	// The save takes data over and frees it, also when it fails
+	int ret = DAS_OK;
+	*save = NULL;
+	if ( data == NULL || size == 0 || size > 0x7FFFFFFF ) {
+		free( data );
+		return( DAS_EFORMAT );
+	}
+	pthread_once( &das_lib_once, das_scan_init );
+	das_save* s = (das_save*)calloc( 1, sizeof( das_save ) );
+	if ( s == NULL ) {
+		free( data );
+		return( DAS_ENOMEM );
+	}
+	s->file.data = data;
+	s->file.size = size;
+	s->file.fd = -1;
+	s->file.mapped = 0;
+	s->file.writable = 1;
+	if ( ( ret = das_save_parse( s ) ) != DAS_OK ) {
+		das_save_close( s );
+		return( ret );
+	}
+	*save = s;
+	return( DAS_OK );
+
+}
+
+int das_save_open( const void* data, size_t size, das_save** save ) {
+
+	// The save keeps its own copy, edits never reach the caller's bytes
+	unsigned char* copy = NULL;
+	*save = NULL;
+	if ( data == NULL || size == 0 || size > 0x7FFFFFFF )
+		return( DAS_EFORMAT );
+	if ( ( copy = (unsigned char*)malloc( size ) ) == NULL )
+		return( DAS_ENOMEM );
+	memcpy( copy, data, size );
+	return( das_save_adopt( copy, size, save ) );
+
+}
+
+int das_save_open_fd( int fd, das_save** save ) {
+
+	// Read to the end, so pipes and sockets work as well as files. The
+	// buffer becomes the save's, it is not copied again
+	size_t size = 0, alloc = 0;
+	unsigned char* data = NULL;
+	*save = NULL;
+	for ( ;; ) {
+		if ( size == alloc ) {
+			alloc = alloc ? alloc * 2 : 1 << 20;
+			unsigned char* tmp = (unsigned char*)realloc( data, alloc );
+			if ( tmp == NULL ) {
+				free( data );
+				return( DAS_ENOMEM );
+			}
+			data = tmp;
+		}
+		ssize_t n = read( fd, data + size, alloc - size );
+		if ( n < 0 ) {
+			free( data );
+			return( DAS_EIO );
+		}
+		if ( n == 0 )
+			break;
+		size += n;
+	}
+	return( das_save_adopt( data, size, save ) );
+
+}
+
+void das_save_close( das_save* save ) {
+
+	if ( save == NULL )
+		return;
+	das_file_close( &save->file );
+	free( save->item );
+	free( save->xml );
+	free( save );
+
+}
+
+const char* das_save_strerror( int err ) {
+
+	switch ( err ) {
+		case DAS_OK:
+			return( "Success" );
+		case DAS_ENOMEM:
+			return( "Memory allocation error" );
+		case DAS_EIO:
+			return( "Read error" );
+		case DAS_EFORMAT:
+			return( "Not a valid save file" );
+		case DAS_ENOFACE:
+			return( "Could not find face data" );
+		case DAS_ERANGE:
+			return( "Out of range" );
+		case DAS_ENOTFOUND:
+			return( "Not found in save" );
+		default:
+			return( "Unknown error" );
+	}
+
+}
+
+int das_save_get_info( const das_save* save, struct das_save_info* info ) {
+
+	const struct header* h = &save->header;
+	memset( info, 0, sizeof( struct das_save_info ) );
+	snprintf( info->name, sizeof( info->name ), "%s", h->player_name );
+	snprintf( info->race, sizeof( info->race ), "%s", h->player_race );
+	snprintf( info->gender, sizeof( info->gender ), "%s", h->player_gender );
+	snprintf( info->player_class, sizeof( info->player_class ), "%s", h->player_class );
+	info->level = h->player_level;
+	snprintf( info->location, sizeof( info->location ), "%s", h->player_location );
+	snprintf( info->area, sizeof( info->area ), "%s", h->area_id );
+	snprintf( info->id, sizeof( info->id ), "%s", h->player_id );
+	snprintf( info->build, sizeof( info->build ), "%s", h->build_number );
+	info->patch = h->patch_number;
+	info->play_time = h->total_play_time;
+	info->timestamp = h->timestamp;
+	info->item_count = h->item_count;
+	info->addon_count = h->addon_count;
+	info->header_checksum = (unsigned int)h->checksum;
+	info->data_checksum = (unsigned int)h->data_checksum;
+	return( DAS_OK );
+
+}
+
+int das_save_header_count( const das_save* save ) {
+
+	return( save->header.item_count );
+
+}
+
+int das_save_header_item( const das_save* save, int index, unsigned int* hash,
+		const unsigned char** value, size_t* len ) {
+
+	if ( index < 0 || index >= save->header.item_count )
+		return( DAS_ERANGE );
+	*hash = save->item[index].hash;
+	*value = save->item[index].value.ptr;
+	*len = save->item[index].value.len;
+	return( DAS_OK );
+
+}
+
+const char* das_face_value_name( int id ) {
+
+	return( das_str_lookup( id ) );
+
+}
+
+int das_face_value_range( int id, float* min, float* max ) {
+
+	if ( id < 0 || id >= DAS_NUM_VALUES )
+		return( DAS_ERANGE );
+	*min = das_fields[id].min;
+	*max = das_fields[id].max;
+	return( DAS_OK );
+
+}
+
+int das_save_face_get( const das_save* save, int id, float* value ) {
+
+	if ( id < 0 || id >= DAS_NUM_VALUES )
+		return( DAS_ERANGE );
+	if ( !save->face )
+		return( DAS_ENOFACE );
+	if ( save->value[id].offset == -1 )
+		return( DAS_ENOTFOUND );
+	*value = save->value[id].fp_val;
+	return( DAS_OK );
+
+}
+
+int das_save_face_set( das_save* save, int id, float value ) {
+
+	float old = 0;
+	int ret = das_save_face_get( save, id, &old );
+	if ( ret != DAS_OK )
+		return( ret );
+	if ( value < das_fields[id].min )
+		value = das_fields[id].min;
+	else if ( value > das_fields[id].max )
+		value = das_fields[id].max;
+	das_view_write_f32( &save->view, save->value[id].offset, value );
+	save->value[id].fp_val = value;
+	return( DAS_OK );
+
+}
+
+int das_save_xml_count( const das_save* save ) {
+
+	return( save->xml_count );
+
+}
+
+int das_save_xml( const das_save* save, int index, unsigned char* buf, size_t buf_size, size_t* len ) {
+
+	if ( index < 0 || index >= save->xml_count )
+		return( DAS_ERANGE );
+	const struct das_save_xml* xml = &save->xml[index];
+	*len = xml->size;
+	if ( buf == NULL )
+		return( DAS_OK );
+	if ( buf_size < (size_t)xml->size )
+		return( DAS_ERANGE );
+	struct das_view view = das_view_init( save->file.data, (int)save->file.size, xml->shift );
+	das_view_read( &view, xml->offset, buf, xml->size );
+	return( DAS_OK );
+
+}
+
+int das_save_fix_checksums( das_save* save ) {
+
+	// das_checksum_compute would complain about ranges outside the file
+	const struct header* h = &save->header;
+	if ( h->data_size < 0 ||
+			(size_t)DAS_HEADER_START + h->size + h->data_size > save->file.size )
+		return( DAS_EFORMAT );
+	if ( das_checksum_fix( &save->file ) == -1 )
+		return( DAS_EFORMAT );
+	save->header = das_read_header( save->file.data, save->file.size );
+	return( DAS_OK );
+
+}
+
+int das_save_serialize( const das_save* save, unsigned char* buf, size_t buf_size, size_t* len ) {
+
+	*len = save->file.size;
+	if ( buf == NULL )
+		return( DAS_OK );
+	if ( buf_size < save->file.size )
+		return( DAS_ERANGE );
+	memcpy( buf, save->file.data, save->file.size );
+	return( DAS_OK );
+
+}
@@ -0,0 +1,83 @@
+// libdas: the save parsing of das_editor as a library, for programs that
+// want it in process instead of running the editor once per save.
+// Every call works on its own das_save and returns a DAS_E* code. Nothing
+// is printed and no file is touched, so different saves can be used from
+// different threads at once (one das_save is not safe to share). Little
+// endian machines only, like the editor.
+// Linux: gcc -c -O2 -fPIC -fvisibility=hidden das.c -o das.o -pthread && objcopy --localize-hidden das.o && ar rcs libdas.a das.o
+//        gcc -shared -O2 -fPIC -fvisibility=hidden das.c -o libdas.so -pthread -lm
+
+#ifndef DAS_H
+#define DAS_H
+
+#include <stddef.h>
+
+#if defined( __GNUC__ )
+#	define DAS_API __attribute__(( visibility( "default" ) ))
+#else
+#	define DAS_API
+#endif
+
+#define DAS_OK          0
+#define DAS_ENOMEM     -1
+#define DAS_EIO        -2  // Reading the fd failed
+#define DAS_EFORMAT    -3  // Not a save, or its header is damaged
+#define DAS_ENOFACE    -4  // No XML to find the face values' bit shift by
+#define DAS_ERANGE     -5  // Id or index out of range, or buffer too small
+#define DAS_ENOTFOUND  -6  // The save doesn't have this value
+
+#define DAS_FACE_COUNT 54
+
+typedef struct das_save das_save;
+
+// Header fields as das_editor info prints them
+struct das_save_info {
+	char         name[24];
+	char         race[8];
+	char         gender[8];
+	char         player_class[16];
+	int          level;
+	char         location[64];
+	char         area[16];
+	char         id[64];
+	char         build[16];
+	int          patch;
+	float        play_time;      // Seconds
+	long long    timestamp;      // Julian day seconds, as stored
+	int          item_count;
+	int          addon_count;
+	unsigned int header_checksum;
+	unsigned int data_checksum;
+};
+
+// A save from memory (the bytes are copied) or from an fd open for reading
+DAS_API int das_save_open( const void* data, size_t size, das_save** save );
+DAS_API int das_save_open_fd( int fd, das_save** save );
+DAS_API void das_save_close( das_save* save );
+DAS_API const char* das_save_strerror( int err );
+
+// FBHEADER items in file order; value points into the save
+DAS_API int das_save_get_info( const das_save* save, struct das_save_info* info );
+DAS_API int das_save_header_count( const das_save* save );
+DAS_API int das_save_header_item( const das_save* save, int index, unsigned int* hash,
+	const unsigned char** value, size_t* len );
+
+// Face values by id, 0 to DAS_FACE_COUNT - 1 in das_editor's order.
+// set clamps to the value's min/max like the editor does.
+DAS_API const char* das_face_value_name( int id );
+DAS_API int das_face_value_range( int id, float* min, float* max );
+DAS_API int das_save_face_get( const das_save* save, int id, float* value );
+DAS_API int das_save_face_set( das_save* save, int id, float value );
+
+// Embedded XMLs, read at their own bit shift. With buf NULL only len is
+// set; a buf smaller than the XML gives DAS_ERANGE and the size in len.
+DAS_API int das_save_xml_count( const das_save* save );
+DAS_API int das_save_xml( const das_save* save, int index, unsigned char* buf, size_t buf_size,
+	size_t* len );
+
+// The save as it is now, optionally with both checksums recomputed first
+DAS_API int das_save_fix_checksums( das_save* save );
+DAS_API int das_save_serialize( const das_save* save, unsigned char* buf, size_t buf_size,
+	size_t* len );
+
+#endif
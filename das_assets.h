@@ -0,0 +1,113 @@
+// Generated by das_gen_assets from notes/complexion.txt and notes/slider_notes.txt, do not edit.
+// Texture hashes to asset paths, looked up through a perfect hash:
+// das_asset_slot[( hash * DAS_ASSET_MUL ) >> ( 32 - DAS_ASSET_BITS )]
+
+#define DAS_NUM_ASSETS      17
+#define DAS_NUM_COMPLEXIONS 15
+#define DAS_NUM_SKIN_TONES  11
+#define DAS_ASSET_BITS      6
+#define DAS_ASSET_MUL       0x60AC33FDu
+
+static const struct das_asset das_assets[DAS_NUM_ASSETS] = {
+	{ 0xE2BD0DB3u, "da3/actors/baseheads/humanfemale/textures/hf_hed_bas_d" },
+	{ 0x4CC192FBu, "da3/actors/baseheads/humanmale/textures/hm_hed_bas_d" },
+	{ 0xE2BD0DB9u, "da3/actors/baseheads/humanfemale/textures/hf_hed_bas_n" },
+	{ 0x4CC192F1u, "da3/actors/baseheads/humanmale/textures/hm_hed_bas_n" },
+	{ 0xE2BD0DA4u, "da3/actors/baseheads/humanfemale/textures/hf_hed_bas_s" },
+	{ 0x4CC192ECu, "da3/actors/baseheads/humanmale/textures/hm_hed_bas_s" },
+	{ 0x5BE8F0C3u, "da3/actors/baseheads/dwarffemale/textures/df_hed_base_d" },
+	{ 0x5BE8F0C9u, "da3/actors/baseheads/dwarffemale/textures/df_hed_base_n" },
+	{ 0x5BE8F0D4u, "da3/actors/baseheads/dwarffemale/textures/df_hed_base_s" },
+	{ 0x58D36475u, "da3/actors/baseheads/inquisitor/textures/hf_hed_inq_d" },
+	{ 0x58D3647Fu, "da3/actors/baseheads/inquisitor/textures/hf_hed_inq_n" },
+	{ 0x58D36462u, "da3/actors/baseheads/inquisitor/textures/hf_hed_inq_s" },
+	{ 0x4F57C652u, "da3/actors/baseheads/textures/age/uhm_age_d" },
+	{ 0x4F57C658u, "da3/actors/baseheads/textures/age/uhm_age_n" },
+	{ 0xC88D1218u, "da3/actors/baseheads/textures/rough/uhm_rough_n" },
+	{ 0xC88D1205u, "da3/actors/baseheads/textures/rough/uhm_rough_s" },
+	{ 0x548A02CCu, "da3/actors/baseheads/elfmale/textures/em_hed_bas_n" }
+};
+
+static const signed char das_asset_slot[1 << DAS_ASSET_BITS] = {
+	-1, -1, 10, -1, 0, 11, -1, -1, 6, -1, 13, -1, -1, -1, -1, -1,
+	-1, 9, 15, 1, -1, 2, -1, -1, -1, 7, 4, 16, -1, 14, -1, -1,
+	-1, 3, 8, -1, -1, -1, -1, -1, 5, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, 12, -1, -1, -1, -1, -1, -1
+};
+
+static const struct das_complexion das_complexions[DAS_NUM_COMPLEXIONS] = {
+	{ "Human", "Female", 0,
+		{ 0.000000f, 0.000000f, 0.000000f },
+		{ 0.000000f, 0.000000f, 0.000000f, 0.000000f },
+		{ 3804040627u, 1287754491u, 3804040633u, 1287754481u, 3804040612u, 1287754476u } },
+	{ "Human", "Female", 1,
+		{ 0.000000f, 0.000000f, 0.000000f },
+		{ 0.000000f, 0.000000f, 0.000000f, 0.000000f },
+		{ 1541992643u, 1287754491u, 1541992649u, 1287754481u, 1541992660u, 1287754476u } },
+	{ "Human", "Female", 2,
+		{ 0.000000f, 0.000000f, 0.000000f },
+		{ 0.000000f, 0.000000f, 0.000000f, 0.000000f },
+		{ 1490248821u, 1287754491u, 1490248831u, 1287754481u, 1490248802u, 1287754476u } },
+	{ "Human", "Female", 3,
+		{ 0.628320f, 0.900000f, 1.000000f },
+		{ 0.000000f, 0.000000f, 0.000000f, 0.000000f },
+		{ 1331152466u, 3804040627u, 1331152472u, 3364688408u, 3804040612u, 3364688389u } },
+	{ "Human", "Female", 4,
+		{ 0.500000f, 0.934620f, 0.000000f },
+		{ 0.000000f, 0.000000f, 0.000000f, 0.000000f },
+		{ 3804040627u, 1287754491u, 1287754481u, 1418330828u, 1287754476u, 1287754476u } },
+	{ "Human", "Female", 5,
+		{ 0.000000f, 0.000000f, 0.000000f },
+		{ 0.000000f, 0.550000f, 0.000000f, 0.000000f },
+		{ 3804040627u, 1287754491u, 3804040633u, 1287754481u, 3804040612u, 1287754476u } },
+	{ "Human", "Female", 6,
+		{ 0.000000f, 0.000000f, 0.000000f },
+		{ 0.000000f, 0.550000f, 0.000000f, 0.000000f },
+		{ 1541992643u, 1287754491u, 1541992649u, 1287754481u, 1541992660u, 1287754476u } },
+	{ "Human", "Female", 7,
+		{ 0.000000f, 0.000000f, 0.000000f },
+		{ 0.000000f, 0.500000f, 0.000000f, 0.000000f },
+		{ 1490248821u, 1287754491u, 1490248831u, 1287754481u, 1490248802u, 1287754476u } },
+	{ "Human", "Female", 8,
+		{ 0.500000f, 0.900000f, 1.000000f },
+		{ 0.000000f, 0.500000f, 0.000000f, 0.000000f },
+		{ 1331152466u, 3804040627u, 1331152472u, 3364688408u, 3804040612u, 3364688389u } },
+	{ "Human", "Female", 9,
+		{ 0.500000f, 0.934620f, 0.000000f },
+		{ 0.000000f, 0.500000f, 0.000000f, 0.000000f },
+		{ 3804040627u, 1287754491u, 1287754481u, 1418330828u, 1287754476u, 1287754476u } },
+	{ "Human", "Female", 10,
+		{ 0.000000f, 0.000000f, 0.000000f },
+		{ 0.500000f, 0.000000f, 0.000000f, 0.000000f },
+		{ 3804040627u, 1287754491u, 3804040633u, 1287754481u, 3804040612u, 1287754476u } },
+	{ "Human", "Female", 11,
+		{ 0.000000f, 0.000000f, 0.000000f },
+		{ 0.500000f, 0.000000f, 0.000000f, 0.000000f },
+		{ 1541992643u, 1287754491u, 1541992649u, 1287754481u, 1541992660u, 1287754476u } },
+	{ "Human", "Female", 12,
+		{ 0.000000f, 0.000000f, 0.000000f },
+		{ 0.500000f, 0.000000f, 0.000000f, 0.000000f },
+		{ 1490248821u, 1287754491u, 1490248831u, 1287754481u, 1490248802u, 1287754476u } },
+	{ "Human", "Female", 13,
+		{ 0.500000f, 0.900000f, 1.000000f },
+		{ 0.500000f, 0.000000f, 0.000000f, 0.000000f },
+		{ 1331152466u, 3804040627u, 1331152472u, 3364688408u, 3804040612u, 3364688389u } },
+	{ "Human", "Female", 14,
+		{ 0.500000f, 0.934620f, 0.000000f },
+		{ 0.500000f, 0.000000f, 0.000000f, 0.000000f },
+		{ 3804040627u, 1287754491u, 1287754481u, 1418330828u, 1287754476u, 1287754476u } }
+};
+
+static const struct das_skin_tone das_skin_tones[DAS_NUM_SKIN_TONES] = {
+	{ "Human", "Female", 0, 0x18DC7731u },
+	{ "Human", "Female", 1, 0x18DC7730u },
+	{ "Human", "Female", 2, 0x18DC7733u },
+	{ "Human", "Female", 3, 0x18DC7732u },
+	{ "Human", "Female", 4, 0x18DC7735u },
+	{ "Human", "Female", 5, 0x18DC7734u },
+	{ "Human", "Female", 6, 0x18DC7737u },
+	{ "Human", "Female", 7, 0x18DC7736u },
+	{ "Human", "Female", 8, 0x18DC7739u },
+	{ "Human", "Female", 9, 0x18DC7738u },
+	{ "Human", "Female", 10, 0x18DC76D0u }
+};
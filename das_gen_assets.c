@@ -0,0 +1,293 @@
+// Generates das_assets.h from the notes, so main.c never parses them.
+// Linux: gcc das_gen_assets.c -o das_gen_assets -Wall
+//        ./das_gen_assets notes/complexion.txt notes/slider_notes.txt > das_assets.h
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MAX_ASSETS      1024
+#define MAX_COMPLEXIONS 1024
+#define MAX_SKIN_TONES  1024
+
+struct asset {
+	unsigned int hash;
+	char         path[256];
+};
+
+struct complexion {
+	char         race[8];
+	char         gender[8];
+	int          slider;
+	float        blend[3];
+	float        tint[4];
+	unsigned int tex[6];
+};
+
+struct skin_tone {
+	char         race[8];
+	char         gender[8];
+	int          step;
+	unsigned int hash;
+};
+
+static struct asset      assets[MAX_ASSETS];
+static struct complexion complexions[MAX_COMPLEXIONS];
+static struct skin_tone  skin_tones[MAX_SKIN_TONES];
+static int asset_count = 0, complexion_count = 0, skin_tone_count = 0;
+
+// Texture slots in the order the XML lists them
+static const char* tex_names[6] = {
+	"D1_Diffuse", "D2_Diffuse", "N1_Normal", "N2_Normal", "S1_Specular", "S2_Specular"
+};
+
+// hf_ etc. in the slider notes
+static const char* prefixes[8][3] = {
+	{ "hf", "Human",  "Female" }, { "hm", "Human",  "Male" },
+	{ "ef", "Elf",    "Female" }, { "em", "Elf",    "Male" },
+	{ "df", "Dwarf",  "Female" }, { "dm", "Dwarf",  "Male" },
+	{ "qf", "Qunari", "Female" }, { "qm", "Qunari", "Male" }
+};
+
+int add_asset( unsigned int hash, const char* path ) {
+
+	int i = 0;
+	for ( i = 0; i < asset_count; i++ ) {
+		if ( assets[i].hash != hash )
+			continue;
+		if ( strcmp( assets[i].path, path ) != 0 ) {
+			fprintf( stderr, ":: ERROR: %u is both %s and %s\n", hash, assets[i].path, path );
+			return( -1 );
+		}
+		return( 0 );
+	}
+	if ( asset_count == MAX_ASSETS ) {
+		fprintf( stderr, ":: ERROR: Too many assets.\n" );
+		return( -1 );
+	}
+	assets[asset_count].hash = hash;
+	snprintf( assets[asset_count].path, 256, "%s", path );
+	asset_count++;
+	return( 0 );
+
+}
+
+const char* attr_value( const char* line, const char* attr, char* out, size_t size ) {
+
+	// attr="value"
+	char key[64];
+	snprintf( key, sizeof( key ), "%s=\"", attr );
+	const char* p = strstr( line, key );
+	if ( p == NULL )
+		return( NULL );
+	p += strlen( key );
+	size_t len = strcspn( p, "\"" );
+	if ( len >= size )
+		len = size - 1;
+	memcpy( out, p, len );
+	out[len] = '\0';
+	return( out );
+
+}
+
+int read_complexions( const char* filename ) {
+
+	FILE* fp = fopen( filename, "r" );
+	char line[1024], race[8] = "", gender[8] = "", value[64];
+	struct complexion* cur = NULL;
+	int i = 0, line_no = 0;
+	if ( fp == NULL ) {
+		fprintf( stderr, ":: ERROR: Cannot open file \"%s\"\n", filename );
+		return( -1 );
+	}
+	while ( fgets( line, sizeof( line ), fp ) != NULL ) {
+		line_no++;
+		// "Human Female {" starts a race, the prototype is only a template
+		char r[32], g[32];
+		if ( !isspace( (unsigned char)line[0] ) && sscanf( line, "%31s %31s {", r, g ) == 2 ) {
+			snprintf( race, 8, "%.7s", strcmp( r, "Prototype" ) == 0 ? "" : r );
+			snprintf( gender, 8, "%.7s", g );
+			cur = NULL;
+			continue;
+		}
+		if ( race[0] == '\0' )
+			continue;
+		const char* slider = strstr( line, "Slider " );
+		if ( slider != NULL ) {
+			if ( complexion_count == MAX_COMPLEXIONS ) {
+				fprintf( stderr, ":: ERROR: Too many complexions.\n" );
+				fclose( fp );
+				return( -1 );
+			}
+			cur = &complexions[complexion_count++];
+			memset( cur, 0, sizeof( struct complexion ) );
+			snprintf( cur->race, 8, "%s", race );
+			snprintf( cur->gender, 8, "%s", gender );
+			cur->slider = atoi( slider + 7 );
+			continue;
+		}
+		if ( cur == NULL )
+			continue;
+		if ( strstr( line, "ComplextionBlend_Diff_Norm_Spec" ) != NULL ) {
+			for ( i = 0; i < 3; i++ )
+				if ( attr_value( line, i == 0 ? "x" : i == 1 ? "y" : "z", value, 32 ) )
+					cur->blend[i] = strtof( value, NULL );
+		} else if ( strstr( line, "TintDetailWeights" ) != NULL ) {
+			for ( i = 0; i < 4; i++ )
+				if ( attr_value( line, i == 0 ? "x" : i == 1 ? "y" : i == 2 ? "z" : "w", value, 32 ) )
+					cur->tint[i] = strtof( value, NULL );
+		} else if ( attr_value( line, "texNameHash", value, 64 ) != NULL ) {
+			// D1_Diffuse  texNameHash="3804040627" [E2BD0DB3] (path)
+			unsigned int hash = (unsigned int)strtoul( value, NULL, 10 );
+			const char* open = strchr( line, '(' );
+			const char* close = open ? strchr( open, ')' ) : NULL;
+			for ( i = 0; i < 6; i++ )
+				if ( strstr( line, tex_names[i] ) != NULL )
+					cur->tex[i] = hash;
+			if ( open != NULL && close != NULL ) {
+				char path[256];
+				snprintf( path, sizeof( path ), "%.*s", (int)( close - open - 1 ), open + 1 );
+				if ( add_asset( hash, path ) == -1 ) {
+					fprintf( stderr, "::  at %s:%d\n", filename, line_no );
+					fclose( fp );
+					return( -1 );
+				}
+			}
+		}
+	}
+	fclose( fp );
+	return( 0 );
+
+}
+
+int read_skin_tones( const char* filename ) {
+
+	// hf_00	= texNameHash="18DC7731", only under "Skin Tone"
+	FILE* fp = fopen( filename, "r" );
+	char line[1024], value[64], prefix[8];
+	int in_skin = 0, step = 0, i = 0;
+	if ( fp == NULL ) {
+		fprintf( stderr, ":: ERROR: Cannot open file \"%s\"\n", filename );
+		return( -1 );
+	}
+	while ( fgets( line, sizeof( line ), fp ) != NULL ) {
+		if ( strstr( line, "Skin Tone" ) != NULL ) {
+			in_skin = 1;
+			continue;
+		}
+		if ( !in_skin )
+			continue;
+		if ( sscanf( line, " %2[a-z]_%d", prefix, &step ) != 2 ||
+				attr_value( line, "texNameHash", value, 64 ) == NULL ) {
+			in_skin = strchr( line, '=' ) != NULL;
+			continue;
+		}
+		for ( i = 0; i < 8; i++ )
+			if ( strcmp( prefix, prefixes[i][0] ) == 0 )
+				break;
+		if ( i == 8 || skin_tone_count == MAX_SKIN_TONES ) {
+			fprintf( stderr, ":: ERROR: Bad skin tone \"%s\"\n", prefix );
+			fclose( fp );
+			return( -1 );
+		}
+		struct skin_tone* st = &skin_tones[skin_tone_count++];
+		snprintf( st->race, 8, "%s", prefixes[i][1] );
+		snprintf( st->gender, 8, "%s", prefixes[i][2] );
+		st->step = step;
+		st->hash = (unsigned int)strtoul( value, NULL, 16 );
+	}
+	fclose( fp );
+	return( 0 );
+
+}
+
+int find_perfect_hash( int* bits, unsigned int* mul ) {
+
+	// Smallest power of two table where ( hash * mul ) >> ( 32 - bits )
+	// puts every asset in its own slot
+	unsigned int seed = 0x9E3779B9u;
+	int b = 1, t = 0, i = 0;
+	unsigned char used[1 << 16];
+	while ( ( 1 << b ) < asset_count * 2 )
+		b++;
+	for ( ; b <= 16; b++ ) {
+		for ( t = 0; t < 1000000; t++ ) {
+			seed = seed * 1664525u + 1013904223u;
+			unsigned int m = seed | 1;
+			memset( used, 0, 1 << b );
+			for ( i = 0; i < asset_count; i++ ) {
+				unsigned int slot = ( assets[i].hash * m ) >> ( 32 - b );
+				if ( used[slot]++ )
+					break;
+			}
+			if ( i == asset_count ) {
+				*bits = b;
+				*mul = m;
+				return( 0 );
+			}
+		}
+	}
+	fprintf( stderr, ":: ERROR: No perfect hash found.\n" );
+	return( -1 );
+
+}
+
+int main( int argc, char* argv[] ) {
+
+	int bits = 0, i = 0, d = 0;
+	unsigned int mul = 0;
+	if ( argc != 3 ) {
+		fprintf( stderr, "::  USAGE: ./das_gen_assets complexion.txt slider_notes.txt > das_assets.h\n" );
+		return( EXIT_FAILURE );
+	}
+	if ( read_complexions( argv[1] ) == -1 || read_skin_tones( argv[2] ) == -1 ||
+			find_perfect_hash( &bits, &mul ) == -1 )
+		return( EXIT_FAILURE );
+
+	printf( "// Generated by das_gen_assets from %s and %s, do not edit.\n", argv[1], argv[2] );
+	printf( "// Texture hashes to asset paths, looked up through a perfect hash:\n" );
+	printf( "// das_asset_slot[( hash * DAS_ASSET_MUL ) >> ( 32 - DAS_ASSET_BITS )]\n\n" );
+	printf( "#define DAS_NUM_ASSETS      %d\n", asset_count );
+	printf( "#define DAS_NUM_COMPLEXIONS %d\n", complexion_count );
+	printf( "#define DAS_NUM_SKIN_TONES  %d\n", skin_tone_count );
+	printf( "#define DAS_ASSET_BITS      %d\n", bits );
+	printf( "#define DAS_ASSET_MUL       0x%.8Xu\n\n", mul );
+
+	printf( "static const struct das_asset das_assets[DAS_NUM_ASSETS] = {\n" );
+	for ( i = 0; i < asset_count; i++ )
+		printf( "\t{ 0x%.8Xu, \"%s\" }%s\n", assets[i].hash, assets[i].path,
+			i + 1 < asset_count ? "," : "" );
+	printf( "};\n\n" );
+
+	printf( "static const signed char das_asset_slot[1 << DAS_ASSET_BITS] = {" );
+	for ( d = 0; d < ( 1 << bits ); d++ ) {
+		int slot = -1;
+		for ( i = 0; i < asset_count; i++ )
+			if ( ( ( assets[i].hash * mul ) >> ( 32 - bits ) ) == (unsigned int)d )
+				slot = i;
+		printf( "%s%s%d", d ? "," : "", d % 16 ? " " : "\n\t", slot );
+	}
+	printf( "\n};\n\n" );
+
+	printf( "static const struct das_complexion das_complexions[DAS_NUM_COMPLEXIONS] = {\n" );
+	for ( i = 0; i < complexion_count; i++ ) {
+		const struct complexion* c = &complexions[i];
+		printf( "\t{ \"%s\", \"%s\", %d,\n", c->race, c->gender, c->slider );
+		printf( "\t\t{ %.6ff, %.6ff, %.6ff },\n", c->blend[0], c->blend[1], c->blend[2] );
+		printf( "\t\t{ %.6ff, %.6ff, %.6ff, %.6ff },\n",
+			c->tint[0], c->tint[1], c->tint[2], c->tint[3] );
+		printf( "\t\t{ %uu, %uu, %uu, %uu, %uu, %uu } }%s\n",
+			c->tex[0], c->tex[1], c->tex[2], c->tex[3], c->tex[4], c->tex[5],
+			i + 1 < complexion_count ? "," : "" );
+	}
+	printf( "};\n\n" );
+
+	printf( "static const struct das_skin_tone das_skin_tones[DAS_NUM_SKIN_TONES] = {\n" );
+	for ( i = 0; i < skin_tone_count; i++ )
+		printf( "\t{ \"%s\", \"%s\", %d, 0x%.8Xu }%s\n", skin_tones[i].race, skin_tones[i].gender,
+			skin_tones[i].step, skin_tones[i].hash, i + 1 < skin_tone_count ? "," : "" );
+	printf( "};\n" );
+	return( EXIT_SUCCESS );
+
+}
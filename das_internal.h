@@ -0,0 +1,249 @@
+// The save parsing core of das_editor: the bit aligned views and scanners,
+// the header reader, the face value search, the SAX tokenizer and the
+// checksums. Defined in das.c and shared by main.c, das_io.c, bench.c and
+// libdas; das.h is the public API, this header is not.
+
+#ifndef DAS_INTERNAL_H
+#define DAS_INTERNAL_H
+
+#include <stddef.h>
+
+// Saves are mapped where the platform has mmap
+#ifndef _WIN32
+#	define DAS_MMAP
+#endif
+
+// SIMD scanners, picked at runtime so no -m flags are needed
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#	define DAS_SCAN_SIMD
+#	include <immintrin.h>
+#endif
+
+#define DAS_NUM_VALUES  54
+#define DAS_NUM_ANCHORS 18
+
+struct handle {
+	int   hash;
+	int   offset;
+	float fp_val;
+	float min;
+	float max;
+	char  name[32];
+};
+
+struct das_field {
+	char  name[32];
+	float min;
+	float max;
+};
+
+struct das_anchor {
+	unsigned int hash;
+	int          count;
+	int          stride;
+	int          index[4];
+};
+
+// FBCHUNKS magic, header size and data size come first, then the header
+// checksum, then the FBHEADER block of header.size bytes
+#define DAS_PREFIX_SIZE  0x12
+#define DAS_HEADER_START 0x16
+#define DAS_HEADER_MAX   65536
+
+// A (pointer, length) slice into a loaded file
+struct das_slice {
+	const unsigned char* ptr;
+	int                  len;
+};
+
+// One FBHEADER item, its value still in the file
+struct das_item {
+	unsigned int     hash;
+	struct das_slice value;
+};
+
+struct header {
+	int       size;
+	int       data_size;
+	int       checksum;
+	int       item_count;
+	char      player_name[24];
+	char      player_race[8];
+	char      player_gender[8];
+	float     total_play_time;
+	char      player_id[64];
+	char      player_class[16];
+	int       player_level;
+	char      player_pos[32];
+	char      area_id[16];
+	char      player_location[64];
+	char      thumbnail[64];
+	char      assets[128];
+	long long timestamp;
+	char      build_number[16];
+	int       patch_number;
+	int       addon_count;
+	char      addons[32][128];
+	int       data_checksum;
+};
+
+struct xml_hit {
+	int offset;
+	int shift;
+};
+
+// Candidate filter for patterns of 3+ bytes. Each pattern at a given bit
+// shift is reduced to the two file bytes it fully determines (lead pair).
+#define DAS_SCAN_MAX 64
+struct das_scan {
+	int           count;
+	unsigned char lead[DAS_SCAN_MAX][2];
+	unsigned char first[256];
+};
+
+// Walks the "<?xml" hits in file order without collecting them. Several
+// shifts can match at one offset, those are handed out smallest first.
+struct das_xml_iter {
+	const unsigned char* data;
+	int                  size;
+	int                  pos;
+	int                  at;
+	int                  pending;
+	struct das_scan      scan;
+};
+
+// A loaded file. Mapped private where possible, so edits are copy on
+// write and the ranges they touched are kept for writing out.
+#define DAS_DIRTY_MAX 64
+struct das_file {
+	unsigned char* data;
+	size_t         size;
+	int            fd;
+	int            mapped;
+	int            writable;
+	int            dirty_count;
+	struct {
+		size_t start;
+		size_t end;
+	} dirty[DAS_DIRTY_MAX];
+};
+
+// --stats: where each file's time went and what was found in it. Kept per
+// thread while a file is processed, then summed under the lock. With
+// --stats off every hook is a NULL check.
+#define DAS_STAGE_OPEN   0
+#define DAS_STAGE_ALIGN  1
+#define DAS_STAGE_VALUES 2
+#define DAS_STAGE_XML    3
+#define DAS_STAGE_WRITE  4
+#define DAS_NUM_STAGES   5
+struct das_stats {
+	double    time[DAS_NUM_STAGES]; // Seconds
+	long long bytes_read;
+	long long bytes_scanned;
+	long long bytes_written;
+	int       anchors;
+	int       xmls;
+	int       shift;                // -1 = not found
+	int       allocs;
+};
+
+// Bit aligned window into a save. Byte i of the view reads as byte i of
+// the file after rotating the whole file right by shift bits.
+struct das_view {
+	unsigned char*   base;
+	int              size;
+	int              shift;
+	struct das_file* file;
+};
+
+// Zero allocation SAX tokenizer over one XML in a view. Names and values
+// are (offset, length) spans in view bytes, nothing is copied.
+#define DAS_SAX_ERROR   -1
+#define DAS_SAX_END      0
+#define DAS_SAX_OPEN     1
+#define DAS_SAX_ATTR     2
+#define DAS_SAX_CLOSE    3
+#define DAS_SAX_TEXT     4
+#define DAS_SAX_DEPTH    32
+#define DAS_XML_HITS_MAX 64
+struct das_span {
+	int offset;
+	int len;
+};
+
+struct das_sax {
+	const struct das_view* view;
+	int                    pos;
+	int                    end;
+	int                    in_tag;
+	int                    close;
+	int                    tag_end;
+	int                    depth;
+	struct das_span        stack[DAS_SAX_DEPTH];
+	// Current token
+	struct das_span        name;
+	struct das_span        value;
+};
+
+// Every face value we know about, indexed the same as struct handle
+// arrays, and the hashes in the face block the values follow
+extern const struct das_field das_fields[DAS_NUM_VALUES];
+extern const struct das_anchor das_anchors[DAS_NUM_ANCHORS];
+
+// Counters of the file this thread is working on, NULL without --stats
+extern __thread struct das_stats* das_stats_cur;
+
+// FBHEADER items and the header fields read from them
+int das_item_next( const unsigned char*, size_t, size_t*, struct das_item* );
+int das_header_find( const unsigned char*, size_t, unsigned int, struct das_item* );
+void das_slice_str( char*, size_t, struct das_slice );
+long long das_slice_ll( struct das_slice );
+double das_slice_double( struct das_slice );
+struct header das_read_header( const unsigned char*, size_t );
+
+// Face values
+const char* das_str_lookup( int );
+int das_anchor_lookup( unsigned int );
+int das_face_scan( struct das_file*, const struct xml_hit*, int, struct handle*, struct das_view* );
+struct handle das_set_struct( const struct das_view*, const char[32], int, float, float );
+
+// "<?xml" hits at every bit shift
+void das_xml_iter_init( struct das_xml_iter*, const unsigned char*, int );
+int das_xml_iter_next( struct das_xml_iter*, struct xml_hit* );
+int das_find_xmls( const unsigned char*, int, struct xml_hit** );
+
+// Bit aligned views
+struct das_view das_view_init( unsigned char*, int, int );
+unsigned char das_view_u8( const struct das_view*, int );
+void das_view_read( const struct das_view*, int, unsigned char*, int );
+void das_view_write( struct das_view*, int, const unsigned char*, int );
+unsigned int das_view_read_u32( const struct das_view*, int );
+float das_view_read_f32( const struct das_view*, int );
+void das_view_write_f32( struct das_view*, int, float );
+int das_view_memcmp( const struct das_view*, int, const unsigned char*, int );
+
+// Lead pair scanner, widest SIMD the cpu has
+void das_scan_add( struct das_scan*, const unsigned char*, int );
+void das_scan_init( void );
+int das_scan_next( const struct das_scan*, const unsigned char*, int, int );
+
+// SAX tokenizer
+void das_sax_init( struct das_sax*, const struct das_view*, int, int );
+int das_sax_next( struct das_sax* );
+int das_sax_is( const struct das_sax*, struct das_span, const char*, int );
+
+// Loaded files; opening and writing them is the editor's (das_io.h)
+void das_file_close( struct das_file* );
+void das_file_touch( struct das_file*, size_t, size_t );
+
+// CRC-32 and the two save checksums
+unsigned int das_crc32( unsigned int, const unsigned char*, size_t );
+int das_checksum_compute( const unsigned char*, size_t, const struct header*, unsigned int*, unsigned int* );
+int das_checksum_fix( struct das_file* );
+
+// --stats hooks, no-ops while das_stats_cur is NULL
+double das_stats_start( void );
+void das_stats_stop( int, double );
+
+#endif
@@ -0,0 +1,1006 @@
+// Files in and out for das_editor and das_bench, see das_io.h.
+
+// Linux: copy_file_range
+#ifdef __linux__
+#	define _GNU_SOURCE
+#endif
+
+// Standard C libs
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+// POSIX
+#include <sys/stat.h>
+#ifndef _WIN32
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#endif
+#ifdef __linux__
+#	include <sys/ioctl.h>
+#	include <linux/fs.h>
+#endif
+
+// Platform specific librarys
+#ifdef _WIN32
+#	include <windows.h>
+#endif
+
+#include "das_io.h"
+
+int das_quiet = 0;
+
+unsigned char* file_to_char( const char* filename, size_t* filesize ) {
+
+	// Open file if it exists, else return NULL
+	FILE * fp;
+	if ( !( fp = fopen( filename, "rb" ) ) ) {
+		fprintf( stderr, ":: ERROR: Cannot open file \"%s\"\n", filename );
+		return( NULL );
+	}
+
+	// Get the files size
+	fseek( fp, 0, SEEK_END );
+	size_t fsize = ftell( fp );
+	rewind( fp );
+
+	// Allocate memory to a buffer, +1 for null terminate
+	unsigned char* buffer = (unsigned char*)malloc( ( fsize ) * sizeof( unsigned char ) );
+	if ( buffer == NULL ) {
+		fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+		fclose( fp );
+		return( NULL );
+	}
+	if ( das_stats_cur )
+		das_stats_cur->allocs++;
+
+	// Copy file data into the buffer
+	if ( fread( buffer, sizeof( unsigned char ), fsize, fp ) != fsize ) {
+		fprintf( stderr, ":: ERROR: File read error.\n" );
+		fclose( fp );
+		free( buffer );
+		return( NULL );
+	}
+
+	// Cleanup and return
+	fclose( fp );
+	if ( filesize != NULL )
+		*filesize = fsize;
+	return( buffer );
+
+}
+
+char* das_tmp_name( char* buf, size_t size, const char* filename ) {
+
+	// Temp file next to the target, unique per process and write since
+	// threads may race to write the same file
+	static int tmp_seq = 0;
+	snprintf( buf, size, "%s.%d.%d.tmp", filename, (int)getpid(), __sync_fetch_and_add( &tmp_seq, 1 ) );
+	return( buf );
+
+}
+
+int char_to_file( const char* filename, unsigned char* data, size_t filesize ) {
+
+	// Were we passed something valid?
+	if ( data == NULL )
+		return( -1 );
+
+	// Written next to the target and renamed over it once it is on disk,
+	// so a crash never leaves half a file behind
+	char tmp_name[4096];
+	das_tmp_name( tmp_name, sizeof( tmp_name ), filename );
+	double start = das_stats_start();
+	FILE * fp;
+	if ( !( fp = fopen( tmp_name, "wb" ) ) ) {
+		fprintf( stderr, ":: ERROR: Cannot create file \"%s\"\n", tmp_name );
+		return( -1 );
+	}
+
+	// Write data to file
+	int ok = fwrite( data, sizeof( unsigned char ), filesize, fp ) == filesize && fflush( fp ) == 0;
+#ifdef DAS_MMAP
+	ok = ok && fsync( fileno( fp ) ) == 0;
+#endif
+	ok = fclose( fp ) == 0 && ok;
+#ifdef _WIN32
+	if ( ok )
+		remove( filename );
+#endif
+	if ( !ok || rename( tmp_name, filename ) == -1 ) {
+		fprintf( stderr, ":: ERROR: writing %s, file left unchanged.\n", filename );
+		remove( tmp_name );
+		return( -1 );
+	}
+	if ( das_stats_cur )
+		das_stats_cur->bytes_written += filesize;
+	das_stats_stop( DAS_STAGE_WRITE, start );
+	return( 0 );
+
+}
+
+// Texture hashes, complexions and skin tones from the notes.
+// Regenerate with das_gen_assets when they change.
+#include "das_assets.h"
+
+const char* das_asset_lookup( unsigned int hash ) {
+
+	int slot = das_asset_slot[( hash * DAS_ASSET_MUL ) >> ( 32 - DAS_ASSET_BITS )];
+	if ( slot == -1 || das_assets[slot].hash != hash )
+		return( NULL );
+	return( das_assets[slot].path );
+
+}
+
+int das_find_values( struct das_file* file, struct handle* value, struct das_view* view ) {
+
+	// First, find the bit alignment of the data, or return if we can't find anything.
+	// Find every "<?xml" at every bit alignment in one pass
+	struct xml_hit* hits = NULL;
+	int hit_count = das_find_xmls( file->data, (int)file->size, &hits );
+	int ret = das_face_scan( file, hits, hit_count, value, view );
+	free( hits );
+	if ( ret == -1 )
+		fprintf( stderr, ":: ERROR: Could not find face data in file.\n" );
+	return( ret );
+
+}
+
+int das_dump_xmls( unsigned char* data, int filesize, const char* prefix, int mode,
+		char* written, size_t written_size ) {
+
+	// Each XML goes from the save to its file as soon as it is found, a
+	// chunk at a time, so memory use doesn't grow with count or size.
+	// written (if not NULL) gets the files written, tab separated.
+	// Returns how many were written
+	struct das_xml_iter it;
+	struct xml_hit hit;
+	int xml_count = 0, write_count = 0, size = 0, truncated = 0;
+	size_t written_len = 0;
+	if ( written != NULL && written_size > 0 )
+		written[0] = '\0';
+	double start = das_stats_start();
+	struct das_xml_out* out = (struct das_xml_out*)malloc( sizeof( struct das_xml_out ) );
+	if ( out == NULL ) {
+		fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+		return( -1 );
+	}
+
+	das_xml_iter_init( &it, data, filesize );
+	while ( das_xml_iter_next( &it, &hit ) ) {
+		// We found an xml (probably)
+		xml_count++;
+		// Get size of the xml from the 4 preceeding bytes (offset-4)
+		struct das_view view = das_view_init( data, filesize, hit.shift );
+		size = hit.offset >= 4 ? (int)das_view_read_u32( &view, hit.offset - 4 ) : 0;
+		// A size that runs off the end of the file means it wasn't one
+		if ( size <= 0 || size > filesize - hit.offset ) {
+			if ( !das_quiet )
+				printf( "::  Found \"<?xml\" at %.8X (>>%.2d), skipped: bad size.\n",
+					hit.offset, hit.shift );
+			continue;
+		}
+		// The xml is unformatted, the writer adds newlines or indents
+		char fname[4096];
+		snprintf( fname, 4096, "%sxml_file%.2d.xml", prefix, xml_count );
+		if ( das_xml_open( out, fname, mode & ~DAS_XML_ANNOTATE ) == -1 )
+			continue;
+		if ( mode & DAS_XML_ANNOTATE )
+			das_xml_annotate( out, &view, hit.offset, size );
+		else
+			das_xml_put_view( out, &view, hit.offset, size );
+		if ( das_xml_close( out ) == -1 )
+			continue;
+		if ( !das_quiet )
+			printf( "::  Found XML at %.8X (>>%.2d). Written to \"%s\"\n", hit.offset, hit.shift, fname );
+		write_count++;
+		if ( written == NULL )
+			continue;
+		// Names that don't fit any more are cut to "..."
+		size_t len = strlen( fname ) + ( written_len > 0 );
+		if ( written_len + len + 4 < written_size ) {
+			snprintf( written + written_len, written_size - written_len, "%s%s",
+				written_len > 0 ? "\t" : "", fname );
+			written_len += len;
+		} else if ( !truncated && written_len + 4 < written_size ) {
+			snprintf( written + written_len, written_size - written_len, "%s...",
+				written_len > 0 ? "\t" : "" );
+			written_len += 3 + ( written_len > 0 );
+			truncated = 1;
+		}
+	}
+	free( out );
+	if ( das_stats_cur ) {
+		das_stats_cur->bytes_scanned += filesize;
+		das_stats_cur->xmls = xml_count;
+		das_stats_cur->allocs++;
+	}
+	das_stats_stop( DAS_STAGE_XML, start );
+
+	if ( xml_count == 0 ) {
+		fprintf( stderr, ":: ERROR: Could not find any XML files.\n" );
+		return( -1 );
+	}
+	return( write_count );
+
+}
+
+int das_file_open( struct das_file* file, const char* filename, int writable ) {
+
+	file->data = NULL;
+	file->size = 0;
+	file->fd = -1;
+	file->mapped = 0;
+	file->writable = 0;
+	file->dirty_count = 0;
+
+	// Is input actually a file?
+	double start = das_stats_start();
+	struct stat sb;
+#ifdef DAS_MMAP
+	int fd = open( filename, O_RDONLY );
+	if ( fd == -1 ) {
+		fprintf( stderr, ":: ERROR: Cannot open file \"%s\"\n", filename );
+		return( -1 );
+	}
+	if ( fstat( fd, &sb ) == -1 ) {
+		fprintf( stderr, ":: ERROR: Cannot stat file %s.\n", filename );
+		close( fd );
+		return( -1 );
+	}
+#else
+	if ( stat( filename, &sb ) == -1 ) {
+		fprintf( stderr, ":: ERROR: Cannot stat file %s.\n", filename );
+		return( -1 );
+	}
+#endif
+	switch ( sb.st_mode & S_IFMT ) {
+		case S_IFREG:
+			break;
+		default:
+			fprintf( stderr, ":: ERROR: \"%s\" is not a file.\n", filename );
+#ifdef DAS_MMAP
+			close( fd );
+#endif
+			return( -1 );
+	}
+	if ( sb.st_size == 0 ) {
+		fprintf( stderr, ":: ERROR: \"%s\" is empty.\n", filename );
+#ifdef DAS_MMAP
+		close( fd );
+#endif
+		return( -1 );
+	}
+
+#ifdef DAS_MMAP
+	// Private mapping, edits are copy on write and never reach the file
+	int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+	void* map = mmap( NULL, sb.st_size, prot, MAP_PRIVATE, fd, 0 );
+	if ( map == MAP_FAILED ) {
+		fprintf( stderr, ":: ERROR: Cannot map file \"%s\"\n", filename );
+		close( fd );
+		return( -1 );
+	}
+	file->data = (unsigned char*)map;
+	file->fd = fd;
+	file->mapped = 1;
+	file->size = sb.st_size;
+#else
+	// No mmap, read the whole file into memory
+	file->data = file_to_char( filename, &file->size );
+	if ( file->data == NULL )
+		return( -1 );
+#endif
+	file->writable = writable || !file->mapped;
+	if ( das_stats_cur )
+		das_stats_cur->bytes_read += file->size;
+	das_stats_stop( DAS_STAGE_OPEN, start );
+	return( 0 );
+
+}
+
+int das_file_writable( struct das_file* file ) {
+
+	if ( file->writable )
+		return( 0 );
+#ifdef DAS_MMAP
+	if ( mprotect( file->data, file->size, PROT_READ | PROT_WRITE ) == -1 ) {
+		fprintf( stderr, ":: ERROR: Cannot make file writable.\n" );
+		return( -1 );
+	}
+#endif
+	file->writable = 1;
+	return( 0 );
+
+}
+
+#ifdef DAS_MMAP
+static int das_pwrite_all( int fd, const unsigned char* data, size_t size, off_t offset ) {
+
+	while ( size > 0 ) {
+		ssize_t n = pwrite( fd, data, size, offset );
+		if ( n <= 0 )
+			return( -1 );
+		data += n;
+		size -= n;
+		offset += n;
+	}
+	return( 0 );
+
+}
+#endif
+
+int das_file_write( const struct das_file* file, const char* filename ) {
+
+	// Were we passed something valid?
+	if ( file == NULL || file->data == NULL )
+		return( -1 );
+
+#ifdef DAS_MMAP
+	if ( !file->mapped )
+		return( char_to_file( filename, file->data, file->size ) );
+
+	// Built as a temp file and renamed over the target once it is on disk,
+	// with the save's own permissions
+	double start = das_stats_start();
+	char tmp_name[4096];
+	struct stat sb;
+	mode_t mode = fstat( file->fd, &sb ) == 0 ? sb.st_mode & 0777 : 0644;
+	das_tmp_name( tmp_name, sizeof( tmp_name ), filename );
+	int fd = open( tmp_name, O_WRONLY | O_CREAT | O_EXCL, mode );
+	if ( fd == -1 ) {
+		fprintf( stderr, ":: ERROR: Cannot create file \"%s\"\n", tmp_name );
+		return( -1 );
+	}
+
+	// Unchanged bytes are shared with the original where the filesystem
+	// can reflink, else copied file to file by the kernel, so pages we
+	// never touched are never read into this process
+	size_t done = 0;
+#	ifdef __linux__
+#		ifdef FICLONE
+	if ( ioctl( fd, FICLONE, file->fd ) == 0 )
+		done = file->size;
+#		endif
+	loff_t in_off = 0;
+	while ( done < file->size ) {
+		ssize_t n = copy_file_range( file->fd, &in_off, fd, NULL, file->size - done, 0 );
+		if ( n <= 0 )
+			break;
+		done += n;
+	}
+#	endif
+
+	// Whatever the kernel couldn't copy comes from the map,
+	// then the changed ranges are written over the copy
+	int i = 0, ret = 0;
+	if ( done < file->size )
+		ret = das_pwrite_all( fd, file->data + done, file->size - done, done );
+	for ( i = 0; i < file->dirty_count && ret == 0; i++ )
+		ret = das_pwrite_all( fd, file->data + file->dirty[i].start,
+			file->dirty[i].end - file->dirty[i].start, file->dirty[i].start );
+	if ( ret == 0 && fsync( fd ) == -1 )
+		ret = -1;
+	if ( close( fd ) == -1 )
+		ret = -1;
+	if ( ret == -1 || rename( tmp_name, filename ) == -1 ) {
+		fprintf( stderr, ":: ERROR: writing %s, file left unchanged.\n", filename );
+		unlink( tmp_name );
+		return( -1 );
+	}
+	if ( das_stats_cur )
+		das_stats_cur->bytes_written += file->size;
+	das_stats_stop( DAS_STAGE_WRITE, start );
+	return( 0 );
+#else
+	return( char_to_file( filename, file->data, file->size ) );
+#endif
+
+}
+
+int das_xml_open( struct das_xml_out* out, const char* filename, int mode ) {
+
+	out->len = 0;
+	out->mode = mode;
+	out->failed = 0;
+	out->depth = 0;
+	out->in_tag = 0;
+	out->quote = 0;
+	out->kind = 0;
+	out->prev = 0;
+	out->last = DAS_XML_LAST_NONE;
+	out->text = 0;
+	if ( !( out->fp = fopen( filename, "wb" ) ) ) {
+		fprintf( stderr, "  ERROR: Cannot create file \"%s\"\n", filename );
+		return( -1 );
+	}
+	// Our own buffer is the only one
+	setvbuf( out->fp, NULL, _IONBF, 0 );
+	return( 0 );
+
+}
+
+static void das_xml_flush( struct das_xml_out* out ) {
+
+	if ( out->len > 0 && !out->failed &&
+			fwrite( out->buf, 1, out->len, out->fp ) != (size_t)out->len )
+		out->failed = 1;
+	if ( das_stats_cur )
+		das_stats_cur->bytes_written += out->len;
+	out->len = 0;
+
+}
+
+static void das_xml_emit( struct das_xml_out* out, const unsigned char* data, int size ) {
+
+	// Big spans skip the buffer
+	if ( size >= DAS_XML_BUF ) {
+		das_xml_flush( out );
+		if ( !out->failed && fwrite( data, 1, size, out->fp ) != (size_t)size )
+			out->failed = 1;
+		if ( das_stats_cur )
+			das_stats_cur->bytes_written += size;
+		return;
+	}
+	if ( out->len + size > DAS_XML_BUF )
+		das_xml_flush( out );
+	memcpy( out->buf + out->len, data, size );
+	out->len += size;
+
+}
+
+static void das_xml_indent( struct das_xml_out* out ) {
+
+	int i = 0;
+	if ( out->last != DAS_XML_LAST_NONE )
+		das_xml_emit( out, (const unsigned char*)"\n", 1 );
+	for ( i = 0; i < out->depth; i++ )
+		das_xml_emit( out, (const unsigned char*)"  ", 2 );
+
+}
+
+static void das_xml_pretty( struct das_xml_out* out, const unsigned char* data, int size ) {
+
+	// One tag per line, two spaces per level. Text goes on the line of its
+	// element, whitespace between tags is dropped. Works across chunks.
+	int i = 0;
+	for ( i = 0; i < size; i++ ) {
+		unsigned char c = data[i];
+		if ( out->in_tag ) {
+			// Tag kind is the byte after '<'
+			if ( out->kind == 0 ) {
+				out->kind = c == '/' || c == '?' || c == '!' ? c : 'o';
+				if ( c == '/' ) {
+					out->depth--;
+					if ( out->last != DAS_XML_LAST_OPEN && out->last != DAS_XML_LAST_TEXT )
+						das_xml_indent( out );
+				} else {
+					das_xml_indent( out );
+				}
+				das_xml_emit( out, (const unsigned char*)"<", 1 );
+			}
+			das_xml_emit( out, &c, 1 );
+			if ( out->quote ) {
+				if ( c == out->quote )
+					out->quote = 0;
+			} else if ( c == '"' || c == '\'' ) {
+				out->quote = c;
+			} else if ( c == '>' ) {
+				out->in_tag = 0;
+				if ( out->kind == 'o' && out->prev != '/' ) {
+					out->depth++;
+					out->last = DAS_XML_LAST_OPEN;
+				} else {
+					out->last = DAS_XML_LAST_TAG;
+				}
+				out->text = 0;
+			}
+			out->prev = c;
+		} else if ( c == '<' ) {
+			// Held back until we know what kind of tag it is
+			out->in_tag = 1;
+			out->kind = 0;
+			out->prev = 0;
+		} else if ( out->text || !isspace( c ) ) {
+			if ( !out->text && out->last != DAS_XML_LAST_OPEN )
+				das_xml_indent( out );
+			out->text = 1;
+			out->last = DAS_XML_LAST_TEXT;
+			das_xml_emit( out, &c, 1 );
+		}
+	}
+	if ( out->depth < 0 )
+		out->depth = 0;
+
+}
+
+void das_xml_put( struct das_xml_out* out, const unsigned char* data, int size ) {
+
+	const unsigned char* end = data + size;
+	const unsigned char* gt = NULL;
+	switch ( out->mode ) {
+		case DAS_XML_RAW:
+			das_xml_emit( out, data, size );
+			break;
+		case DAS_XML_PRETTY:
+			das_xml_pretty( out, data, size );
+			break;
+		default: // A newline after every '>', like it always was
+			while ( data < end && ( gt = (const unsigned char*)memchr( data, '>', end - data ) ) ) {
+				das_xml_emit( out, data, gt - data + 1 );
+				das_xml_emit( out, (const unsigned char*)"\n", 1 );
+				data = gt + 1;
+			}
+			if ( data < end )
+				das_xml_emit( out, data, end - data );
+			break;
+	}
+
+}
+
+int das_xml_close( struct das_xml_out* out ) {
+
+	if ( out->mode == DAS_XML_PRETTY && out->last != DAS_XML_LAST_NONE )
+		das_xml_emit( out, (const unsigned char*)"\n", 1 );
+	das_xml_flush( out );
+	if ( fclose( out->fp ) != 0 )
+		out->failed = 1;
+	out->fp = NULL;
+	if ( out->failed ) {
+		fprintf( stderr, ":: ERROR: File write error.\n" );
+		return( -1 );
+	}
+	return( 0 );
+
+}
+
+void das_xml_put_view( struct das_xml_out* out, const struct das_view* view, int offset, int size ) {
+
+	// De-shift a chunk at a time into the writer
+	unsigned char chunk[16384];
+	int at = 0, n = 0;
+	for ( at = 0; at < size; at += n ) {
+		n = size - at < (int)sizeof( chunk ) ? size - at : (int)sizeof( chunk );
+		das_view_read( view, offset + at, chunk, n );
+		das_xml_put( out, chunk, n );
+	}
+
+}
+
+static unsigned int das_span_u32( const struct das_view* view, struct das_span span ) {
+
+	char num[16] = "";
+	if ( span.len <= 0 || span.len >= (int)sizeof( num ) )
+		return( 0 );
+	das_view_read( view, span.offset, (unsigned char*)num, span.len );
+	num[span.len] = '\0';
+	return( (unsigned int)strtoul( num, NULL, 10 ) );
+
+}
+
+static float das_span_f32( const struct das_view* view, struct das_span span ) {
+
+	char num[32] = "";
+	if ( span.len <= 0 || span.len >= (int)sizeof( num ) )
+		return( 0 );
+	das_view_read( view, span.offset, (unsigned char*)num, span.len );
+	num[span.len] = '\0';
+	return( strtof( num, NULL ) );
+
+}
+
+void das_xml_annotate( struct das_xml_out* out, const struct das_view* view, int offset, int size ) {
+
+	// Copy the XML, adding <!-- path --> after each tag with a known texNameHash
+	struct das_sax sax;
+	const char* path = NULL;
+	int written = offset, type = 0;
+	das_sax_init( &sax, view, offset, size );
+	do {
+		type = das_sax_next( &sax );
+		if ( path != NULL && !sax.in_tag && sax.tag_end > written ) {
+			das_xml_put_view( out, view, written, sax.tag_end - written );
+			das_xml_put( out, (const unsigned char*)"<!-- ", 5 );
+			das_xml_put( out, (const unsigned char*)path, (int)strlen( path ) );
+			das_xml_put( out, (const unsigned char*)" -->", 4 );
+			written = sax.tag_end;
+			path = NULL;
+		}
+		if ( type == DAS_SAX_ATTR &&
+				das_sax_is( &sax, sax.name, "texNameHash", 11 ) )
+			path = das_asset_lookup( das_span_u32( view, sax.value ) );
+	} while ( type > DAS_SAX_END );
+	das_xml_put_view( out, view, written, offset + size - written );
+
+}
+
+int das_face_xml_read( const struct das_file* file, struct das_face_xml* face ) {
+
+	// Complexion from the first XML that has textures, skin tone from any
+	// texNameHash that is a known skin tone
+	static const char* tex_names[6] = {
+		"D1_Diffuse", "D2_Diffuse", "N1_Normal", "N2_Normal", "S1_Specular", "S2_Specular"
+	};
+	struct das_xml_iter it;
+	struct xml_hit hit;
+	struct das_sax sax;
+	int type = 0, i = 0;
+	memset( face, 0, sizeof( struct das_face_xml ) );
+	face->skin_tone = -1;
+	das_xml_iter_init( &it, file->data, (int)file->size );
+	while ( das_xml_iter_next( &it, &hit ) && face->tex_count == 0 ) {
+		struct das_view view = das_view_init( file->data, (int)file->size, hit.shift );
+		int size = hit.offset >= 4 ? (int)das_view_read_u32( &view, hit.offset - 4 ) : 0;
+		if ( size <= 0 || size > (int)file->size - hit.offset )
+			continue;
+		das_sax_init( &sax, &view, hit.offset, size );
+		while ( ( type = das_sax_next( &sax ) ) > DAS_SAX_END ) {
+			if ( type != DAS_SAX_ATTR || sax.depth == 0 )
+				continue;
+			struct das_span elem = sax.stack[sax.depth-1];
+			if ( das_sax_is( &sax, sax.name, "texNameHash", 11 ) ) {
+				unsigned int hash = das_span_u32( &view, sax.value );
+				for ( i = 0; i < 6; i++ )
+					if ( das_sax_is( &sax, elem, tex_names[i], (int)strlen( tex_names[i] ) ) ) {
+						face->tex[i] = hash;
+						face->tex_count++;
+					}
+				for ( i = 0; i < DAS_NUM_SKIN_TONES; i++ )
+					if ( das_skin_tones[i].hash == hash )
+						face->skin_tone = i;
+			} else if ( sax.name.len == 1 ) {
+				// x, y, z (and w) of the two weight elements
+				unsigned char axis = das_view_u8( &view, sax.name.offset );
+				int k = axis == 'x' ? 0 : axis == 'y' ? 1 : axis == 'z' ? 2 : axis == 'w' ? 3 : -1;
+				if ( k >= 0 && k < 3 && das_sax_is( &sax, elem, "ComplextionBlend_Diff_Norm_Spec", 31 ) )
+					face->blend[k] = das_span_f32( &view, sax.value );
+				else if ( k >= 0 && das_sax_is( &sax, elem, "TintDetailWeights", 17 ) )
+					face->tint[k] = das_span_f32( &view, sax.value );
+			}
+		}
+	}
+	return( face->tex_count > 0 ? 0 : -1 );
+
+}
+
+int das_complexion_check( const struct das_file* file, const struct header* header,
+		const char* path, char* out, size_t out_size ) {
+
+	// Which preset of the save's race and gender the face is, if any
+	struct das_face_xml face;
+	const char* race = header->player_race;
+	const char* gender = header->player_gender;
+	int i = 0, k = 0, known = 0, match = -1;
+	if ( das_face_xml_read( file, &face ) == -1 ) {
+		fprintf( stderr, ":: ERROR: %s: No complexion in the XMLs.\n", path );
+		return( -1 );
+	}
+	for ( i = 0; i < DAS_NUM_COMPLEXIONS && match == -1; i++ ) {
+		const struct das_complexion* c = &das_complexions[i];
+		if ( strcmp( c->race, race ) != 0 || strcmp( c->gender, gender ) != 0 )
+			continue;
+		known = 1;
+		for ( k = 0; k < 6 && c->tex[k] == face.tex[k]; k++ );
+		if ( k < 6 )
+			continue;
+		// The notes round to a few digits
+		for ( k = 0; k < 3; k++ )
+			if ( c->blend[k] - face.blend[k] > 0.0001f || face.blend[k] - c->blend[k] > 0.0001f )
+				break;
+		if ( k < 3 )
+			continue;
+		for ( k = 0; k < 4; k++ )
+			if ( c->tint[k] - face.tint[k] > 0.0001f || face.tint[k] - c->tint[k] > 0.0001f )
+				break;
+		if ( k == 4 )
+			match = i;
+	}
+	int len = snprintf( out, out_size, "%s %s", race, gender );
+	if ( !known ) {
+		snprintf( out + len, out_size - len, "\tno presets known" );
+		return( 0 );
+	}
+	if ( match == -1 ) {
+		fprintf( stderr, ":: ERROR: %s: Complexion is not a %s %s preset.\n", path, race, gender );
+		return( -1 );
+	}
+	len += snprintf( out + len, out_size - len, "\tcomplexion %.2d", das_complexions[match].slider );
+
+	// A skin tone made for another race or gender is a broken face
+	if ( face.skin_tone != -1 ) {
+		const struct das_skin_tone* st = &das_skin_tones[face.skin_tone];
+		if ( strcmp( st->race, race ) != 0 || strcmp( st->gender, gender ) != 0 ) {
+			fprintf( stderr, ":: ERROR: %s: Skin tone is a %s %s one.\n", path, st->race, st->gender );
+			return( -1 );
+		}
+		snprintf( out + len, out_size - len, "\tskin tone %.2d", st->step );
+	}
+	return( 0 );
+
+}
+
+int das_field_anchor( int field ) {
+
+	// Which anchor's values a field is among
+	int i = 0, d = 0;
+	for ( i = 0; i < DAS_NUM_ANCHORS; i++ )
+		for ( d = 0; d < das_anchors[i].count; d++ )
+			if ( das_anchors[i].index[d] == field )
+				return( i );
+	return( -1 );
+
+}
+
+static int das_face_write_cmp( const void* a, const void* b ) {
+
+	const struct das_face_write* wa = (const struct das_face_write*)a;
+	const struct das_face_write* wb = (const struct das_face_write*)b;
+	return( ( wa->offset > wb->offset ) - ( wa->offset < wb->offset ) );
+
+}
+
+int das_face_compile( const unsigned char* data, size_t size, struct das_face_preset* preset ) {
+
+	// v1 or v2 preset into (field, value) pairs, -1 if it is damaged
+	const unsigned char v1_magic[12] = { 'D', 'A', 'S', 'F', 'A', 'C', 'E', 'D', 'A', 'T', 'A', 0x0A };
+	int field = 0, i = 0;
+	preset->count = 0;
+	if ( size >= 17 && memcmp( data, v1_magic, 12 ) == 0 ) {
+		// v1: value count, then index, value and 0x0A for each
+		int num = 0;
+		memcpy( &num, data + 12, 4 );
+		if ( num < 0 || num > DAS_NUM_VALUES || size != (size_t)num * 9 + 17 )
+			return( -1 );
+		for ( i = 0; i < num; i++ ) {
+			const unsigned char* rec = data + 17 + i * 9;
+			memcpy( &field, rec, 4 );
+			if ( field < 0 || field >= DAS_NUM_VALUES )
+				return( -1 );
+			preset->field[i] = field;
+			memcpy( &preset->value[i], rec + 4, 4 );
+		}
+		preset->count = num;
+		return( 0 );
+	}
+
+	// v2: the field must be in the bitmap and behind the anchor it was
+	// exported from
+	const struct das_face_head* head = (const struct das_face_head*)data;
+	if ( size < sizeof( struct das_face_head ) || memcmp( head->magic, DAS_FACE_MAGIC, 8 ) != 0 ||
+			head->version != DAS_FACE_VERSION ||
+			head->record_size < (int)sizeof( struct das_face_rec ) ||
+			head->count < 0 || head->count > DAS_NUM_VALUES ||
+			size < sizeof( struct das_face_head ) + (size_t)head->count * head->record_size )
+		return( -1 );
+	for ( i = 0; i < head->count; i++ ) {
+		const struct das_face_rec* rec = (const struct das_face_rec*)
+			( data + sizeof( struct das_face_head ) + (size_t)i * head->record_size );
+		field = rec->field;
+		if ( field < 0 || field >= DAS_NUM_VALUES ||
+				!( head->present[field / 32] & ( 1u << ( field % 32 ) ) ) ||
+				das_anchors[das_field_anchor( field )].hash != rec->anchor )
+			return( -1 );
+		preset->field[i] = field;
+		preset->value[i] = rec->value;
+	}
+	preset->count = head->count;
+	return( 0 );
+
+}
+
+int das_face_load( const char* filename, struct das_face_preset* preset ) {
+
+	// Map the face file read only, it isn't needed after this
+	struct das_file face;
+	if ( das_file_open( &face, filename, 0 ) == -1 )
+		return( -1 );
+	int ret = das_face_compile( face.data, face.size, preset );
+	das_file_close( &face );
+	if ( ret == -1 )
+		fprintf( stderr, ":: ERROR: %s is not a face data file.\n", filename );
+	return( ret );
+
+}
+
+int das_face_resolve( const struct das_face_preset* preset, const struct handle* hb,
+		struct das_face_write* writes ) {
+
+	// Fields the save doesn't have (offset -1) are left out, writes come
+	// back sorted by offset. Returns the number of writes
+	int count = 0, i = 0;
+	for ( i = 0; i < preset->count; i++ ) {
+		if ( hb[preset->field[i]].offset == -1 )
+			continue;
+		writes[count].offset = hb[preset->field[i]].offset;
+		writes[count].value = preset->value[i];
+		count++;
+	}
+	qsort( writes, count, sizeof( struct das_face_write ), das_face_write_cmp );
+	return( count );
+
+}
+
+void das_face_apply( struct das_view* view, const struct das_face_write* writes, int count ) {
+
+	int i = 0;
+	for ( i = 0; i < count; i++ )
+		das_view_write_f32( view, writes[i].offset, writes[i].value );
+
+}
+
+int das_file_patch( const struct das_file* file, const char* filename ) {
+
+	// Write the edits into the save itself. The bytes about to be
+	// overwritten go to <save>.undo first, and the journal is on disk
+	// before the save is touched, so das_file_undo can always go back.
+#ifdef DAS_MMAP
+	double start = das_stats_start();
+	char undo_name[4096];
+	snprintf( undo_name, sizeof( undo_name ), "%s.undo", filename );
+	int fd = open( filename, O_RDWR );
+	struct stat sb;
+	if ( fd == -1 || fstat( fd, &sb ) == -1 ) {
+		fprintf( stderr, ":: ERROR: Cannot open file \"%s\"\n", filename );
+		if ( fd != -1 )
+			close( fd );
+		return( -1 );
+	}
+
+	// Only the dirty ranges while the save is still mapped at its old size,
+	// all of it once an edit moved bytes around
+	struct das_undo_rec whole = { .offset = 0, .len = sb.st_size };
+	int ranges = file->mapped && (size_t)sb.st_size == file->size;
+	int count = ranges ? file->dirty_count : 1, i = 0, ok = 1;
+	struct das_undo_head head = { .magic = DAS_UNDO_MAGIC, .size = sb.st_size, .count = count };
+	FILE* fp = fopen( undo_name, "wb" );
+	if ( fp == NULL ) {
+		fprintf( stderr, ":: ERROR: Cannot create file \"%s\"\n", undo_name );
+		close( fd );
+		return( -1 );
+	}
+	ok = fwrite( &head, sizeof( head ), 1, fp ) == 1;
+	for ( i = 0; i < count && ok; i++ ) {
+		struct das_undo_rec rec = whole;
+		if ( ranges ) {
+			rec.offset = file->dirty[i].start;
+			rec.len = file->dirty[i].end - file->dirty[i].start;
+		}
+		unsigned char* old = (unsigned char*)malloc( rec.len ? rec.len : 1 );
+		ok = old != NULL && pread( fd, old, rec.len, rec.offset ) == rec.len &&
+			fwrite( &rec, sizeof( rec ), 1, fp ) == 1 &&
+			fwrite( old, 1, rec.len, fp ) == (size_t)rec.len;
+		free( old );
+		if ( das_stats_cur ) {
+			das_stats_cur->allocs++;
+			das_stats_cur->bytes_written += sizeof( rec ) + rec.len * 2;
+		}
+	}
+	ok = ok && fflush( fp ) == 0 && fsync( fileno( fp ) ) == 0;
+	ok = fclose( fp ) == 0 && ok;
+	if ( !ok ) {
+		fprintf( stderr, ":: ERROR: Cannot write file \"%s\", save left unchanged.\n", undo_name );
+		unlink( undo_name );
+		close( fd );
+		return( -1 );
+	}
+
+	// Now the edit itself
+	int ret = 0;
+	if ( ranges ) {
+		for ( i = 0; i < file->dirty_count && ret == 0; i++ )
+			ret = das_pwrite_all( fd, file->data + file->dirty[i].start,
+				file->dirty[i].end - file->dirty[i].start, file->dirty[i].start );
+	} else {
+		ret = das_pwrite_all( fd, file->data, file->size, 0 );
+		if ( ret == 0 && ftruncate( fd, file->size ) == -1 )
+			ret = -1;
+	}
+	if ( ret == 0 && fsync( fd ) == -1 )
+		ret = -1;
+	if ( close( fd ) == -1 )
+		ret = -1;
+	if ( ret == -1 ) {
+		fprintf( stderr, ":: ERROR: writing %s, restore it with undo.\n", filename );
+		return( -1 );
+	}
+	das_stats_stop( DAS_STAGE_WRITE, start );
+	return( 0 );
+#else
+	(void)file;
+	fprintf( stderr, ":: ERROR: %s: In place edits are not supported here.\n", filename );
+	return( -1 );
+#endif
+
+}
+
+int das_file_undo( const char* filename ) {
+
+	// Put the bytes from <save>.undo back and drop the journal. Safe to
+	// run again if it is interrupted, the journal stays until the end.
+#ifdef DAS_MMAP
+	char undo_name[4096];
+	snprintf( undo_name, sizeof( undo_name ), "%s.undo", filename );
+	struct das_file undo;
+	if ( das_file_open( &undo, undo_name, 0 ) == -1 )
+		return( -1 );
+	const struct das_undo_head* head = (const struct das_undo_head*)undo.data;
+	size_t pos = sizeof( struct das_undo_head );
+	int i = 0, ret = 0;
+	if ( undo.size < pos || memcmp( head->magic, DAS_UNDO_MAGIC, 8 ) != 0 || head->count < 0 ) {
+		fprintf( stderr, ":: ERROR: %s is not an undo journal.\n", undo_name );
+		das_file_close( &undo );
+		return( -1 );
+	}
+	int fd = open( filename, O_WRONLY );
+	if ( fd == -1 ) {
+		fprintf( stderr, ":: ERROR: Cannot open file \"%s\"\n", filename );
+		das_file_close( &undo );
+		return( -1 );
+	}
+	for ( i = 0; i < head->count && ret == 0; i++ ) {
+		struct das_undo_rec rec;
+		if ( undo.size - pos < sizeof( rec ) ) {
+			ret = -1;
+			break;
+		}
+		memcpy( &rec, undo.data + pos, sizeof( rec ) );
+		pos += sizeof( rec );
+		if ( rec.offset < 0 || rec.len < 0 || (size_t)rec.len > undo.size - pos ||
+				rec.offset + rec.len > head->size ) {
+			ret = -1;
+			break;
+		}
+		ret = das_pwrite_all( fd, undo.data + pos, rec.len, rec.offset );
+		pos += rec.len;
+	}
+	if ( ret == 0 && ( ftruncate( fd, head->size ) == -1 || fsync( fd ) == -1 ) )
+		ret = -1;
+	if ( close( fd ) == -1 )
+		ret = -1;
+	das_file_close( &undo );
+	if ( ret == -1 ) {
+		fprintf( stderr, ":: ERROR: Cannot restore %s from %s.\n", filename, undo_name );
+		return( -1 );
+	}
+	unlink( undo_name );
+	return( 0 );
+#else
+	fprintf( stderr, ":: ERROR: %s: In place edits are not supported here.\n", filename );
+	return( -1 );
+#endif
+
+}
+
+int das_mkdir( const char* path ) {
+
+	// Fine if it is there already, missing parents are made too
+	struct stat sb;
+	char dir[4096];
+	size_t i = 0;
+	snprintf( dir, sizeof( dir ), "%s", path );
+	for ( i = 1; dir[i]; i++ ) {
+		if ( dir[i] != '/' && dir[i] != '\\' )
+			continue;
+		dir[i] = '\0';
+#ifdef _WIN32
+		mkdir( dir );
+#else
+		mkdir( dir, 0755 );
+#endif
+		dir[i] = path[i];
+	}
+#ifdef _WIN32
+	mkdir( path );
+#else
+	mkdir( path, 0755 );
+#endif
+	if ( stat( path, &sb ) == -1 || !S_ISDIR( sb.st_mode ) ) {
+		fprintf( stderr, ":: ERROR: Cannot create directory \"%s\"\n", path );
+		return( -1 );
+	}
+	return( 0 );
+
+}
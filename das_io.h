@@ -0,0 +1,145 @@
+// The editor's side of a save that batch mode and das_bench share: files
+// in and out, the XML writer and dumps, the asset notes and face presets.
+// Built on the core in das_internal.h; these print their errors to stderr.
+
+#ifndef DAS_IO_H
+#define DAS_IO_H
+
+#include <stdio.h>
+
+#include "das_internal.h"
+
+// DASFACE v2 preset: the head, then one record per field set in the
+// bitmap. Little endian and 4 byte aligned, so a mapped file is read as is
+#define DAS_FACE_MAGIC   "DASFACE2"
+#define DAS_FACE_VERSION 2
+struct das_face_head {
+	char         magic[8];
+	int          version;
+	int          record_size;
+	int          count;
+	unsigned int present[2]; // Bit i % 32 of present[i / 32] = field i
+};
+
+struct das_face_rec {
+	unsigned int anchor;     // Hash in front of the field's values
+	int          field;      // Index into das_fields
+	float        value;
+};
+
+// A preset as read from its file, not tied to any save yet
+struct das_face_preset {
+	int   count;
+	int   field[DAS_NUM_VALUES];
+	float value[DAS_NUM_VALUES];
+};
+
+// An import resolved against one save
+struct das_face_write {
+	int   offset;
+	float value;
+};
+
+// Buffered XML output. Newline mode is the old dump format (a newline
+// after every '>'), raw writes the bytes as they are, pretty indents.
+#define DAS_XML_NEWLINE   0
+#define DAS_XML_RAW       1
+#define DAS_XML_PRETTY    2
+#define DAS_XML_ANNOTATE  8
+#define DAS_XML_BUF       65536
+#define DAS_XML_LAST_NONE 0
+#define DAS_XML_LAST_OPEN 1
+#define DAS_XML_LAST_TAG  2
+#define DAS_XML_LAST_TEXT 3
+struct das_xml_out {
+	FILE*         fp;
+	int           mode;
+	int           len;
+	int           failed;
+	// Pretty printer state, kept between chunks
+	int           depth;
+	int           in_tag;
+	int           quote;
+	int           kind;
+	int           prev;
+	int           last;
+	int           text;
+	unsigned char buf[DAS_XML_BUF];
+};
+
+// Undo journal of an in-place edit, <save>.undo: the head, then for each
+// range its offset and length followed by the bytes it had before
+#define DAS_UNDO_MAGIC "DASUNDO1"
+struct das_undo_head {
+	char      magic[8];
+	long long size;        // Size of the save before the edit
+	int       count;
+	int       reserved;
+};
+
+struct das_undo_rec {
+	long long offset;
+	long long len;
+};
+
+// Known texture hashes, and the complexion and skin tone presets that
+// use them (das_assets.h)
+struct das_asset {
+	unsigned int hash;
+	const char*  path;
+};
+
+struct das_complexion {
+	const char*  race;
+	const char*  gender;
+	int          slider;
+	float        blend[3];
+	float        tint[4];
+	unsigned int tex[6];
+};
+
+struct das_skin_tone {
+	const char*  race;
+	const char*  gender;
+	int          step;
+	unsigned int hash;
+};
+
+// Complexion and skin tone as the save's XMLs have them
+struct das_face_xml {
+	int          tex_count;
+	float        blend[3];
+	float        tint[4];
+	unsigned int tex[6];
+	int          skin_tone;
+};
+
+// Batch mode keeps stdout to one status line per file
+extern int das_quiet;
+
+unsigned char* file_to_char( const char*, size_t* );
+char* das_tmp_name( char*, size_t, const char* );
+int char_to_file( const char*, unsigned char*, size_t );
+const char* das_asset_lookup( unsigned int );
+int das_find_values( struct das_file*, struct handle*, struct das_view* );
+int das_dump_xmls( unsigned char*, int, const char*, int, char*, size_t );
+int das_file_open( struct das_file*, const char*, int );
+int das_file_writable( struct das_file* );
+int das_file_write( const struct das_file*, const char* );
+int das_xml_open( struct das_xml_out*, const char*, int );
+void das_xml_put( struct das_xml_out*, const unsigned char*, int );
+int das_xml_close( struct das_xml_out* );
+void das_xml_put_view( struct das_xml_out*, const struct das_view*, int, int );
+void das_xml_annotate( struct das_xml_out*, const struct das_view*, int, int );
+int das_face_xml_read( const struct das_file*, struct das_face_xml* );
+int das_complexion_check( const struct das_file*, const struct header*, const char*, char*, size_t );
+int das_field_anchor( int );
+int das_face_compile( const unsigned char*, size_t, struct das_face_preset* );
+int das_face_load( const char*, struct das_face_preset* );
+int das_face_resolve( const struct das_face_preset*, const struct handle*, struct das_face_write* );
+void das_face_apply( struct das_view*, const struct das_face_write*, int );
+int das_file_patch( const struct das_file*, const char* );
+int das_file_undo( const char* );
+int das_mkdir( const char* );
+
+#endif
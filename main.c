@@ -1,77 +1,428 @@
-// Linux: compile with gcc: gcc main.c -o das_editor -Wall
+// Linux: compile with gcc: gcc main.c das.c das_io.c -o das_editor -Wall -pthread -lm
 // Windows x86 built with mingw-w64.
 
+// Linux: accept4
+#ifdef __linux__
+#	define _GNU_SOURCE
+#endif
+
 // Standard C libs
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <math.h>
 
 // POSIX
 #include <sys/stat.h>
+#include <dirent.h>
+#include <pthread.h>
+#ifndef _WIN32
+#	include <fcntl.h>
+#endif
+#ifdef __linux__
+#	include <sys/epoll.h>
+#	include <sys/eventfd.h>
+#	include <sys/signalfd.h>
+#	include <sys/socket.h>
+#	include <sys/un.h>
+#endif
 
 // Platform specific librarys
 #ifdef _WIN32
 #	include <windows.h>
 #endif
 
-struct handle {
-	int   hash;
-	int   offset;
-	float fp_val;
+// Save parsing core (das.c) and the file side shared with das_bench (das_io.c)
+#include "das_internal.h"
+#include "das_io.h"
+
+// Bulk color transforms (color). The 16 RGB triplets of the face values
+// are read into planes of reds, greens and blues and every op runs over
+// all of them in one pass. Hue, saturation, brightness and blend are
+// linear, back to back they are folded into one affine matrix.
+#define DAS_NUM_COLORS    16
+#define DAS_COLOR_OPS     16
+#define DAS_COLOR_MATRIX  1   // m[0..8] row major 3x3, m[9..11] added after
+#define DAS_COLOR_CLAMP   2
+#define DAS_COLOR_LINEAR  3   // sRGB to linear
+#define DAS_COLOR_SRGB    4   // Linear to sRGB
+struct das_color_op {
+	int   type;
+	float m[12];
 	float min;
 	float max;
-	char  name[32];
 };
 
-struct header {
-	int       size;
-	int       data_size;
+struct das_color_plan {
+	int                 count;
+	struct das_color_op op[DAS_COLOR_OPS];
+	unsigned int        mask;      // Triplets to change, bit per das_colors entry
+};
+
+// Content defined chunks, cut by a Gear rolling hash
+struct das_chunk {
+	size_t       offset;
+	size_t       len;
+	unsigned int hash;
+};
+
+// Open addressing map from 64 bit keys to ints, val -1 = empty slot
+struct das_map {
+	unsigned long long* key;
+	int*                val;
+	int                 cap;
+	int                 count;
+};
+
+// One save of a diff, and the byte ranges the structural diff covered
+struct das_diff_side {
+	struct das_file  file;
+	struct header    header;
+	int              shift;
+	struct handle    value[DAS_NUM_VALUES];
+	struct xml_hit*  xmls;
+	int              xml_count;
+	struct das_span* known;
+	int              known_count;
+};
+
+// SHA-256, the chunk and save ids of the archive store
+struct das_sha256 {
+	unsigned int       state[8];
+	unsigned char      buf[64];
+	int                fill;
+	unsigned long long len;
+};
+
+// Archive store: chunks/xx/<sha256> holds each distinct chunk once,
+// saves/<sha256 of the save>.manifest lists a save's chunks in order.
+// Chunks are cut from the save read at its XML shift, restoring shifts
+// them back.
+#define DAS_MANIFEST_MAGIC   "DASMANIF"
+#define DAS_MANIFEST_VERSION 1
+#define DAS_CHUNK_MIN        2048
+#define DAS_CHUNK_AVG        8192
+#define DAS_CHUNK_MAX        65536
+#define DAS_CHUNK_BITS       13
+struct das_manifest_head {
+	char          magic[8];
+	int           version;
+	int           count;
+	long long     size;
+	int           shift;
+	int           reserved;
+	unsigned char sha[32];
+	char          name[256];
+};
+
+struct das_manifest_rec {
+	unsigned char sha[32];
+	int           len;
+	int           reserved;
+};
+
+// Totals over every save of one archive run
+struct das_store {
+	const char*     dir;
+	pthread_mutex_t lock;
+	long long       bytes_in;
+	long long       bytes_new;
+	int             chunks;
+	int             chunks_new;
+};
+
+struct das_stats_sum {
+	pthread_mutex_t  lock;
+	int              text;          // Report on stderr
+	FILE*            json;          // JSON lines, or NULL
+	int              files;
+	int              failed;
+	int              shifts[8];     // Files per shift
+	struct das_stats total;
+};
+
+// Save metadata index. A head, fixed size records sorted by path, then a
+// pool of strings the records point into, so it can be used straight
+// from a mapping. Records are reused while size and mtime don't change.
+#define DAS_INDEX_VERSION 1
+#define DAS_IDX_PATH     0
+#define DAS_IDX_NAME     1
+#define DAS_IDX_RACE     2
+#define DAS_IDX_GENDER   3
+#define DAS_IDX_CLASS    4
+#define DAS_IDX_LOCATION 5
+#define DAS_IDX_AREA     6
+#define DAS_IDX_BUILD    7
+#define DAS_IDX_ADDONS   8
+#define DAS_INDEX_STRS   9
+struct das_index_head {
+	char magic[8];
+	int  version;
+	int  record_size;
+	int  count;
+	int  pool_size;
+	int  reserved[2];
+};
+
+struct das_index_rec {
+	long long size;
+	long long mtime;
+	long long timestamp;
 	int       checksum;
-	int       item_count;
-	char      player_name[24];
-	char      player_race[8];
-	char      player_gender[8];
-	float     total_play_time;
-	char      player_id[64];
-	char      player_class[16];
+	int       str[DAS_INDEX_STRS];
 	int       player_level;
-	char      player_pos[32];
-	char      area_id[16];
-	char      player_location[64];
-	char      thumbnail[64];
-	char      assets[128];
-	long long timestamp;
-	char      build_number[16];
 	int       patch_number;
-	int       addon_count;
-	char      addons[32][128];
-	int       data_checksum;
+	float     total_play_time;
+	// Face values as das_find_values found them, -1 if not
+	int       shift;
+	int       offset[DAS_NUM_VALUES];
+};
+
+// Old index as loaded, and the new one being built from it
+struct das_index {
+	struct das_file             file;
+	int                         count;
+	const struct das_index_rec* rec;
+	const char*                 pool;
+	pthread_mutex_t             lock;
+	struct das_index_rec*       new_rec;
+	int                         new_count;
+	int                         new_alloc;
+	char*                       new_pool;
+	int                         new_pool_size;
+	int                         new_pool_alloc;
+};
+
+// Batch mode commands, numbered like the menu options
+#define DAS_CMD_NONE        0
+#define DAS_CMD_EXPORT_FACE 1
+#define DAS_CMD_IMPORT_FACE 2
+#define DAS_CMD_SET_FACE    3
+#define DAS_CMD_DUMP_XML    4
+#define DAS_CMD_SCAN        5
+#define DAS_CMD_INFO        6
+#define DAS_CMD_INDEX       7
+#define DAS_CMD_LIST        8
+#define DAS_CMD_VERIFY      9
+#define DAS_CMD_XML_GET     10
+#define DAS_CMD_XML_SET     11
+#define DAS_CMD_COMPLEXION  12
+#define DAS_CMD_STAMP       13
+#define DAS_CMD_UNDO        14
+#define DAS_CMD_DIFF        15
+#define DAS_CMD_ARCHIVE     16
+#define DAS_CMD_RESTORE     17
+#define DAS_CMD_SERVE       18
+#define DAS_CMD_COLOR       19
+
+struct das_batch {
+	int         command;
+	int         jobs;
+	const char* out_dir;
+	const char* preset;
+	int         set_count;
+	int         set_index[DAS_NUM_VALUES];
+	float       set_value[DAS_NUM_VALUES];
+	const char* db;
+	int         verify;
+	int         fix_checksums;
+	int         xml_mode;
+	const char* query;
+	const char* value;
+	struct das_index* index;
+	const struct das_face_preset* face;
+	int         in_place;
+	struct das_store* store;
+	struct das_stats_sum* stats;
+	const char* socket;
+	int         cache;
+	const struct das_color_plan* color;
+};
+
+// Growable list of save paths
+struct das_paths {
+	char** path;
+	int    count;
+	int    alloc;
+};
+
+// Work stealing pool. Each worker owns a deque of jobs (indexes into the
+// path list), pops its own from the tail and steals from others' heads.
+struct das_deque {
+	pthread_mutex_t lock;
+	int*            job;
+	int             head;
+	int             tail;
+};
+
+struct das_pool {
+	const struct das_batch* batch;
+	struct das_paths*       paths;
+	struct das_deque*       deque;
+	int                     workers;
+};
+
+// serve: a daemon answering one JSON object per line on a Unix socket.
+// An epoll loop reads requests and writes replies, a pool of workers
+// answers them. Parsed saves stay in an LRU cache keyed by device and
+// inode, and are parsed again once their mtime or size changes.
+#define DAS_SERVE_LINE_MAX 65536
+#define DAS_SERVE_FIELDS   8
+#define DAS_SERVE_EVENTS   64
+struct das_request {
+	int  count;
+	char key[DAS_SERVE_FIELDS][16];
+	char value[DAS_SERVE_FIELDS][4096];
+	int  string[DAS_SERVE_FIELDS];
+};
+
+struct das_cache_xml {
+	int offset;
+	int shift;
+	int size;
+};
+
+struct das_cache_entry {
+	unsigned long long      key;
+	dev_t                   dev;
+	ino_t                   ino;
+	off_t                   size;
+	struct timespec         mtime;
+	struct das_file         file;      // Mapped read only
+	struct header           header;
+	struct handle           value[DAS_NUM_VALUES];
+	int                     face;      // The face values were found
+	int                     shift;
+	struct das_cache_xml*   xml;
+	int                     xml_count;
+	int                     refs;
+	int                     slot;      // Index in das_cache.slot, -1 once dropped
+	struct das_cache_entry* prev;      // LRU list, most recently used first
+	struct das_cache_entry* next;
+};
+
+struct das_cache {
+	pthread_mutex_t          lock;
+	struct das_map           map;      // key -> slot
+	struct das_cache_entry** slot;
+	int                      slots;
+	int                      cap;
+	int                      count;
+	struct das_cache_entry*  head;
+	struct das_cache_entry*  tail;
+	long long                hits;
+	long long                misses;
 };
 
-struct xml_file {
-	int*			size;
-	int*			offset;
-	int*			shift_amount;
-	unsigned char**	data;
+// A client. The event loop, every queued job and the ready list hold a
+// reference, it is freed when the last one goes.
+struct das_conn {
+	int              fd;
+	int              refs;
+	int              jobs;
+	int              closed;
+	int              eof;
+	int              ready;
+	int              events;
+	char*            in;
+	int              in_len;
+	char*            out;
+	size_t           out_len;
+	size_t           out_sent;
+	size_t           out_alloc;
+	struct das_conn* ready_next;
+	struct das_conn* prev;
+	struct das_conn* next;
+};
+
+struct das_job {
+	struct das_conn* conn;
+	char*            line;
+	struct das_job*  next;
+};
+
+struct das_server {
+	const struct das_batch* batch;
+	int                     epfd;
+	int                     listen_fd;
+	int                     wake_fd;
+	int                     signal_fd;
+	pthread_mutex_t         lock;      // Jobs, replies and references
+	pthread_cond_t          cond;
+	struct das_job*         head;
+	struct das_job*         tail;
+	struct das_conn*        ready;     // Connections with new replies
+	struct das_conn*        conns;     // Only the event loop uses this
+	int                     workers;
+	int                     stop;
+	struct das_cache        cache;
+};
+
+struct das_worker {
+	struct das_pool* pool;
+	int              id;
+	int              failed;
+	pthread_t        thread;
 };
 
 int is_little_endian( void );
-int char_to_file( const char*, unsigned char*, size_t );
-int das_rw_values( unsigned char*, int, int );
-int das_manual_write( struct handle, unsigned char* );
+int das_rw_values( struct das_file*, int );
+int das_manual_write( struct handle, struct das_view* );
 int das_file_export( const char*, struct handle*, int );
-int das_import_file_write( const char*, struct handle*, int, unsigned char* );
-const char* das_str_lookup( int );
-unsigned char* file_to_char( const char*, size_t* );
+int das_import_file_write( const char*, struct handle*, int, struct das_view* );
 void enter_to_continue( void );
-struct handle das_set_struct( unsigned char*, const char[32], int, float, float );
-struct header das_read_header( unsigned char* );
-char* das_ts_to_str( long long );
-char* das_pt_to_str( float );
+int das_read_header_file( const char*, struct header*, unsigned char*, size_t );
+void das_header_format( const struct header*, char*, size_t );
+char* das_ts_to_str( long long, char*, size_t );
+char* das_pt_to_str( float, char*, size_t );
 int xml_mem_to_file( unsigned char*, int, const char* );
-int das_dump_xmls( unsigned char*, int );
+int das_xml_mode( const char* );
+int das_xml_query( const struct das_view*, int, int, const char*, struct das_span*, int );
+int das_xml_splice( struct das_file*, int, int, int, int, const unsigned char*, int );
+int das_xml_edit( struct das_file*, const char*, const char*, char*, size_t );
+int das_xml_get( const struct das_file*, const char*, char*, size_t );
+size_t das_cdc_next( const unsigned char*, size_t, size_t, size_t, size_t, size_t, int );
+int das_chunks( const unsigned char*, size_t, size_t, size_t, size_t, int, struct das_chunk** );
+int das_diff( const char*, const char*, FILE* );
+int das_batch_command( const char* );
+void das_batch_usage( void );
+void das_out_path( char*, size_t, const char*, const char*, const char* );
+int das_batch_save( const struct das_batch*, struct das_file*, const char*, char*, size_t );
+int das_diff_main( int, char*[] );
+void das_sha256_init( struct das_sha256* );
+void das_sha256_update( struct das_sha256*, const unsigned char*, size_t );
+void das_sha256_final( struct das_sha256*, unsigned char[32] );
+int das_archive_file( struct das_store*, const char*, char*, size_t );
+int das_restore_file( const char*, const char*, const char*, char*, size_t );
+void das_stats_add( struct das_stats_sum*, const char*, int, const struct das_stats* );
+void das_stats_print( const struct das_stats_sum*, const char*, int, const struct das_stats* );
+int das_serve( const struct das_batch* );
+int das_batch_set( struct das_batch*, const char* );
+int das_color_parse( struct das_color_plan*, const char* );
+int das_color_only( struct das_color_plan*, const char* );
+int das_color_apply( const struct das_color_plan*, struct handle*, struct das_view* );
+int das_batch_run( const struct das_batch*, struct das_file*, const char*, char*, size_t );
+int das_batch_file( const struct das_batch*, const char* );
+int das_batch_main( int, char*[] );
+int das_paths_add( struct das_paths*, const char* );
+int das_paths_walk( struct das_paths*, const char* );
+void das_paths_free( struct das_paths* );
+int das_pool_run( const struct das_batch*, struct das_paths*, int );
+int das_index_load( struct das_index*, const char* );
+const struct das_index_rec* das_index_lookup( const struct das_index*, const char* );
+int das_index_add( struct das_index*, const struct das_index_rec*, const char* const[DAS_INDEX_STRS] );
+int das_index_write( struct das_index*, const char* );
+void das_index_free( struct das_index* );
+void das_index_format( const struct das_index_rec*, const char* const[DAS_INDEX_STRS], char*, size_t );
+int das_index_file( struct das_index*, const char*, int, char*, size_t );
+int das_index_values( const struct das_index*, struct das_file*, const char*, struct handle*, struct das_view* );
+int das_batch_values( const struct das_batch*, struct das_file*, const char*, struct handle*, struct das_view* );
+int das_index_list( const char* );
 
 int main( int argc, char* argv[] ) {
 
@@ -85,6 +436,10 @@ int main( int argc, char* argv[] ) {
 		return( EXIT_FAILURE );
 	}
 
+	// Scriptable mode, never waits on stdin
+	if ( argc >= 2 && das_batch_command( argv[1] ) != DAS_CMD_NONE )
+		return( das_batch_main( argc, argv ) );
+
 	// Check input arguments
 	if ( argc < 2 ) {
 		fprintf( stderr, ":: ERROR: No file specified.\n" );
@@ -97,43 +452,28 @@ int main( int argc, char* argv[] ) {
 		return( EXIT_FAILURE );
 	}
 
-	// Is input actually a file?
+	// Map the file read only, edits are copy on write later
 	printf( ":: Opening file...\n" );
-	struct stat sb;
-	if ( stat( argv[1], &sb ) == -1 ) {
-		fprintf( stderr, ":: ERROR: Cannot stat file.\n" );
+	struct das_file file;
+	if ( das_file_open( &file, argv[1], 0 ) == -1 ) {
 		enter_to_continue();
 		return( EXIT_FAILURE );
 	}
-	switch ( sb.st_mode & S_IFMT ) {
-		case S_IFREG:
-			break;
-		default:
-			fprintf( stderr, ":: ERROR: \"%s\" is not a file.\n", argv[1] );
-			enter_to_continue();
-			return( EXIT_FAILURE );
-	}
 
 	// Don't proceed if filesize is > 2mb or < 100kb
-	if ( sb.st_size > 2000000 || sb.st_size < 100000 ) {
+	if ( file.size > 2000000 || file.size < 100000 ) {
 		fprintf( stderr, ":: ERROR: File size is off. Not a save file.\n" );
-		enter_to_continue();
-		return( EXIT_FAILURE );
-	}
-
-	// Read file into a memory buffer
-	unsigned char* data = file_to_char( argv[1], NULL );
-	if ( data == NULL ) {
+		das_file_close( &file );
 		enter_to_continue();
 		return( EXIT_FAILURE );
 	}
 	printf( "::  File loaded successfully.\n" );
 
 	// Read header block
-	struct header header = das_read_header( data );
+	struct header header = das_read_header( file.data, file.size );
 	if ( header.size == 0 ) {
 		fprintf( stderr, ":: ERROR: Cannot read file header.\n" );
-		free( data );
+		das_file_close( &file );
 		enter_to_continue();
 		return( EXIT_FAILURE );
 	}
@@ -151,9 +491,10 @@ int main( int argc, char* argv[] ) {
 	printf( ":: Build %s, Patch %d\n",
 		header.build_number,
 		header.patch_number );
+	char pt_str[64], ts_str[64];
 	printf( ":: Play Time: %s, Save Date: %s",
-		das_pt_to_str( header.total_play_time ),
-		das_ts_to_str( header.timestamp ) );
+		das_pt_to_str( header.total_play_time, pt_str, 64 ),
+		das_ts_to_str( header.timestamp, ts_str, 64 ) );
 
 	// This will be the name of the output file.
 	char new_filename[strlen(argv[1])+5];
@@ -173,28 +514,28 @@ int main( int argc, char* argv[] ) {
 	switch ( in_str[0] ) {
 		case '0':
 			printf( ":: Quitting...\n" );
-			free( data );
+			das_file_close( &file );
 			enter_to_continue();
 			return( EXIT_SUCCESS );
 			break;
 		case '1': // Export
 			printf( ":: Exporting values to file...\n" );
-			if ( das_rw_values( data, sb.st_size, 1 ) == -1 ) {
-				free( data );
+			if ( das_rw_values( &file, 1 ) == -1 ) {
+				das_file_close( &file );
 				enter_to_continue();
 				return( EXIT_FAILURE );
 			}
 			break;
 		case '2': // Import
 			printf( ":: Importing values from file...\n" );
-			if ( das_rw_values( data, sb.st_size, 2 ) == -1 ) {
-				free( data );
+			if ( das_file_writable( &file ) == -1 || das_rw_values( &file, 2 ) == -1 ) {
+				das_file_close( &file );
 				enter_to_continue();
 				return( EXIT_FAILURE );
 			}
 			// Data has been edited. Write to file.
-			if ( char_to_file( new_filename, data, sb.st_size ) == -1 ) {
-				free( data );
+			if ( das_file_write( &file, new_filename ) == -1 ) {
+				das_file_close( &file );
 				enter_to_continue();
 				return( EXIT_FAILURE );
 			}
@@ -202,14 +543,14 @@ int main( int argc, char* argv[] ) {
 			break;
 		case '3': // Manual writing of values
 			printf( ":: Manual editing all values...\n::\n" );
-			if ( das_rw_values( data, sb.st_size, 3 ) == -1 ) {
-				free( data );
+			if ( das_file_writable( &file ) == -1 || das_rw_values( &file, 3 ) == -1 ) {
+				das_file_close( &file );
 				enter_to_continue();
 				return( EXIT_FAILURE );
 			}
 			// Data has been edited. Write to file.
-			if ( char_to_file( new_filename, data, sb.st_size ) == -1 ) {
-				free( data );
+			if ( das_file_write( &file, new_filename ) == -1 ) {
+				das_file_close( &file );
 				enter_to_continue();
 				return( EXIT_FAILURE );
 			}
@@ -217,15 +558,15 @@ int main( int argc, char* argv[] ) {
 			break;
 		case '4':
 			printf( ":: Exporting XML files...\n" );
-			if ( das_dump_xmls( data, sb.st_size ) == -1 ) {
-				free( data );
+			if ( das_dump_xmls( file.data, file.size, "", DAS_XML_NEWLINE, NULL, 0 ) == -1 ) {
+				das_file_close( &file );
 				enter_to_continue();
 				return( EXIT_FAILURE );
 			}
 			break;
 		default:
 			fprintf( stderr, ":: ERROR: Incorrect option selected.\n" );
-			free( data );
+			das_file_close( &file );
 			enter_to_continue();
 			return( EXIT_SUCCESS );
 			break;
@@ -233,7 +574,7 @@ int main( int argc, char* argv[] ) {
 
 	// Let user read the console and hit enter before closing
 	// Free memory and quit
-	free( data );
+	das_file_close( &file );
 	enter_to_continue();
 	return( EXIT_SUCCESS );
 
@@ -255,570 +596,50 @@ int is_little_endian( void ) {
 
 }
 
-unsigned char* file_to_char( const char* filename, size_t* filesize ) {
-
-	// Open file if it exists, else return NULL
-	FILE * fp;
-	if ( !( fp = fopen( filename, "rb" ) ) ) {
-		fprintf( stderr, ":: ERROR: Cannot open file \"%s\"\n", filename );
-		return( NULL );
-	}
-
-	// Get the files size
-	fseek( fp, 0, SEEK_END );
-	size_t fsize = ftell( fp );
-	rewind( fp );
-
-	// Allocate memory to a buffer, +1 for null terminate
-	unsigned char* buffer = (unsigned char*)malloc( ( fsize ) * sizeof( unsigned char ) );
-	if ( buffer == NULL ) {
-		fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
-		fclose( fp );
-		return( NULL );
-	}
-
-	// Copy file data into the buffer
-	if ( fread( buffer, sizeof( unsigned char ), fsize, fp ) != fsize ) {
-		fprintf( stderr, ":: ERROR: File read error.\n" );
-		fclose( fp );
-		free( buffer );
-		return( NULL );
-	}
-
-	// Cleanup and return
-	fclose( fp );
-	if ( filesize != NULL )
-		*filesize = fsize;
-	return( buffer );
-
-}
-
-int char_to_file( const char* filename, unsigned char* data, size_t filesize ) {
-
-	// Were we passed something valid?
-	if ( data == NULL )
-		return( -1 );
-
-	// Open file for write
-	FILE * fp;
-	if ( !( fp = fopen( filename, "wb" ) ) ) {
-		fprintf( stderr, ":: ERROR: Cannot create file \"%s\"\n", filename );
-		return( -1 );
-	}
-
-	// Write data to file
-	if ( fwrite( data, sizeof( unsigned char ), filesize, fp ) != filesize ) {
-		fprintf( stderr, ":: ERROR: writing %s, file may be corrupted.\n", filename );
-		fclose( fp );
-		return( -1 );
-	}
-
-	// Cleanup and return
-	fclose( fp );
-	return( 0 );
-
-}
-
-char* das_ts_to_str( long long ts ) {
+char* das_ts_to_str( long long ts, char* buf, size_t size ) {
 
+	// Same format as asctime, but into the callers buffer
+	static const char days[7][4] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+	static const char months[12][4] = {
+		"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+		"Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+	};
 	time_t rawtime = ts - ( 2440588LL * 24 * 60 * 60 );
-	struct tm* timeinfo = gmtime( &rawtime );
-	return( asctime( timeinfo ) );
+	struct tm timeinfo;
+#ifdef _WIN32
+	if ( gmtime_s( &timeinfo, &rawtime ) != 0 ) {
+#else
+	if ( gmtime_r( &rawtime, &timeinfo ) == NULL ) {
+#endif
+		snprintf( buf, size, "(invalid)\n" );
+		return( buf );
+	}
+	snprintf( buf, size, "%.3s %.3s%3d %.2d:%.2d:%.2d %d\n",
+		days[timeinfo.tm_wday], months[timeinfo.tm_mon], timeinfo.tm_mday,
+		timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec,
+		timeinfo.tm_year + 1900 );
+	return( buf );
 
 }
 
-char* das_pt_to_str( float play_time ) {
+char* das_pt_to_str( float play_time, char* buf, size_t size ) {
 
-	static char buf[64];
 	int seconds = (int)play_time % 60;
 	int minutes = ( (int)play_time / 60 ) % 60;
 	int hours = (int)play_time / 3600;
-	snprintf( buf, 64, "%d:%.2d:%.2d", hours, minutes, seconds );
+	snprintf( buf, size, "%d:%.2d:%.2d", hours, minutes, seconds );
 	return( buf );
 
 }
 
-struct header das_read_header( unsigned char* data ) {
-
-	// Initialize struct
-	struct header header = {
-		.size            = 0,
-		.data_size       = 0,
-		.checksum        = 0,
-		.item_count      = 0,
-		.player_name     = "",
-		.player_race     = "",
-		.player_gender   = "",
-		.total_play_time = 0,
-		.player_id       = "",
-		.player_class    = "",
-		.player_level    = 0,
-		.player_pos      = "",
-		.area_id         = "",
-		.player_location = "",
-		.thumbnail       = "",
-		.assets          = "",
-		.timestamp       = 0,
-		.build_number    = "",
-		.patch_number    = 0,
-		.addon_count     = 0,
-		.data_checksum   = 0
-	};
-
-	// Vars
-	int i = 0, d = 0, ind = 0, offset = 0;
-
-	// Start reading file and printing info.
-	// Check first 10 bytes for FBCHUNKS file
-	if (	data[0] != 0x46 ||  // F
-			data[1] != 0x42 ||  // B
-			data[2] != 0x43 ||  // C
-			data[3] != 0x48 ||  // H
-			data[4] != 0x55 ||  // U
-			data[5] != 0x4E ||  // N
-			data[6] != 0x4B ||  // K
-			data[7] != 0x53 ||  // S
-			data[8] != 0x01 ||  // <SOH>
-			data[9] != 0x00 ) { // \0
-		fprintf( stderr, "  ERROR: Not a valid save file.\n" );
-		return( header );
-	}
-	offset += 10;
-
-	// At offset 0xA, 4 bytes, size of header in bytes
-	for ( i = 3; i >= 0; i-- )
-		header.size = ( header.size << 8 ) + data[offset+i];
-	offset += 4;
-
-	// At offset 0xE, 4 bytes, size of data in bytes
-	for ( i = 3; i >= 0; i-- )
-		header.data_size = ( header.data_size << 8 ) + data[offset+i];
-	offset += 4;
-
-	// At offset 0x12, 4 bytes, header checksum
-	for ( i = 3; i >= 0; i-- )
-		header.checksum = ( header.checksum << 8 ) + data[offset+i];
-	offset += 4;
-
-	// We don't care about these 10 bytes, so move on
-	// 46 42 48 45 41 44 45 52 00 01
-	// F  B  H  E  A  D  E  R  \0 SOH
-	offset += 10;
-
-	// At offset 0x20, 4 bytes, number of items to loop (big endian)
-	for ( i = 0; i < 4; i++ )
-		header.item_count = ( header.item_count << 8 ) + data[offset+i];
-	offset += 4;
-
-	// Allocate total item data array
-	unsigned char** item_data =
-		(unsigned char**)malloc( header.item_count * sizeof( unsigned char* ) );
-
-	// At offset 0x24, start loop item_count times
-	// Each item starts with 4 bytes (unknown hash) 2 bytes length, item data
-	for ( i = 0; i < header.item_count; i++ ) {
-		int item_hash = 0;
-		for ( d = 0; d < 4; d++ )
-			item_hash = ( item_hash << 8 ) + data[offset+d];
-		offset += 4;
-		// 2 bytes, items (string) length
-		int item_length = 0;
-		for ( d = 0; d < 2; d++ )
-			item_length = ( item_length << 8 ) + data[offset+d];
-		offset += 2;
-		item_data[i] = ( unsigned char* )malloc( ( item_length + 1 ) * sizeof( unsigned char ) );
-		item_data[i] = ( unsigned char* )memcpy( item_data[i], data + offset, item_length );
-		memset( item_data[i] + item_length, 0, 1 );
-		switch ( item_hash ) {
-			case 0x92796772: // Player Name
-				snprintf( header.player_name, 24, "%s", item_data[i] );
-				break;
-			case 0x926E6FA0: // Race, 0 = human, 1 = elf, 2 = dwarf, 3 = qunari
-				switch ( item_data[i][0] ) {
-					case 0x30:
-						snprintf( header.player_race, 8, "Human" );
-						break;
-					case 0x31:
-						snprintf( header.player_race, 8, "Elf" );
-						break;
-					case 0x32:
-						snprintf( header.player_race, 8, "Dwarf" );
-						break;
-					case 0x33:
-						snprintf( header.player_race, 8, "Qunari" );
-						break;
-					default:
-						snprintf( header.player_race, 8, "Unknown" );
-						break;
-				}
-				break;
-			case 0x06AE718A: // Gender, 0 = male, 1 = female
-				switch ( item_data[i][0] ) {
-					case 0x30:
-						snprintf( header.player_gender, 8, "Male" );
-						break;
-					case 0x31:
-						snprintf( header.player_gender, 8, "Female" );
-						break;
-					default:
-						snprintf( header.player_gender, 8, "Unknown" );
-						break;
-				}
-				break;
-			case 0x979CAD3D: // Total play time in seconds (float)
-				header.total_play_time = atof( (const char*)item_data[i] );
-				break;
-			case 0xB615BDD8: // 128 bit character id
-				snprintf( header.player_id, 64, "%s", item_data[i] );
-				break;
-			case 0xE17097FB: // Class, 1 = warrior, 2 = rogue, 3 = mage
-				switch ( item_data[i][0] ) {
-					case 0x31:
-						snprintf( header.player_class, 16, "Warrior" );
-						break;
-					case 0x32:
-						snprintf( header.player_class, 16, "Rogue" );
-						break;
-					case 0x33:
-						snprintf( header.player_class, 16, "Mage" );
-						break;
-					default:
-						snprintf( header.player_class, 16, "Unknown" );
-						break;
-				}
-				break;
-			case 0xE1CA2F03: // Level
-				header.player_level = atoi( (const char*)item_data[i] );
-				break;
-			case 0xA521BDF0: // Position in world
-				snprintf( header.player_pos, 32, "%s", item_data[i] );
-				break;
-			case 0x5F500F34: //  This may be some location code (area id)
-				snprintf( header.area_id, 16, "%s", item_data[i] );
-				break;
-			case 0x2F852FB8: // Location
-				snprintf( header.player_location, 64, "%s", item_data[i] );
-				break;
-			case 0xB3991F9F: // Save thumbnail image
-				snprintf( header.thumbnail, 64, "%s", item_data[i] );
-				break;
-			case 0x9A832D89: // Map assets
-				snprintf( header.assets, 128, "%s", item_data[i] );
-				break;
-			case 0x39AA8AB0: // Time of save
-				header.timestamp = atoll( (const char*)item_data[i] );
-				break;
-			case 0x8509F5B0: // Game exe build number (version.json)
-				snprintf( header.build_number, 16, "%s", item_data[i] );
-				break;
-			case 0x0346EAF1: // Patch level
-				header.patch_number = atoi( (const char*)item_data[i] );
-				break;
-			case 0x4D86FB47: // Loaded addons with ~ as seperator
-				ind = 0;
-				for ( d = 0; d < item_length - 1; d++ ) {
-					if ( item_data[i][d] == 0x7E ) {
-						header.addon_count++;
-						header.addons[header.addon_count][ind] = '\0';
-						ind = 0;
-					} else {
-						header.addons[header.addon_count][ind] = item_data[i][d];
-						ind++;
-					}
-				}
-				break;
-			default: // Something I don't know
-				break;
-		}
-		offset += item_length;
-	}
-
-	// At current offset, 4 bytes,
-	for ( i = 3; i >= 0; i-- )
-		header.data_checksum = ( header.data_checksum << 8 ) + data[offset+i];
-
-	// Cleanup and return
-	for ( i = 0; i < header.item_count; i++ )
-		free( item_data[i] );
-	free( item_data );
-	return( header );
-
-}
-
-const char* das_str_lookup( int index ) {
-
-	if ( index < 0 || index > 53 )
-		return( NULL );
-
-	static const char lookup[54][32] = {
-		"EYELINER_INTENSITY",      // 00
-		"EYELINER COLOR RED",      // 01
-		"EYELINER COLOR GREEN",    // 02
-		"EYELINER COLOR BLUE",     // 03
-		"EYE SHADOW INTENSITY",    // 04
-		"EYE SHADOW COLOR RED",    // 05
-		"EYE SHADOW COLOR GREEN",  // 06
-		"EYE SHADOW COLOR BLUE",   // 07
-		"UNDER-EYE COLOR RED",     // 08
-		"UNDER-EYE COLOR GREEN",   // 09
-		"UNDER-EYE COLOR BLUE",    // 10
-		"BLUSH INTENSITY",         // 11
-		"BLUSH COLOR RED",         // 12
-		"BLUSH COLOR GREEN",       // 13
-		"BLUSH COLOR BLUE",        // 14
-		"LIP SHINE",               // 15
-		"LIP INTENSITY",           // 16
-		"LIP COLOR RED",           // 17
-		"LIP COLOR GREEN",         // 18
-		"LIP COLOR BLUE",          // 19
-		"LIP LINER COLOR RED",     // 20
-		"LIP LINER COLOR GREEN",   // 21
-		"LIP LINER COLOR BLUE",    // 22
-		"UNDER-BROW INTENSITY",    // 23
-		"UNDER-BROW COLOR RED",    // 24
-		"UNDER-BROW COLOR GREEN",  // 25
-		"UNDER-BROW COLOR BLUE",   // 26
-		"EYEBROW COLOR RED",       // 27
-		"EYEBROW COLOR GREEN",     // 28
-		"EYEBROW COLOR BLUE",      // 29
-		"EYELASH COLOR RED",       // 30
-		"EYELASH COLOR GREEN",     // 31
-		"EYELASH COLOR BLUE",      // 32
-		"HAIR COLOR RED",          // 33
-		"HAIR COLOR GREEN",        // 34
-		"HAIR COLOR BLUE",         // 35
-		"HAIR SPEC1 COLOR RED",    // 36
-		"HAIR SPEC1 COLOR GREEN",  // 37
-		"HAIR SPEC1 COLOR BLUE",   // 38
-		"HAIR SPEC2 COLOR RED",    // 39
-		"HAIR SPEC2 COLOR GREEN",  // 40
-		"HAIR SPEC2 COLOR BLUE",   // 41
-		"SCALP HAIR COLOR RED",    // 42
-		"SCALP HAIR COLOR GREEN",  // 43
-		"SCALP HAIR COLOR BLUE",   // 44
-		"FACIAL HAIR COLOR RED",   // 45
-		"FACIAL HAIR COLOR GREEN", // 46
-		"FACIAL HAIR COLOR BLUE",  // 47
-		"INNER IRIS COLOR RED",    // 48
-		"INNER IRIS COLOR GREEN",  // 49
-		"INNER IRIS COLOR BLUE",   // 50
-		"OUTER IRIS COLOR RED",    // 51
-		"OUTER IRIS COLOR GREEN",  // 52
-		"OUTER IRIS COLOR BLUE"    // 53
-	};
-
-	return( lookup[index] );
-
-}
-
-int das_rw_values( unsigned char* data, int filesize, int setting ) {
-
-	// Variables
-	int offset = 0, hash = 0, shift_count = -1, d = 0, i = 0;
-	unsigned char tbit = 0;
-
-	// First, shift the data, or return if we can't find anything.
-	// 5 byte str we are looking for
-	unsigned char xmlstr[5] = { 0x3C, 0x3F, 0x78, 0x6D, 0x6C };
+int das_rw_values( struct das_file* file, int setting ) {
 
-	// Bit shift the file until the find a readable XML file
-	// Loop 7 times, 1 bit shift to the right at a time
-	for ( d = 0; d < 8; d++ ) {
-		// Scan 5 bytes at a time for "<?xml" until end of file
-		for ( i = 0; i < filesize - 5; i++ )
-			if ( memcmp( data + i, xmlstr, 5 ) == 0 )
-				shift_count = d;
-		if ( shift_count != -1 )
-			break;
-		// Shift file 1 bit to the right
-		tbit = ( data[0] >> 1 ) | ( data[filesize-1] << 7 );
-		for ( i = filesize - 1; i > 0; i-- )
-			data[i] = ( data[i] >> 1 ) | ( data[i-1] << 7 );
-		data[0] = tbit;
-	}
-
-	// Shift should be set at this point
-	if ( shift_count == -1 ) {
-		fprintf( stderr, ":: ERROR: Could not find face data in file.\n" );
-		return( -1 );
-	}
-
-	// Initalize structs that hold the data
-	int num_values = 0;
-	for ( i = 0; das_str_lookup( i ) != NULL; i++ )
-		num_values++;
-	if ( num_values <= 0 ) { // this shouldnt be possible
-		fprintf( stderr, ":: ERROR: No values in lookup table.\n" );
+	// Find the values, or return if we can't find anything.
+	int num_values = DAS_NUM_VALUES, i = 0;
+	struct handle value[DAS_NUM_VALUES];
+	struct das_view view;
+	if ( das_find_values( file, value, &view ) == -1 )
 		return( -1 );
-	}
-	struct handle value[num_values];
-	for ( i = 0; i < num_values; i++ ) {
-		value[i].hash   = 0;
-		value[i].offset = -1;
-		value[i].fp_val = 0;
-		value[i].min    = 0;
-		value[i].max    = 0;
-		snprintf( value[i].name, 32, "%s", das_str_lookup( i ) );
-	}
-
-	// Search for values and store location & value
-	for ( offset = 4; offset < filesize - 4; offset++ ) {
-		// Break the loop if the xml file starts
-		// We need to do this because custom Hawkes
-		if ( memcmp( data + offset, xmlstr, 5 ) == 0 )
-			break;
-		// Set 4 bytes as hash
-		for ( i = 0; i < 4; i++ )
-			hash = ( hash << 8 ) + data[offset+i];
-		switch ( hash ) {
-			case 0x4560EB1D:
-				// Eyeliner Intensity
-				value[0] = das_set_struct( data, value[0].name, offset+=4, 0.0f, 1.0f );
-				// Eye Shadow Intensity
-				value[4] = das_set_struct( data, value[4].name, offset+=4, 0.0f, 1.0f );
-				// Blush Intensity
-				value[11] = das_set_struct( data, value[11].name, offset+=4, 0.0f, 1.0f );
-				// Lip Intensity
-				value[16] = das_set_struct( data, value[16].name, offset+=4, 0.0f, 1.0f );
-				break;
-			case 0xB4E2B58B:
-				// Lip Shine
-				value[15] = das_set_struct( data, value[15].name, offset+=8, 0.0f, 1.0f );
-				// Under-Brow Intensity
-				value[23] = das_set_struct( data, value[23].name, offset+=8, 0.0f, 1.0f );
-				break;
-			case 0x982C9069:
-				// Eyebrow Color RED
-				value[27] = das_set_struct( data, value[27].name, offset+=4, 0.0f, 1.0f );
-				// Eyebrow Color GREEN
-				value[28] = das_set_struct( data, value[28].name, offset+=4, 0.0f, 1.0f );
-				// Eyebrow Color BLUE
-				value[29] = das_set_struct( data, value[29].name, offset+=4, 0.0f, 1.0f );
-				break;
-			case 0x5923F86C:
-				// Blush Color RED
-				value[12] = das_set_struct( data, value[12].name, offset+=4, 0.0f, 1.0f );
-				// Blush Color GREEN
-				value[13] = das_set_struct( data, value[13].name, offset+=4, 0.0f, 1.0f );
-				// Blush Color BLUE
-				value[14] = das_set_struct( data, value[14].name, offset+=4, 0.0f, 1.0f );
-				break;
-			case 0x27E256DA:
-				// Eyeliner Color RED
-				value[1] = das_set_struct( data, value[1].name, offset+=4, 0.0f, 1.0f );
-				// Eyeliner Color GREEN
-				value[2] = das_set_struct( data, value[2].name, offset+=4, 0.0f, 1.0f );
-				// Eyeliner Color BLUE
-				value[3] = das_set_struct( data, value[3].name, offset+=4, 0.0f, 1.0f );
-				break;
-			case 0xCBF6A094:
-				// Under-Eye Color RED
-				value[8] = das_set_struct( data, value[8].name, offset+=4, 0.0f, 1.0f );
-				// Under-Eye Color GREEN
-				value[9] = das_set_struct( data, value[9].name, offset+=4, 0.0f, 1.0f );
-				// Under-Eye Color BLUE
-				value[10] = das_set_struct( data, value[10].name, offset+=4, 0.0f, 1.0f );
-				break;
-			case 0xCBF6A097:
-				// Eye Shadow Color RED
-				value[5] = das_set_struct( data, value[5].name, offset+=4, 0.0f, 1.0f );
-				// Eye Shadow Color GREEN
-				value[6] = das_set_struct( data, value[6].name, offset+=4, 0.0f, 1.0f );
-				// Eye Shadow Color BLUE
-				value[7] = das_set_struct( data, value[7].name, offset+=4, 0.0f, 1.0f );
-				break;
-			case 0x181A7B16:
-				// Lip Liner Color RED
-				value[20] = das_set_struct( data, value[20].name, offset+=4, 0.0f, 1.0f );
-				// Lip Liner Color GREEN
-				value[21] = das_set_struct( data, value[21].name, offset+=4, 0.0f, 1.0f );
-				// Lip Liner Color BLUE
-				value[22] = das_set_struct( data, value[22].name, offset+=4, 0.0f, 1.0f );
-				break;
-			case 0x3C775B99:
-				// Lip Color RED
-				value[17] = das_set_struct( data, value[17].name, offset+=4, 0.0f, 1.0f );
-				// Lip Color GREEN
-				value[18] = das_set_struct( data, value[18].name, offset+=4, 0.0f, 1.0f );
-				// Lip Color BLUE
-				value[19] = das_set_struct( data, value[19].name, offset+=4, 0.0f, 1.0f );
-				break;
-			case 0x319BF572:
-				// Scalp Color RED
-				value[42] = das_set_struct( data, value[42].name, offset+=4, 0.0f, 1.0f );
-				// Scalp Color GREEN
-				value[43] = das_set_struct( data, value[43].name, offset+=4, 0.0f, 1.0f );
-				// Scalp Color BLUE
-				value[44] = das_set_struct( data, value[44].name, offset+=4, 0.0f, 1.0f );
-				break;
-			case 0x99631BDF:
-				// Under-Brow Color RED
-				value[24] = das_set_struct( data, value[24].name, offset+=4, 0.0f, 1.0f );
-				// Under-Brow Color GREEN
-				value[25] = das_set_struct( data, value[25].name, offset+=4, 0.0f, 1.0f );
-				// Under-Brow Color BLUE
-				value[26] = das_set_struct( data, value[26].name, offset+=4, 0.0f, 1.0f );
-				break;
-			case 0x860AD2A3:
-				// Facial Hair Color RED
-				value[45] = das_set_struct( data, value[45].name, offset+=4, 0.0f, 1.0f );
-				// Facial Hair Color GREEN
-				value[46] = das_set_struct( data, value[46].name, offset+=4, 0.0f, 1.0f );
-				// Facial Hair Color BLUE
-				value[47] = das_set_struct( data, value[47].name, offset+=4, 0.0f, 1.0f );
-				break;
-			case 0x3BD3FFDC:
-				// Inner Iris Color RED
-				value[48] = das_set_struct( data, value[48].name, offset+=4, 0.0f, 1.0f );
-				// Inner Iris Color GREEN
-				value[49] = das_set_struct( data, value[49].name, offset+=4, 0.0f, 1.0f );
-				// Inner Iris Color BLUE
-				value[50] = das_set_struct( data, value[50].name, offset+=4, 0.0f, 1.0f );
-				break;
-			case 0x75D44C82:
-				// Outer Iris Color RED
-				value[51] = das_set_struct( data, value[51].name, offset+=4, 0.0f, 1.0f );
-				// Outer Iris Color GREEN
-				value[52] = das_set_struct( data, value[52].name, offset+=4, 0.0f, 1.0f );
-				// Outer Iris Color BLUE
-				value[53] = das_set_struct( data, value[53].name, offset+=4, 0.0f, 1.0f );
-				break;
-			case 0x0C2A5CEE:
-				// Eyelash Color RED
-				value[30] = das_set_struct( data, value[30].name, offset+=4, 0.0f, 1.0f );
-				// Eyelash Color GREEN
-				value[31] = das_set_struct( data, value[31].name, offset+=4, 0.0f, 1.0f );
-				// Eyelash Color BLUE
-				value[32] = das_set_struct( data, value[32].name, offset+=4, 0.0f, 1.0f );
-				break;
-			case 0x6B2444AA:
-				// Hair Color RED
-				value[33] = das_set_struct( data, value[33].name, offset+=4, 0.0f, 1.0f );
-				// Hair Color GREEN
-				value[34] = das_set_struct( data, value[34].name, offset+=4, 0.0f, 1.0f );
-				// Hair Color BLUE
-				value[35] = das_set_struct( data, value[35].name, offset+=4, 0.0f, 1.0f );
-				break;
-			case 0x4BFD7239:
-				// Hair Spec1 Color RED
-				value[36] = das_set_struct( data, value[36].name, offset+=4, 0.0f, 1.0f );
-				// Hair Spec1 Color GREEN
-				value[37] = das_set_struct( data, value[37].name, offset+=4, 0.0f, 1.0f );
-				// Hair Spec1 Color BLUE
-				value[38] = das_set_struct( data, value[38].name, offset+=4, 0.0f, 1.0f );
-				break;
-			case 0xF63C0CBA:
-				// Hair Spec2 Color RED
-				value[39] = das_set_struct( data, value[39].name, offset+=4, 0.0f, 1.0f );
-				// Hair Spec2 Color GREEN
-				value[40] = das_set_struct( data, value[40].name, offset+=4, 0.0f, 1.0f );
-				// Hair Spec2 Color BLUE
-				value[41] = das_set_struct( data, value[41].name, offset+=4, 0.0f, 1.0f );
-				break;
-			default:
-				break;
-		}
-	}
 
 	// Do something with the data
 	char out_fn[1024] = {0};
@@ -867,26 +688,21 @@ int das_rw_values( unsigned char* data, int filesize, int setting ) {
 					out_fn[i+7] = 'E';
 					out_fn[i+8] = 0;
 				}
-			das_import_file_write( out_fn, value, num_values, data );
+			das_import_file_write( out_fn, value, num_values, &view );
 			break;
 		case 3: // Get user input and fill values
 			for( i = 0; i < num_values; i++ )
-				das_manual_write( value[i], data );
+				das_manual_write( value[i], &view );
 			break;
 		default:
 			break;
 	}
 
-	// Shift bits back to original and return
-	tbit = ( data[filesize - 1] << shift_count ) | ( data[0] >> ( 8 - shift_count ) );
-	for ( i = 0; i < filesize - 1; i++ )
-		data[i] = ( data[i] << shift_count ) | ( data[i+1] >> ( 8 - shift_count ) );
-	data[filesize - 1] = tbit;
 	return( 0 );
 
 }
 
-int das_manual_write( struct handle hb, unsigned char* data ) {
+int das_manual_write( struct handle hb, struct das_view* view ) {
 
 	// If value wasn't found, offset should be -1
 	if ( hb.offset == -1 )
@@ -904,7 +720,7 @@ int das_manual_write( struct handle hb, unsigned char* data ) {
 			hb.fp_val = hb.min;
 		else if ( hb.fp_val > hb.max )
 			hb.fp_val = hb.max;
-		memcpy( &data[hb.offset], &hb.fp_val, 4 * sizeof( unsigned char ) );
+		das_view_write_f32( view, hb.offset, hb.fp_val );
 		printf( "::    Changed to %f.\n", hb.fp_val );
 	}
 
@@ -916,36 +732,6 @@ int das_manual_write( struct handle hb, unsigned char* data ) {
 
 }
 
-struct handle
-das_set_struct(	unsigned char* data, const char title[32], int ioffset, float imin, float imax ) {
-
-	// Initialize struct with in values
-	struct handle hb = {
-		.hash = 0,
-		.offset = ioffset,
-		.fp_val = 0,
-		.min = imin,
-		.max = imax,
-		.name = "(NULL)"
-	};
-
-	// Set title
-	snprintf( hb.name, 32, "%s", title );
-
-	// Set hash and float value
-	int i = 0;
-	unsigned char tbytes[4] = { 0, 0, 0, 0 };
-	for ( i = 0; i < 4; i++ ) {
-		hb.hash = ( hb.hash << 8 ) + data[hb.offset+i];
-		tbytes[i] = data[hb.offset+i];
-	}
-	memcpy( &hb.fp_val, &tbytes, sizeof( float ) );
-
-	// Return the new struct
-	return( hb );
-
-}
-
 int das_file_export( const char* filename, struct handle* value, int num_values ) {
 
 	// Were we passed something valid?
@@ -953,86 +739,60 @@ int das_file_export( const char* filename, struct handle* value, int num_values
 		return( -1 );
 
 	// Open file for write
+	double start = das_stats_start();
 	FILE * fp;
 	if ( !( fp = fopen( filename, "wb" ) ) ) {
 		fprintf( stderr, ":: ERROR: Cannot create file \"%s\"\n", filename );
 		return( -1 );
 	}
 
-	// Write header, 12 bytes (12)
-	unsigned char header[12] = { 'D', 'A', 'S', 'F', 'A', 'C', 'E', 'D', 'A', 'T', 'A', 0x0A };
-	fwrite( header, sizeof( unsigned char ), 12, fp );
-
-	// 4 bytes, number of values (5)
-	unsigned char tbytes[4] = { 0, 0, 0, 0 };
-	memcpy( &tbytes, &num_values, sizeof( unsigned char ) * 4 );
-	fwrite( tbytes, sizeof( unsigned char ), 4, fp );
-	fputc( 0x0A, fp );
-
-	// Start of data (9*num_values)
+	// Only fields found in the save are written, keyed by their anchor
+	struct das_face_head head = { .magic = DAS_FACE_MAGIC, .version = DAS_FACE_VERSION,
+		.record_size = sizeof( struct das_face_rec ), .count = 0, .present = { 0, 0 } };
+	struct das_face_rec rec[DAS_NUM_VALUES];
 	int i = 0;
-	for ( i = 0; i < num_values; i++ ) {
-		// 4 bytes index
-		memcpy( &tbytes, &i, sizeof( unsigned char ) * 4 );
-		fwrite( tbytes, sizeof( unsigned char ), 4, fp );
-		// 4 bytes value
-		memcpy( &tbytes, &value[i].fp_val, sizeof( unsigned char ) * 4 );
-		fwrite( tbytes, sizeof( unsigned char ), 4, fp );
-		// Seperator
-		fputc( 0x0A, fp );
+	for ( i = 0; i < num_values && i < DAS_NUM_VALUES; i++ ) {
+		if ( value[i].offset == -1 )
+			continue;
+		head.present[i / 32] |= 1u << ( i % 32 );
+		rec[head.count].anchor = das_anchors[das_field_anchor( i )].hash;
+		rec[head.count].field = i;
+		rec[head.count].value = value[i].fp_val;
+		head.count++;
 	}
-
-	// Cleanup and return
-	printf( ":: File saved to %s\n", filename );
-	fclose( fp );
-	return( 0 );
-
-}
-
-int das_import_file_write( const char* file, struct handle* hb, int num_values, unsigned char* data ) {
-
-	// Check to see if file exists
-	struct stat sb;
-	if ( stat( file, &sb ) == -1 ) {
-		fprintf( stderr, ":: ERROR: Cannot stat file %s.\n", file );
+	if ( fwrite( &head, sizeof( head ), 1, fp ) != 1 ||
+			fwrite( rec, sizeof( struct das_face_rec ), head.count, fp ) != (size_t)head.count ) {
+		fprintf( stderr, ":: ERROR: Cannot write file \"%s\"\n", filename );
+		fclose( fp );
 		return( -1 );
 	}
-	switch ( sb.st_mode & S_IFMT ) {
-		case S_IFREG:
-			break;
-		default:
-			fprintf( stderr, ":: ERROR: \"%s\" is not a file.\n", file );
-			return( -1 );
-	}
 
-	// Don't proceed if filesize is incorrect
-	if ( sb.st_size != ( num_values * 9 ) + 17 ) {
-		fprintf( stderr, ":: ERROR: File size is off. Not a face data file.\n" );
+	// Cleanup and return
+	if ( !das_quiet )
+		printf( ":: File saved to %s\n", filename );
+	if ( fclose( fp ) != 0 ) {
+		fprintf( stderr, ":: ERROR: Cannot write file \"%s\"\n", filename );
 		return( -1 );
 	}
+	if ( das_stats_cur )
+		das_stats_cur->bytes_written += sizeof( head ) + head.count * sizeof( struct das_face_rec );
+	das_stats_stop( DAS_STAGE_WRITE, start );
+	return( 0 );
 
-	// Read file into a memory buffer
-	unsigned char* facedata = file_to_char( file, NULL );
-	if ( facedata == NULL )
-		return( -1 );
+}
 
-	// Check header of file
-	unsigned char header[12] = { 'D', 'A', 'S', 'F', 'A', 'C', 'E', 'D', 'A', 'T', 'A', 0x0A };
-	if ( memcmp( facedata, header, 12 ) != 0 ) {
-		free( facedata );
-		fprintf( stderr, ":: ERROR: Wrong header data.\n" );
-		return( -1 );
-	}
+int das_import_file_write( const char* file, struct handle* hb, int num_values, struct das_view* view ) {
 
-	// Copy bytes over
-	int foffset = 21, i = 0;
-	for ( i = 0; i < num_values; i++ ) {
-		memcpy( &data[hb[i].offset], &facedata[foffset], 4 * sizeof( unsigned char ) );
-		foffset += 9;
-	}
+	// Resolve every value to its offset in this save, then write them all
+	struct das_face_preset preset;
+	struct das_face_write writes[DAS_NUM_VALUES];
+	if ( num_values != DAS_NUM_VALUES || das_face_load( file, &preset ) == -1 )
+		return( -1 );
+	int count = das_face_resolve( &preset, hb, writes );
+	das_face_apply( view, writes, count );
 
-	printf( ":: Imported data from %s\n", file );
-	free( facedata );
+	if ( !das_quiet )
+		printf( ":: Imported %d values from %s\n", count, file );
 	return 0;
 
 }
@@ -1043,106 +803,3909 @@ int xml_mem_to_file( unsigned char* xmldata, int size, const char* filename ) {
 	if ( xmldata == NULL )
 		return( -1 );
 
-	// Open file for write
-	FILE * fp;
-	if ( !( fp = fopen( filename, "wb" ) ) ) {
-		fprintf( stderr, "  ERROR: Cannot create file \"%s\"\n", filename );
+	// Open file for write, newline after every '>'
+	struct das_xml_out* out = (struct das_xml_out*)malloc( sizeof( struct das_xml_out ) );
+	int ret = -1;
+	if ( out == NULL ) {
+		fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
 		return( -1 );
 	}
-
-	// Write data to file
-	int i = 0;
-	for ( i = 0; i < size; i++ ) {
-		fputc( xmldata[i], fp );
-		if ( xmldata[i] == '>' )
-			fputc( '\n', fp );
+	if ( das_xml_open( out, filename, DAS_XML_NEWLINE ) == 0 ) {
+		das_xml_put( out, xmldata, size );
+		ret = das_xml_close( out );
 	}
 
 	// Cleanup and return
-	fclose( fp );
-	return( 0 );
+	free( out );
+	return( ret );
 
 }
 
-int das_dump_xmls( unsigned char* data, int filesize ) {
+int das_batch_command( const char* name ) {
 
-	// Variables
-	unsigned char xmlstr[5] = { 0x3C, 0x3F, 0x78, 0x6D, 0x6C };
-	int shift_count = 0, xml_count = 0, i = 0, d = 0;
-	struct xml_file xml = {
-		.size = NULL, .offset = NULL, .shift_amount = NULL, .data = NULL
-	};
+	if ( strcmp( name, "export-face" ) == 0 )
+		return( DAS_CMD_EXPORT_FACE );
+	if ( strcmp( name, "import-face" ) == 0 )
+		return( DAS_CMD_IMPORT_FACE );
+	if ( strcmp( name, "set-face" ) == 0 )
+		return( DAS_CMD_SET_FACE );
+	if ( strcmp( name, "dump-xml" ) == 0 )
+		return( DAS_CMD_DUMP_XML );
+	if ( strcmp( name, "scan" ) == 0 )
+		return( DAS_CMD_SCAN );
+	if ( strcmp( name, "info" ) == 0 )
+		return( DAS_CMD_INFO );
+	if ( strcmp( name, "index" ) == 0 )
+		return( DAS_CMD_INDEX );
+	if ( strcmp( name, "list" ) == 0 )
+		return( DAS_CMD_LIST );
+	if ( strcmp( name, "verify" ) == 0 )
+		return( DAS_CMD_VERIFY );
+	if ( strcmp( name, "xml-get" ) == 0 )
+		return( DAS_CMD_XML_GET );
+	if ( strcmp( name, "xml-set" ) == 0 )
+		return( DAS_CMD_XML_SET );
+	if ( strcmp( name, "complexion" ) == 0 )
+		return( DAS_CMD_COMPLEXION );
+	if ( strcmp( name, "stamp" ) == 0 )
+		return( DAS_CMD_STAMP );
+	if ( strcmp( name, "undo" ) == 0 )
+		return( DAS_CMD_UNDO );
+	if ( strcmp( name, "diff" ) == 0 )
+		return( DAS_CMD_DIFF );
+	if ( strcmp( name, "archive" ) == 0 )
+		return( DAS_CMD_ARCHIVE );
+	if ( strcmp( name, "restore" ) == 0 )
+		return( DAS_CMD_RESTORE );
+	if ( strcmp( name, "serve" ) == 0 )
+		return( DAS_CMD_SERVE );
+	if ( strcmp( name, "color" ) == 0 )
+		return( DAS_CMD_COLOR );
+	return( DAS_CMD_NONE );
 
-	// Bit shift the file until the find a readable XML file
-	// Loop 7 times, 1 bit shift to the right at a time
-	for ( shift_count = 0; shift_count < 8; shift_count++ ) {
-		// Scan 5 bytes at a time for "<?xml" until end of file
-		for ( i = 0; i < filesize - 5; i++ ) {
-			// We found an xml (probably)
-			if ( memcmp( data + i, xmlstr, 5 ) == 0 ) {
-				xml_count++;
-				// Dynamically allocate memory
-				xml.size =
-					(int*)realloc( xml.size, xml_count * sizeof( int ) );
-				xml.offset =
-					(int*)realloc( xml.offset, xml_count * sizeof( int ) );
-				xml.shift_amount =
-					(int*)realloc( xml.shift_amount, xml_count * sizeof( int ) );
-				xml.data =
-					(unsigned char**)realloc( xml.data, xml_count * sizeof( unsigned char* ) );
-				// Initalize values
-				xml.size[xml_count-1] = 0;
-				xml.offset[xml_count-1] = i;
-				xml.shift_amount[xml_count-1] = shift_count;
-				xml.data[xml_count-1] = NULL;
-				// Get size of the xml from the 4 preceeding bytes (offset-4)
-				for ( d = 0; d < 4; d++ )
-					xml.size[xml_count-1] =
-						( xml.size[xml_count-1] << 8 ) + data[xml.offset[xml_count-1]+d-4];
-				// Allocate the xml data if its less than 1mb in size
-				if ( xml.size[xml_count-1] <= 1000000 ) {
-					xml.data[xml_count-1] =
-						(unsigned char*)realloc( xml.data[xml_count-1],
-							xml.size[xml_count-1] * sizeof( unsigned char ) );
-					memcpy( xml.data[xml_count-1],
-						data + xml.offset[xml_count-1],
-						xml.size[xml_count-1] );
-				}
-				printf( "::  Found XML at %.8X (>>%.2d). Written to \"xml_file%.2d.xml\"\n",
-					xml.offset[xml_count-1],
-					xml.shift_amount[xml_count-1],
-					xml_count );
-			}
-		}
-		// Shift file 1 bit to the right
-		unsigned char tbit = ( data[0] >> 1 ) | ( data[filesize-1] << 7 );
-		for ( i = filesize - 1; i > 0; i-- )
-			data[i] = ( data[i] >> 1 ) | ( data[i-1] << 7 );
-		data[0] = tbit;
+}
+
+void das_batch_usage( void ) {
+
+	fprintf( stderr, "::  USAGE: ./das_editor <filename>.DAS\n" );
+	fprintf( stderr, "::         ./das_editor export-face [--db INDEX] [--out DIR] FILES...\n" );
+	fprintf( stderr, "::         ./das_editor import-face PRESET.DASFACE [--fix-checksums] [--db INDEX] [--out DIR] FILES...\n" );
+	fprintf( stderr, "::         ./das_editor set-face --set INDEX=VALUE [--set ...] [--fix-checksums] [--db INDEX] [--out DIR] FILES...\n" );
+	fprintf( stderr, "::         ./das_editor dump-xml [--xml newline|raw|pretty] [--annotate] [--out DIR] FILES...\n" );
+	fprintf( stderr, "::         ./das_editor scan [--xml newline|raw|pretty] [--annotate] [--db INDEX] [--out DIR] FILES...\n" );
+	fprintf( stderr, "::         ./das_editor info FILES...\n" );
+	fprintf( stderr, "::         ./das_editor index --db INDEX [--verify] FILES...\n" );
+	fprintf( stderr, "::         ./das_editor list --db INDEX\n" );
+	fprintf( stderr, "::         ./das_editor verify FILES...\n" );
+	fprintf( stderr, "::         ./das_editor xml-get QUERY FILES...\n" );
+	fprintf( stderr, "::         ./das_editor xml-set QUERY VALUE [--fix-checksums] [--out DIR] FILES...\n" );
+	fprintf( stderr, "::         ./das_editor complexion FILES...\n" );
+	fprintf( stderr, "::         ./das_editor stamp PRESET.DASFACE [--fix-checksums] [--db INDEX] [--out DIR] FILES...\n" );
+	fprintf( stderr, "::         ./das_editor undo FILES...\n" );
+	fprintf( stderr, "::         ./das_editor diff A.DAS B.DAS [A2.DAS B2.DAS ...]\n" );
+	fprintf( stderr, "::         ./das_editor archive --store DIR FILES...\n" );
+	fprintf( stderr, "::         ./das_editor restore --store DIR [--out DIR] IDS...\n" );
+	fprintf( stderr, "::         ./das_editor serve --socket PATH [--cache N] [-j N]\n" );
+	fprintf( stderr, "::         ./das_editor color --op OP [--op ...] [--only NAMES] [--fix-checksums] [--db INDEX] [--out DIR] FILES...\n" );
+	fprintf( stderr, "::  OP is hue=DEGREES, saturation=F, brightness=F, blend=R,G,B,T, clamp=MIN,MAX,\n" );
+	fprintf( stderr, "::  linear or srgb, NAMES e.g. hair,lip (every color whose name has one of them)\n" );
+	fprintf( stderr, "::  import-face, set-face, xml-set, stamp and color take --in-place to edit\n" );
+	fprintf( stderr, "::  the saves themselves instead of writing .NEW files, undo reverts that.\n" );
+	fprintf( stderr, "::  QUERY is Elem, Parent/Elem or Parent/Elem@attr, e.g. TintDetailWeights@x\n" );
+	fprintf( stderr, "::  All commands take -j N to use N threads (0 = one per cpu), --stats\n" );
+	fprintf( stderr, "::  for a timing report per file on stderr and --stats-json FILE for JSON lines.\n" );
+	fprintf( stderr, "::  A FILES entry of \"-\" reads one path per line from stdin,\n" );
+	fprintf( stderr, "::  a directory adds every *.DAS file under it.\n" );
+
+}
+
+void das_out_path( char* out, size_t size, const char* dir, const char* path, const char* ext ) {
+
+	// Next to the input, or in dir with the inputs base name
+	const char* base = path;
+	const char* p = NULL;
+	if ( dir == NULL ) {
+		snprintf( out, size, "%s%s", path, ext );
+		return;
+	}
+	for ( p = path; *p; p++ )
+		if ( *p == '/' || *p == '\\' )
+			base = p + 1;
+	snprintf( out, size, "%s/%s%s", dir, base, ext );
+
+}
+
+int das_batch_save( const struct das_batch* batch, struct das_file* file, const char* path,
+		char* out, size_t out_size ) {
+
+	// <save>.NEW, or the save itself with an undo journal
+	if ( batch->in_place ) {
+		snprintf( out, out_size, "%s", path );
+		return( das_file_patch( file, path ) );
+	}
+	das_out_path( out, out_size, batch->out_dir, path, ".NEW" );
+	return( das_file_write( file, out ) );
+
+}
+
+int das_batch_set( struct das_batch* batch, const char* arg ) {
+
+	// INDEX=VALUE, index is a number or a name from das_str_lookup
+	const char* eq = strchr( arg, '=' );
+	char name[32] = "";
+	char* end = NULL;
+	int index = -1, i = 0;
+	if ( eq == NULL || eq == arg || eq - arg >= 32 || batch->set_count >= DAS_NUM_VALUES )
+		return( -1 );
+	memcpy( name, arg, eq - arg );
+	name[eq - arg] = '\0';
+	index = (int)strtol( name, &end, 10 );
+	if ( *end != '\0' ) {
+		index = -1;
+		for ( i = 0; das_str_lookup( i ) != NULL; i++ )
+			if ( strcmp( name, das_str_lookup( i ) ) == 0 )
+				index = i;
+	}
+	if ( das_str_lookup( index ) == NULL )
+		return( -1 );
+	batch->set_index[batch->set_count] = index;
+	batch->set_value[batch->set_count] = strtof( eq + 1, &end );
+	if ( end == eq + 1 || *end != '\0' )
+		return( -1 );
+	batch->set_count++;
+	return( 0 );
+
+}
+
+int das_batch_run( const struct das_batch* batch, struct das_file* file, const char* path,
+		char* out, size_t out_size ) {
+
+	// Same checks as the interactive mode
+	if ( file->size > 2000000 || file->size < 100000 ) {
+		fprintf( stderr, ":: ERROR: %s: File size is off. Not a save file.\n", path );
+		return( -1 );
+	}
+	struct header header = das_read_header( file->data, file->size );
+	if ( header.size == 0 ) {
+		fprintf( stderr, ":: ERROR: %s: Cannot read file header.\n", path );
+		return( -1 );
+	}
+
+	int i = 0;
+	struct handle value[DAS_NUM_VALUES];
+	struct das_view view;
+	switch ( batch->command ) {
+		case DAS_CMD_EXPORT_FACE:
+			if ( das_batch_values( batch, file, path, value, &view ) == -1 )
+				return( -1 );
+			das_out_path( out, out_size, batch->out_dir, path, ".DASFACE" );
+			return( das_file_export( out, value, DAS_NUM_VALUES ) );
+		case DAS_CMD_IMPORT_FACE:
+		case DAS_CMD_STAMP: { // The preset was read once in das_batch_main
+			struct das_face_write writes[DAS_NUM_VALUES];
+			if ( das_batch_values( batch, file, path, value, &view ) == -1 )
+				return( -1 );
+			das_face_apply( &view, writes, das_face_resolve( batch->face, value, writes ) );
+			if ( batch->fix_checksums && das_checksum_fix( file ) == -1 )
+				return( -1 );
+			return( das_batch_save( batch, file, path, out, out_size ) );
+		}
+		case DAS_CMD_SET_FACE:
+			if ( das_batch_values( batch, file, path, value, &view ) == -1 )
+				return( -1 );
+			for ( i = 0; i < batch->set_count; i++ ) {
+				struct handle* hb = &value[batch->set_index[i]];
+				float val = batch->set_value[i];
+				if ( hb->offset == -1 ) {
+					fprintf( stderr, ":: ERROR: %s: %s not found in file.\n", path, hb->name );
+					return( -1 );
+				}
+				if ( val < hb->min )
+					val = hb->min;
+				else if ( val > hb->max )
+					val = hb->max;
+				das_view_write_f32( &view, hb->offset, val );
+			}
+			if ( batch->fix_checksums && das_checksum_fix( file ) == -1 )
+				return( -1 );
+			return( das_batch_save( batch, file, path, out, out_size ) );
+		case DAS_CMD_COLOR: // The ops were parsed once in das_batch_main
+			if ( das_batch_values( batch, file, path, value, &view ) == -1 )
+				return( -1 );
+			das_color_apply( batch->color, value, &view );
+			if ( batch->fix_checksums && das_checksum_fix( file ) == -1 )
+				return( -1 );
+			return( das_batch_save( batch, file, path, out, out_size ) );
+		case DAS_CMD_DUMP_XML: { // The status line lists the files written
+			char prefix[4096];
+			das_out_path( prefix, sizeof( prefix ), batch->out_dir, path, "." );
+			return( das_dump_xmls( file->data, file->size, prefix, batch->xml_mode, out, out_size ) == -1 ? -1 : 0 );
+		}
+		case DAS_CMD_SCAN: // Header, face values and xmls in one go
+			if ( das_batch_values( batch, file, path, value, &view ) == -1 )
+				return( -1 );
+			das_out_path( out, out_size, batch->out_dir, path, ".DASFACE" );
+			if ( das_file_export( out, value, DAS_NUM_VALUES ) == -1 )
+				return( -1 );
+			das_out_path( out, out_size, batch->out_dir, path, "." );
+			int xmls = das_dump_xmls( file->data, file->size, out, batch->xml_mode, NULL, 0 );
+			if ( xmls == -1 )
+				return( -1 );
+			char pt_str[64], ts_str[64];
+			das_ts_to_str( header.timestamp, ts_str, 64 );
+			ts_str[strcspn( ts_str, "\n" )] = '\0';
+			snprintf( out, out_size, "%s\t%d\t%s\t%s\t%s\t%s\t%s\t%s\t%d",
+				header.player_name, header.player_level, header.player_race,
+				header.player_gender, header.player_class, header.player_location,
+				das_pt_to_str( header.total_play_time, pt_str, 64 ), ts_str, xmls );
+			return( 0 );
+		case DAS_CMD_XML_GET:
+			return( das_xml_get( file, batch->query, out, out_size ) );
+		case DAS_CMD_COMPLEXION:
+			return( das_complexion_check( file, &header, path, out, out_size ) );
+		case DAS_CMD_XML_SET: {
+			char count[16];
+			if ( das_xml_edit( file, batch->query, batch->value, count, sizeof( count ) ) == -1 )
+				return( -1 );
+			if ( batch->fix_checksums && das_checksum_fix( file ) == -1 )
+				return( -1 );
+			if ( das_batch_save( batch, file, path, out, out_size ) == -1 )
+				return( -1 );
+			size_t len = strlen( out );
+			snprintf( out + len, out_size - len, "\t%s", count );
+			return( 0 );
+		}
+		case DAS_CMD_VERIFY: {
+			unsigned int header_crc = 0, data_crc = 0;
+			if ( das_checksum_compute( file->data, file->size, &header, &header_crc, &data_crc ) == -1 )
+				return( -1 );
+			int header_ok = header_crc == (unsigned int)header.checksum;
+			int data_ok = data_crc == (unsigned int)header.data_checksum;
+			if ( !header_ok )
+				fprintf( stderr, ":: ERROR: %s: Header checksum is %.8X, should be %.8X.\n",
+					path, (unsigned int)header.checksum, header_crc );
+			if ( !data_ok )
+				fprintf( stderr, ":: ERROR: %s: Data checksum is %.8X, should be %.8X.\n",
+					path, (unsigned int)header.data_checksum, data_crc );
+			snprintf( out, out_size, "%.8X\t%.8X", header_crc, data_crc );
+			return( header_ok && data_ok ? 0 : -1 );
+		}
+		default:
+			return( -1 );
+	}
+
+}
+
+int das_batch_file( const struct das_batch* batch, const char* path ) {
+
+	// Edits stay copy on write in the mapping until written out
+	struct das_file file;
+	struct das_stats stats = { .shift = -1 };
+	char out[4096] = "";
+	int ret = -1;
+	int writable = batch->command == DAS_CMD_IMPORT_FACE || batch->command == DAS_CMD_SET_FACE ||
+		batch->command == DAS_CMD_XML_SET || batch->command == DAS_CMD_STAMP ||
+		batch->command == DAS_CMD_COLOR;
+	if ( batch->stats != NULL )
+		das_stats_cur = &stats;
+	if ( batch->command == DAS_CMD_INFO ) {
+		// Header only, into a small fixed buffer
+		unsigned char buf[DAS_HEADER_MAX];
+		struct header header;
+		ret = das_read_header_file( path, &header, buf, sizeof( buf ) );
+		if ( ret == 0 )
+			das_header_format( &header, out, sizeof( out ) );
+	} else if ( batch->command == DAS_CMD_INDEX ) {
+		ret = das_index_file( batch->index, path, batch->verify, out, sizeof( out ) );
+	} else if ( batch->command == DAS_CMD_ARCHIVE ) {
+		ret = das_archive_file( batch->store, path, out, sizeof( out ) );
+	} else if ( batch->command == DAS_CMD_RESTORE ) {
+		ret = das_restore_file( batch->store->dir, path, batch->out_dir, out, sizeof( out ) );
+	} else if ( batch->command == DAS_CMD_UNDO ) {
+		if ( ( ret = das_file_undo( path ) ) == 0 )
+			snprintf( out, sizeof( out ), "restored" );
+	} else if ( das_file_open( &file, path, writable ) == 0 ) {
+		ret = das_batch_run( batch, &file, path, out, sizeof( out ) );
+		das_file_close( &file );
+	}
+
+	// One status line per file
+	printf( "%s\t%s\t%s\n", ret == 0 ? "ok" : "fail", path, ret == 0 ? out : "" );
+	fflush( stdout );
+	if ( batch->stats != NULL ) {
+		das_stats_cur = NULL;
+		das_stats_add( batch->stats, path, ret, &stats );
+	}
+	return( ret );
+
+}
+
+int das_batch_main( int argc, char* argv[] ) {
+
+	struct das_batch batch = {
+		.command   = das_batch_command( argv[1] ),
+		.jobs      = 1,
+		.out_dir   = NULL,
+		.preset    = NULL,
+		.set_count = 0,
+		.db        = NULL,
+		.verify    = 0,
+		.fix_checksums = 0,
+		.xml_mode  = DAS_XML_NEWLINE,
+		.query     = NULL,
+		.value     = NULL,
+		.index     = NULL,
+		.face      = NULL,
+		.in_place  = 0,
+		.store     = NULL,
+		.stats     = NULL,
+		.socket    = NULL,
+		.cache     = 64,
+		.color     = NULL
+	};
+	struct das_color_plan color = { .count = 0, .mask = ( 1u << DAS_NUM_COLORS ) - 1 };
+	int only = 0;
+	struct das_store store = { .dir = NULL };
+	struct das_stats_sum stats = { .text = 0, .json = NULL, .files = 0, .failed = 0 };
+	const char* stats_json = NULL;
+	struct das_face_preset face;
+	struct timespec start, stop;
+	int i = 2, total = 0, failed = 0;
+	das_quiet = 1;
+
+	// import-face and stamp take the preset before any options,
+	// it is read once here and shared by every save
+	if ( batch.command == DAS_CMD_IMPORT_FACE || batch.command == DAS_CMD_STAMP ) {
+		if ( argc < 3 ) {
+			fprintf( stderr, ":: ERROR: No preset specified.\n" );
+			das_batch_usage();
+			return( 2 );
+		}
+		batch.preset = argv[i++];
+		if ( das_face_load( batch.preset, &face ) == -1 )
+			return( EXIT_FAILURE );
+		batch.face = &face;
+	}
+	// xml-get and xml-set take the query (and value) the same way
+	if ( batch.command == DAS_CMD_XML_GET || batch.command == DAS_CMD_XML_SET ) {
+		int need = batch.command == DAS_CMD_XML_SET ? 2 : 1;
+		if ( argc < 2 + need ) {
+			fprintf( stderr, ":: ERROR: No query specified.\n" );
+			das_batch_usage();
+			return( 2 );
+		}
+		batch.query = argv[i++];
+		if ( need == 2 )
+			batch.value = argv[i++];
+	}
+
+	// Options
+	for ( ; i < argc && strncmp( argv[i], "-", 1 ) == 0 && argv[i][1] != '\0'; i++ ) {
+		if ( strcmp( argv[i], "-j" ) == 0 && i + 1 < argc ) {
+			batch.jobs = atoi( argv[++i] );
+		} else if ( strcmp( argv[i], "--" ) == 0 ) {
+			i++;
+			break;
+		} else if ( strcmp( argv[i], "--out" ) == 0 && i + 1 < argc ) {
+			batch.out_dir = argv[++i];
+		} else if ( strcmp( argv[i], "--jobs" ) == 0 && i + 1 < argc ) {
+			batch.jobs = atoi( argv[++i] );
+		} else if ( strcmp( argv[i], "--db" ) == 0 && i + 1 < argc ) {
+			batch.db = argv[++i];
+		} else if ( strcmp( argv[i], "--verify" ) == 0 ) {
+			batch.verify = 1;
+		} else if ( strcmp( argv[i], "--xml" ) == 0 && i + 1 < argc ) {
+			int mode = das_xml_mode( argv[++i] );
+			if ( mode == -1 ) {
+				fprintf( stderr, ":: ERROR: Unknown XML mode \"%s\".\n", argv[i] );
+				return( 2 );
+			}
+			batch.xml_mode = ( batch.xml_mode & DAS_XML_ANNOTATE ) | mode;
+		} else if ( strcmp( argv[i], "--annotate" ) == 0 ) {
+			batch.xml_mode |= DAS_XML_ANNOTATE;
+		} else if ( strcmp( argv[i], "--fix-checksums" ) == 0 ) {
+			batch.fix_checksums = 1;
+		} else if ( strcmp( argv[i], "--store" ) == 0 && i + 1 < argc ) {
+			store.dir = argv[++i];
+		} else if ( strcmp( argv[i], "--in-place" ) == 0 ) {
+			batch.in_place = 1;
+		} else if ( strcmp( argv[i], "--stats" ) == 0 ) {
+			stats.text = 1;
+		} else if ( strcmp( argv[i], "--stats-json" ) == 0 && i + 1 < argc ) {
+			stats_json = argv[++i];
+		} else if ( strcmp( argv[i], "--socket" ) == 0 && i + 1 < argc ) {
+			batch.socket = argv[++i];
+		} else if ( strcmp( argv[i], "--cache" ) == 0 && i + 1 < argc ) {
+			batch.cache = atoi( argv[++i] );
+		} else if ( strcmp( argv[i], "--set" ) == 0 && i + 1 < argc &&
+				batch.command == DAS_CMD_SET_FACE ) {
+			if ( das_batch_set( &batch, argv[++i] ) == -1 ) {
+				fprintf( stderr, ":: ERROR: Bad value \"%s\".\n", argv[i] );
+				return( 2 );
+			}
+		} else if ( strcmp( argv[i], "--op" ) == 0 && i + 1 < argc &&
+				batch.command == DAS_CMD_COLOR ) {
+			if ( das_color_parse( &color, argv[++i] ) == -1 ) {
+				fprintf( stderr, ":: ERROR: Bad color op \"%s\".\n", argv[i] );
+				return( 2 );
+			}
+		} else if ( strcmp( argv[i], "--only" ) == 0 && i + 1 < argc &&
+				batch.command == DAS_CMD_COLOR ) {
+			if ( !only++ )
+				color.mask = 0;
+			if ( das_color_only( &color, argv[++i] ) == -1 ) {
+				fprintf( stderr, ":: ERROR: No color matches \"%s\".\n", argv[i] );
+				return( 2 );
+			}
+		} else {
+			fprintf( stderr, ":: ERROR: Unknown option \"%s\".\n", argv[i] );
+			das_batch_usage();
+			return( 2 );
+		}
+	}
+	if ( batch.in_place && batch.out_dir != NULL ) {
+		fprintf( stderr, ":: ERROR: --in-place and --out don't go together.\n" );
+		return( 2 );
+	}
+	if ( batch.command == DAS_CMD_SET_FACE && batch.set_count == 0 ) {
+		fprintf( stderr, ":: ERROR: Nothing to set.\n" );
+		das_batch_usage();
+		return( 2 );
+	}
+	if ( batch.command == DAS_CMD_COLOR ) {
+		if ( color.count == 0 ) {
+			fprintf( stderr, ":: ERROR: No color op specified.\n" );
+			das_batch_usage();
+			return( 2 );
+		}
+		batch.color = &color;
+	}
+	if ( ( batch.command == DAS_CMD_INDEX || batch.command == DAS_CMD_LIST ) && batch.db == NULL ) {
+		fprintf( stderr, ":: ERROR: No index specified.\n" );
+		das_batch_usage();
+		return( 2 );
+	}
+	if ( ( batch.command == DAS_CMD_ARCHIVE || batch.command == DAS_CMD_RESTORE ) && store.dir == NULL ) {
+		fprintf( stderr, ":: ERROR: No store specified.\n" );
+		das_batch_usage();
+		return( 2 );
+	}
+	if ( store.dir != NULL ) {
+		pthread_mutex_init( &store.lock, NULL );
+		batch.store = &store;
+	}
+	if ( batch.command == DAS_CMD_LIST )
+		return( das_index_list( batch.db ) == -1 ? EXIT_FAILURE : EXIT_SUCCESS );
+	if ( stats_json != NULL && ( stats.json = fopen( stats_json, "w" ) ) == NULL ) {
+		fprintf( stderr, ":: ERROR: Cannot create file \"%s\"\n", stats_json );
+		return( EXIT_FAILURE );
+	}
+	if ( stats.text || stats.json != NULL ) {
+		stats.total.shift = -1;
+		pthread_mutex_init( &stats.lock, NULL );
+		batch.stats = &stats;
+	}
+	if ( batch.command == DAS_CMD_DIFF )
+		return( das_diff_main( argc - i, argv + i ) );
+	if ( batch.command == DAS_CMD_SERVE ) {
+		if ( batch.socket == NULL || batch.cache < 1 ) {
+			fprintf( stderr, ":: ERROR: serve needs --socket PATH and a --cache of at least 1.\n" );
+			das_batch_usage();
+			return( 2 );
+		}
+		return( das_serve( &batch ) == -1 ? EXIT_FAILURE : EXIT_SUCCESS );
+	}
+	if ( i >= argc ) {
+		fprintf( stderr, ":: ERROR: No file specified.\n" );
+		das_batch_usage();
+		return( 2 );
+	}
+
+	// --out is made once here instead of every file failing on it
+	if ( batch.out_dir != NULL && das_mkdir( batch.out_dir ) == -1 )
+		return( EXIT_FAILURE );
+
+	// Files from argv, "-" reads the list from stdin, directories are walked
+	struct das_paths paths = { .path = NULL, .count = 0, .alloc = 0 };
+	for ( ; i < argc; i++ ) {
+		struct stat sb;
+		if ( strcmp( argv[i], "-" ) == 0 ) {
+			char line[4096];
+			while ( fgets( line, sizeof( line ), stdin ) != NULL ) {
+				line[strcspn( line, "\r\n" )] = '\0';
+				if ( line[0] != '\0' && das_paths_add( &paths, line ) == -1 )
+					break;
+			}
+		} else if ( stat( argv[i], &sb ) == 0 && S_ISDIR( sb.st_mode ) ) {
+			das_paths_walk( &paths, argv[i] );
+		} else {
+			das_paths_add( &paths, argv[i] );
+		}
+	}
+	total = paths.count;
+
+	// The old index is read while the new one is collected. The face
+	// value commands only read it, for the offsets of unchanged saves
+	struct das_index index;
+	if ( batch.command == DAS_CMD_INDEX || ( batch.db != NULL && (
+			batch.command == DAS_CMD_EXPORT_FACE || batch.command == DAS_CMD_IMPORT_FACE ||
+			batch.command == DAS_CMD_SET_FACE || batch.command == DAS_CMD_SCAN ||
+			batch.command == DAS_CMD_STAMP || batch.command == DAS_CMD_COLOR ) ) ) {
+		if ( das_index_load( &index, batch.db ) == -1 ) {
+			das_paths_free( &paths );
+			return( EXIT_FAILURE );
+		}
+		batch.index = &index;
+	}
+
+	// One thread keeps the input order, more go through the pool
+	if ( batch.jobs == 0 ) {
+#ifdef _SC_NPROCESSORS_ONLN
+		batch.jobs = (int)sysconf( _SC_NPROCESSORS_ONLN );
+#else
+		batch.jobs = 1;
+#endif
+	}
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	if ( batch.jobs <= 1 ) {
+		for ( i = 0; i < paths.count; i++ )
+			if ( das_batch_file( &batch, paths.path[i] ) == -1 )
+				failed++;
+	} else {
+		failed = das_pool_run( &batch, &paths, batch.jobs );
+	}
+	das_paths_free( &paths );
+	if ( batch.index != NULL ) {
+		if ( batch.command == DAS_CMD_INDEX && das_index_write( &index, batch.db ) == -1 )
+			failed = total;
+		das_index_free( &index );
+	}
+
+	clock_gettime( CLOCK_MONOTONIC, &stop );
+	double secs = ( stop.tv_sec - start.tv_sec ) + ( stop.tv_nsec - start.tv_nsec ) / 1e9;
+	if ( batch.command == DAS_CMD_STAMP )
+		fprintf( stderr, ":: %d of %d files processed in %.3fs (%.1f saves/sec).\n",
+			total - failed, total, secs, secs > 0 ? total / secs : 0.0 );
+	else if ( batch.command == DAS_CMD_ARCHIVE && store.bytes_new > 0 )
+		fprintf( stderr, ":: %d of %d files processed, %.1f MB in, %d of %d chunks new, "
+			"%.1f MB stored (%.1fx).\n", total - failed, total, store.bytes_in / 1e6,
+			store.chunks_new, store.chunks, store.bytes_new / 1e6,
+			(double)store.bytes_in / store.bytes_new );
+	else if ( batch.command == DAS_CMD_ARCHIVE )
+		fprintf( stderr, ":: %d of %d files processed, %.1f MB in, all %d chunks already stored.\n",
+			total - failed, total, store.bytes_in / 1e6, store.chunks );
+	else
+		fprintf( stderr, ":: %d of %d files processed.\n", total - failed, total );
+	if ( batch.stats != NULL ) {
+		das_stats_print( &stats, NULL, 0, &stats.total );
+		if ( stats.json != NULL && fclose( stats.json ) != 0 )
+			fprintf( stderr, ":: ERROR: Cannot write file \"%s\"\n", stats_json );
+		pthread_mutex_destroy( &stats.lock );
+	}
+	return( failed ? EXIT_FAILURE : EXIT_SUCCESS );
+
+}
+
+int das_paths_add( struct das_paths* paths, const char* path ) {
+
+	if ( paths->count == paths->alloc ) {
+		int alloc = paths->alloc ? paths->alloc * 2 : 64;
+		char** tmp = (char**)realloc( paths->path, alloc * sizeof( char* ) );
+		if ( tmp == NULL ) {
+			fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+			return( -1 );
+		}
+		paths->path = tmp;
+		paths->alloc = alloc;
+	}
+	size_t len = strlen( path );
+	if ( ( paths->path[paths->count] = (char*)malloc( len + 1 ) ) == NULL ) {
+		fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+		return( -1 );
+	}
+	memcpy( paths->path[paths->count], path, len + 1 );
+	paths->count++;
+	return( 0 );
+
+}
+
+int das_paths_walk( struct das_paths* paths, const char* dir ) {
+
+	// Recursively add every *.DAS file (any case) under dir
+	DIR* dp = opendir( dir );
+	struct dirent* ent = NULL;
+	if ( dp == NULL ) {
+		fprintf( stderr, ":: ERROR: Cannot open directory \"%s\"\n", dir );
+		return( -1 );
+	}
+	while ( ( ent = readdir( dp ) ) != NULL ) {
+		if ( strcmp( ent->d_name, "." ) == 0 || strcmp( ent->d_name, ".." ) == 0 )
+			continue;
+		char path[4096];
+		struct stat sb;
+		snprintf( path, sizeof( path ), "%s/%s", dir, ent->d_name );
+		if ( stat( path, &sb ) == -1 )
+			continue;
+		if ( S_ISDIR( sb.st_mode ) ) {
+			das_paths_walk( paths, path );
+		} else if ( S_ISREG( sb.st_mode ) ) {
+			size_t len = strlen( ent->d_name );
+			if ( len > 4 && ent->d_name[len-4] == '.' &&
+					toupper( (unsigned char)ent->d_name[len-3] ) == 'D' &&
+					toupper( (unsigned char)ent->d_name[len-2] ) == 'A' &&
+					toupper( (unsigned char)ent->d_name[len-1] ) == 'S' &&
+					das_paths_add( paths, path ) == -1 ) {
+				closedir( dp );
+				return( -1 );
+			}
+		}
+	}
+	closedir( dp );
+	return( 0 );
+
+}
+
+void das_paths_free( struct das_paths* paths ) {
+
+	int i = 0;
+	for ( i = 0; i < paths->count; i++ )
+		free( paths->path[i] );
+	free( paths->path );
+	paths->path = NULL;
+	paths->count = 0;
+	paths->alloc = 0;
+
+}
+
+static int das_deque_pop( struct das_deque* dq, int* job ) {
+
+	// Owner takes from the tail
+	int ret = 0;
+	pthread_mutex_lock( &dq->lock );
+	if ( dq->tail > dq->head ) {
+		*job = dq->job[--dq->tail];
+		ret = 1;
+	}
+	pthread_mutex_unlock( &dq->lock );
+	return( ret );
+
+}
+
+static int das_deque_steal( struct das_deque* dq, int* job ) {
+
+	// Thieves take from the head, away from the owner
+	int ret = 0;
+	pthread_mutex_lock( &dq->lock );
+	if ( dq->tail > dq->head ) {
+		*job = dq->job[dq->head++];
+		ret = 1;
+	}
+	pthread_mutex_unlock( &dq->lock );
+	return( ret );
+
+}
+
+static void* das_pool_worker( void* arg ) {
+
+	struct das_worker* worker = (struct das_worker*)arg;
+	struct das_pool* pool = worker->pool;
+	int job = 0, i = 0;
+	for ( ;; ) {
+		// Own queue first, then try everyone else once
+		int got = das_deque_pop( &pool->deque[worker->id], &job );
+		for ( i = 1; !got && i < pool->workers; i++ )
+			got = das_deque_steal( &pool->deque[( worker->id + i ) % pool->workers], &job );
+		// Nothing new is ever queued, so empty everywhere means done
+		if ( !got )
+			break;
+		if ( das_batch_file( pool->batch, pool->paths->path[job] ) == -1 )
+			worker->failed++;
+	}
+	return( NULL );
+
+}
+
+int das_pool_run( const struct das_batch* batch, struct das_paths* paths, int workers ) {
+
+	int i = 0, failed = 0, started = 0;
+	if ( workers > paths->count )
+		workers = paths->count;
+	if ( workers < 1 )
+		workers = 1;
+
+	struct das_pool pool = {
+		.batch   = batch,
+		.paths   = paths,
+		.deque   = (struct das_deque*)calloc( workers, sizeof( struct das_deque ) ),
+		.workers = workers
+	};
+	struct das_worker* worker = (struct das_worker*)calloc( workers, sizeof( struct das_worker ) );
+	int* jobs = (int*)malloc( ( paths->count + 1 ) * sizeof( int ) );
+	if ( pool.deque == NULL || worker == NULL || jobs == NULL ) {
+		fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+		free( pool.deque );
+		free( worker );
+		free( jobs );
+		return( paths->count );
+	}
+
+	// Deal the files out round robin, each worker gets a slice of jobs
+	int per = paths->count / workers, extra = paths->count % workers, at = 0;
+	for ( i = 0; i < workers; i++ ) {
+		int n = per + ( i < extra ), d = 0;
+		pthread_mutex_init( &pool.deque[i].lock, NULL );
+		pool.deque[i].job = jobs + at;
+		pool.deque[i].head = 0;
+		pool.deque[i].tail = n;
+		for ( d = 0; d < n; d++ )
+			pool.deque[i].job[n - 1 - d] = i + d * workers;
+		at += n;
+	}
+
+	// Resolve the scanner once, before anyone races for it
+	das_scan_init();
+	for ( i = 0; i < workers; i++ ) {
+		worker[i].pool = &pool;
+		worker[i].id = i;
+		worker[i].failed = 0;
+		if ( pthread_create( &worker[i].thread, NULL, das_pool_worker, &worker[i] ) != 0 )
+			break;
+		started++;
+	}
+	// If threads ran out, the ones we have steal the rest
+	if ( started == 0 )
+		das_pool_worker( &worker[0] );
+	for ( i = 0; i < started; i++ )
+		pthread_join( worker[i].thread, NULL );
+
+	for ( i = 0; i < workers; i++ ) {
+		failed += worker[i].failed;
+		pthread_mutex_destroy( &pool.deque[i].lock );
+	}
+	free( pool.deque );
+	free( worker );
+	free( jobs );
+	return( failed );
+
+}
+
+int das_read_header_file( const char* filename, struct header* header,
+		unsigned char* buf, size_t buf_size ) {
+
+	// Only the prefix and the FBHEADER block are read, never the save data
+	double start = das_stats_start();
+	size_t need = 0;
+	int i = 0;
+	header->size = 0;
+	if ( buf_size < DAS_HEADER_START ) {
+		fprintf( stderr, ":: ERROR: Header buffer too small.\n" );
+		return( -1 );
+	}
+#ifdef _WIN32
+	FILE* fp = fopen( filename, "rb" );
+	if ( fp == NULL ) {
+		fprintf( stderr, ":: ERROR: Cannot open file \"%s\"\n", filename );
+		return( -1 );
+	}
+	if ( fread( buf, 1, DAS_PREFIX_SIZE, fp ) != DAS_PREFIX_SIZE ) {
+		fprintf( stderr, ":: ERROR: File read error.\n" );
+		fclose( fp );
+		return( -1 );
+	}
+#else
+	int fd = open( filename, O_RDONLY );
+	if ( fd == -1 ) {
+		fprintf( stderr, ":: ERROR: Cannot open file \"%s\"\n", filename );
+		return( -1 );
+	}
+	if ( pread( fd, buf, DAS_PREFIX_SIZE, 0 ) != DAS_PREFIX_SIZE ) {
+		fprintf( stderr, ":: ERROR: File read error.\n" );
+		close( fd );
+		return( -1 );
+	}
+#endif
+
+	// At offset 0xA, 4 bytes, size of the FBHEADER block that starts at 0x16.
+	// Read the header checksum at 0x12 and then exactly that block.
+	unsigned int block = 0;
+	for ( i = 3; i >= 0; i-- )
+		block = ( block << 8 ) + buf[0xA+i];
+	need = (size_t)DAS_HEADER_START + block;
+	if ( memcmp( buf, "FBCHUNKS", 8 ) != 0 || need > buf_size ) {
+		fprintf( stderr, ":: ERROR: %s: Not a save file or header too large.\n", filename );
+#ifdef _WIN32
+		fclose( fp );
+#else
+		close( fd );
+#endif
+		return( -1 );
+	}
+#ifdef _WIN32
+	size_t got = fread( buf + DAS_PREFIX_SIZE, 1, need - DAS_PREFIX_SIZE, fp );
+	fclose( fp );
+#else
+	ssize_t got = pread( fd, buf + DAS_PREFIX_SIZE, need - DAS_PREFIX_SIZE, DAS_PREFIX_SIZE );
+	close( fd );
+#endif
+	if ( got < 0 || (size_t)got != need - DAS_PREFIX_SIZE ) {
+		fprintf( stderr, ":: ERROR: File read error.\n" );
+		return( -1 );
+	}
+	if ( das_stats_cur )
+		das_stats_cur->bytes_read += need;
+	das_stats_stop( DAS_STAGE_OPEN, start );
+
+	*header = das_read_header( buf, need );
+	return( header->size == 0 ? -1 : 0 );
+
+}
+
+void das_header_format( const struct header* header, char* out, size_t out_size ) {
+
+	// Tab separated, addons joined with ~ like they are stored
+	char pt_str[64], ts_str[64], addons[1024] = "";
+	size_t len = 0;
+	int i = 0;
+	for ( i = 0; i < header->addon_count && len < sizeof( addons ); i++ )
+		len += snprintf( addons + len, sizeof( addons ) - len, "%s%s",
+			i ? "~" : "", header->addons[i] );
+	das_ts_to_str( header->timestamp, ts_str, 64 );
+	ts_str[strcspn( ts_str, "\n" )] = '\0';
+	snprintf( out, out_size,
+		"%s\t%s\t%s\t%s\t%s\t%d\t%s\t%s\t%s\t%s\t%d\t%s\t%s\t%s",
+		header->player_name, header->player_id, header->player_race,
+		header->player_gender, header->player_class, header->player_level,
+		header->player_location, header->player_pos, header->area_id,
+		header->build_number, header->patch_number,
+		das_pt_to_str( header->total_play_time, pt_str, 64 ), ts_str, addons );
+
+}
+
+static long long das_mtime( const struct stat* sb ) {
+
+	// Nanoseconds where the platform has them
+#ifdef __linux__
+	return( (long long)sb->st_mtim.tv_sec * 1000000000LL + sb->st_mtim.tv_nsec );
+#else
+	return( (long long)sb->st_mtime * 1000000000LL );
+#endif
+
+}
+
+int das_index_load( struct das_index* index, const char* filename ) {
+
+	memset( index, 0, sizeof( struct das_index ) );
+	pthread_mutex_init( &index->lock, NULL );
+
+	// No index yet is fine, everything gets parsed
+	struct stat sb;
+	if ( stat( filename, &sb ) == -1 )
+		return( 0 );
+	if ( das_file_open( &index->file, filename, 0 ) == -1 )
+		return( -1 );
+
+	// Check the head, then that every string starts inside the pool and
+	// ends there
+	const struct das_index_head* head = (const struct das_index_head*)index->file.data;
+	size_t size = index->file.size;
+	int i = 0, s = 0, bad = 0;
+	if ( size < sizeof( struct das_index_head ) ||
+			memcmp( head->magic, "DASINDEX", 8 ) != 0 ||
+			head->version != DAS_INDEX_VERSION ||
+			head->record_size != (int)sizeof( struct das_index_rec ) ||
+			head->count < 0 || head->pool_size <= 0 ||
+			size != sizeof( struct das_index_head ) +
+				(size_t)head->count * sizeof( struct das_index_rec ) + head->pool_size ) {
+		fprintf( stderr, ":: ERROR: \"%s\" is not a usable index.\n", filename );
+		das_file_close( &index->file );
+		return( 0 );
+	}
+	const struct das_index_rec* rec = (const struct das_index_rec*)( head + 1 );
+	const char* pool = (const char*)( rec + head->count );
+	for ( i = 0; i < head->count && !bad; i++ )
+		for ( s = 0; s < DAS_INDEX_STRS; s++ )
+			if ( rec[i].str[s] < 0 || rec[i].str[s] >= head->pool_size ||
+					memchr( pool + rec[i].str[s], '\0', head->pool_size - rec[i].str[s] ) == NULL ) {
+				bad = 1;
+				break;
+			}
+	if ( bad ) {
+		fprintf( stderr, ":: ERROR: \"%s\" is damaged.\n", filename );
+		das_file_close( &index->file );
+		return( 0 );
+	}
+	index->count = head->count;
+	index->rec = rec;
+	index->pool = pool;
+	return( 0 );
+
+}
+
+const struct das_index_rec* das_index_lookup( const struct das_index* index, const char* path ) {
+
+	// Records are sorted by path
+	int lo = 0, hi = index->count - 1;
+	while ( lo <= hi ) {
+		int mid = lo + ( hi - lo ) / 2;
+		int cmp = strcmp( index->pool + index->rec[mid].str[DAS_IDX_PATH], path );
+		if ( cmp == 0 )
+			return( &index->rec[mid] );
+		if ( cmp < 0 )
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return( NULL );
+
+}
+
+static int das_index_str( struct das_index* index, const char* str ) {
+
+	// Append to the new pool, caller holds the lock
+	int len = (int)strlen( str ) + 1;
+	if ( index->new_pool_size + len > index->new_pool_alloc ) {
+		int alloc = index->new_pool_alloc ? index->new_pool_alloc : 65536;
+		while ( index->new_pool_size + len > alloc )
+			alloc *= 2;
+		char* tmp = (char*)realloc( index->new_pool, alloc );
+		if ( tmp == NULL ) {
+			fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+			return( -1 );
+		}
+		index->new_pool = tmp;
+		index->new_pool_alloc = alloc;
+	}
+	memcpy( index->new_pool + index->new_pool_size, str, len );
+	index->new_pool_size += len;
+	return( index->new_pool_size - len );
+
+}
+
+int das_index_add( struct das_index* index, const struct das_index_rec* rec,
+		const char* const str[DAS_INDEX_STRS] ) {
+
+	int ret = 0, s = 0;
+	pthread_mutex_lock( &index->lock );
+	if ( index->new_count == index->new_alloc ) {
+		int alloc = index->new_alloc ? index->new_alloc * 2 : 1024;
+		struct das_index_rec* tmp = (struct das_index_rec*)realloc( index->new_rec,
+			alloc * sizeof( struct das_index_rec ) );
+		if ( tmp == NULL ) {
+			fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+			pthread_mutex_unlock( &index->lock );
+			return( -1 );
+		}
+		index->new_rec = tmp;
+		index->new_alloc = alloc;
+	}
+	struct das_index_rec* dst = &index->new_rec[index->new_count];
+	*dst = *rec;
+	for ( s = 0; s < DAS_INDEX_STRS && ret != -1; s++ )
+		ret = dst->str[s] = das_index_str( index, str[s] );
+	if ( ret != -1 )
+		index->new_count++;
+	pthread_mutex_unlock( &index->lock );
+	return( ret == -1 ? -1 : 0 );
+
+}
+
+// qsort has no context pointer, the pool is only sorted from one thread
+static const char* das_index_sort_pool = NULL;
+
+static int das_index_cmp( const void* a, const void* b ) {
+
+	return( strcmp( das_index_sort_pool + ( (const struct das_index_rec*)a )->str[DAS_IDX_PATH],
+		das_index_sort_pool + ( (const struct das_index_rec*)b )->str[DAS_IDX_PATH] ) );
+
+}
+
+int das_index_write( struct das_index* index, const char* filename ) {
+
+	// Written next to the old one and renamed over it, so a reader never
+	// sees half an index
+	char tmp_name[4096];
+	das_tmp_name( tmp_name, sizeof( tmp_name ), filename );
+	if ( index->new_pool_size == 0 && das_index_str( index, "" ) == -1 )
+		return( -1 );
+	das_index_sort_pool = index->new_pool;
+	qsort( index->new_rec, index->new_count, sizeof( struct das_index_rec ), das_index_cmp );
+
+	struct das_index_head head;
+	memset( &head, 0, sizeof( head ) );
+	memcpy( head.magic, "DASINDEX", 8 );
+	head.version = DAS_INDEX_VERSION;
+	head.record_size = (int)sizeof( struct das_index_rec );
+	head.count = index->new_count;
+	head.pool_size = index->new_pool_size;
+
+	FILE* fp = fopen( tmp_name, "wb" );
+	if ( fp == NULL ) {
+		fprintf( stderr, ":: ERROR: Cannot write file \"%s\"\n", tmp_name );
+		return( -1 );
+	}
+	int ok = fwrite( &head, sizeof( head ), 1, fp ) == 1 &&
+		fwrite( index->new_rec, sizeof( struct das_index_rec ), index->new_count, fp ) ==
+			(size_t)index->new_count &&
+		fwrite( index->new_pool, 1, index->new_pool_size, fp ) == (size_t)index->new_pool_size &&
+		fflush( fp ) == 0;
+#ifdef DAS_MMAP
+	ok = ok && fsync( fileno( fp ) ) == 0;
+#endif
+	ok = fclose( fp ) == 0 && ok;
+#ifdef _WIN32
+	if ( ok )
+		remove( filename );
+#endif
+	if ( !ok || rename( tmp_name, filename ) == -1 ) {
+		fprintf( stderr, ":: ERROR: Cannot write file \"%s\"\n", filename );
+		remove( tmp_name );
+		return( -1 );
+	}
+	return( 0 );
+
+}
+
+void das_index_free( struct das_index* index ) {
+
+	das_file_close( &index->file );
+	free( index->new_rec );
+	free( index->new_pool );
+	pthread_mutex_destroy( &index->lock );
+	memset( index, 0, sizeof( struct das_index ) );
+
+}
+
+void das_index_format( const struct das_index_rec* rec, const char* const str[DAS_INDEX_STRS],
+		char* out, size_t out_size ) {
+
+	// Same order as info, minus what isn't kept
+	char pt_str[64], ts_str[64];
+	das_ts_to_str( rec->timestamp, ts_str, 64 );
+	ts_str[strcspn( ts_str, "\n" )] = '\0';
+	snprintf( out, out_size, "%s\t%s\t%s\t%s\t%d\t%s\t%s\t%s\t%d\t%s\t%s\t%s",
+		str[DAS_IDX_NAME], str[DAS_IDX_RACE], str[DAS_IDX_GENDER], str[DAS_IDX_CLASS],
+		rec->player_level, str[DAS_IDX_LOCATION], str[DAS_IDX_AREA], str[DAS_IDX_BUILD],
+		rec->patch_number, das_pt_to_str( rec->total_play_time, pt_str, 64 ),
+		ts_str, str[DAS_IDX_ADDONS] );
+
+}
+
+int das_index_file( struct das_index* index, const char* path, int verify,
+		char* out, size_t out_size ) {
+
+	struct stat sb;
+	if ( stat( path, &sb ) == -1 ) {
+		fprintf( stderr, ":: ERROR: Cannot stat file %s.\n", path );
+		return( -1 );
+	}
+
+	// Same size and mtime (and header checksum, if asked) means unchanged
+	const struct das_index_rec* old = das_index_lookup( index, path );
+	unsigned char buf[DAS_HEADER_MAX];
+	struct header header;
+	if ( old != NULL && ( old->size != (long long)sb.st_size || old->mtime != das_mtime( &sb ) ) )
+		old = NULL;
+	if ( old != NULL && verify &&
+			( das_read_header_file( path, &header, buf, sizeof( buf ) ) == -1 ||
+				header.checksum != old->checksum ) )
+		old = NULL;
+	if ( old != NULL ) {
+		const char* str[DAS_INDEX_STRS];
+		int s = 0;
+		for ( s = 0; s < DAS_INDEX_STRS; s++ )
+			str[s] = index->pool + old->str[s];
+		if ( das_index_add( index, old, str ) == -1 )
+			return( -1 );
+		int len = snprintf( out, out_size, "cached\t" );
+		das_index_format( old, str, out + len, out_size - len );
+		return( 0 );
+	}
+
+	// Changed or new, parse it
+	struct das_file file;
+	struct das_index_rec rec;
+	struct handle value[DAS_NUM_VALUES];
+	struct das_view view;
+	int i = 0, ret = -1;
+	if ( das_file_open( &file, path, 0 ) == -1 )
+		return( -1 );
+	if ( file.size > 2000000 || file.size < 100000 ) {
+		fprintf( stderr, ":: ERROR: %s: File size is off. Not a save file.\n", path );
+		das_file_close( &file );
+		return( -1 );
+	}
+	header = das_read_header( file.data, file.size );
+	if ( header.size == 0 ) {
+		fprintf( stderr, ":: ERROR: %s: Cannot read file header.\n", path );
+		das_file_close( &file );
+		return( -1 );
+	}
+	memset( &rec, 0, sizeof( rec ) );
+	rec.size = sb.st_size;
+	rec.mtime = das_mtime( &sb );
+	rec.timestamp = header.timestamp;
+	rec.checksum = header.checksum;
+	rec.player_level = header.player_level;
+	rec.patch_number = header.patch_number;
+	rec.total_play_time = header.total_play_time;
+	// A save without face data is still worth listing
+	rec.shift = -1;
+	if ( das_find_values( &file, value, &view ) == 0 )
+		rec.shift = view.shift;
+	for ( i = 0; i < DAS_NUM_VALUES; i++ )
+		rec.offset[i] = rec.shift == -1 ? -1 : value[i].offset;
+	das_file_close( &file );
+
+	char addons[1024] = "";
+	size_t len = 0;
+	for ( i = 0; i < header.addon_count && len < sizeof( addons ); i++ )
+		len += snprintf( addons + len, sizeof( addons ) - len, "%s%s",
+			i ? "~" : "", header.addons[i] );
+	const char* str[DAS_INDEX_STRS] = {
+		[DAS_IDX_PATH]     = path,
+		[DAS_IDX_NAME]     = header.player_name,
+		[DAS_IDX_RACE]     = header.player_race,
+		[DAS_IDX_GENDER]   = header.player_gender,
+		[DAS_IDX_CLASS]    = header.player_class,
+		[DAS_IDX_LOCATION] = header.player_location,
+		[DAS_IDX_AREA]     = header.area_id,
+		[DAS_IDX_BUILD]    = header.build_number,
+		[DAS_IDX_ADDONS]   = addons
+	};
+	if ( ( ret = das_index_add( index, &rec, str ) ) == 0 ) {
+		len = snprintf( out, out_size, "parsed\t" );
+		das_index_format( &rec, str, out + len, out_size - len );
+	}
+	return( ret );
+
+}
+
+int das_index_values( const struct das_index* index, struct das_file* file, const char* path,
+		struct handle* value, struct das_view* view ) {
+
+	// Face values of a save the index has, read at its recorded shift and
+	// offsets instead of searched for. -1 if the save is not in the index,
+	// changed since (size or mtime) or had no face data
+	const struct das_index_rec* rec = das_index_lookup( index, path );
+	struct stat sb;
+	int i = 0;
+	if ( rec == NULL || rec->shift < 0 || rec->shift > 7 || stat( path, &sb ) == -1 ||
+			rec->size != (long long)sb.st_size || rec->mtime != das_mtime( &sb ) ||
+			rec->size != (long long)file->size )
+		return( -1 );
+	for ( i = 0; i < DAS_NUM_VALUES; i++ )
+		if ( rec->offset[i] < -1 || rec->offset[i] + 4 > (int)file->size )
+			return( -1 );
+	*view = das_view_init( file->data, (int)file->size, rec->shift );
+	view->file = file;
+	for ( i = 0; i < DAS_NUM_VALUES; i++ ) {
+		if ( rec->offset[i] != -1 ) {
+			value[i] = das_set_struct( view, das_str_lookup( i ), rec->offset[i],
+				das_fields[i].min, das_fields[i].max );
+			continue;
+		}
+		memset( &value[i], 0, sizeof( struct handle ) );
+		value[i].offset = -1;
+		memcpy( value[i].name, das_fields[i].name, sizeof( value[i].name ) );
+	}
+	if ( das_stats_cur )
+		das_stats_cur->shift = rec->shift;
+	return( 0 );
+
+}
+
+int das_batch_values( const struct das_batch* batch, struct das_file* file, const char* path,
+		struct handle* value, struct das_view* view ) {
+
+	// --db lets unchanged saves skip the face value search
+	if ( batch->index != NULL && batch->command != DAS_CMD_INDEX &&
+			das_index_values( batch->index, file, path, value, view ) == 0 )
+		return( 0 );
+	return( das_find_values( file, value, view ) );
+
+}
+
+int das_index_list( const char* filename ) {
+
+	// Everything in the index, no save is opened
+	struct das_index index;
+	char out[4096];
+	int i = 0, s = 0;
+	if ( das_index_load( &index, filename ) == -1 )
+		return( -1 );
+	for ( i = 0; i < index.count; i++ ) {
+		const char* str[DAS_INDEX_STRS];
+		for ( s = 0; s < DAS_INDEX_STRS; s++ )
+			str[s] = index.pool + index.rec[i].str[s];
+		das_index_format( &index.rec[i], str, out, sizeof( out ) );
+		printf( "%s\t%s\n", str[DAS_IDX_PATH], out );
+	}
+	das_index_free( &index );
+	return( 0 );
+
+}
+
+int das_xml_mode( const char* name ) {
+
+	if ( strcmp( name, "newline" ) == 0 )
+		return( DAS_XML_NEWLINE );
+	if ( strcmp( name, "raw" ) == 0 )
+		return( DAS_XML_RAW );
+	if ( strcmp( name, "pretty" ) == 0 )
+		return( DAS_XML_PRETTY );
+	return( -1 );
+
+}
+
+static int das_sax_match( const struct das_sax* sax, const char* path, int len ) {
+
+	// The path's elements, last first, against the innermost open elements
+	int depth = sax->depth, seg = len;
+	while ( seg > 0 ) {
+		int start = seg;
+		while ( start > 0 && path[start-1] != '/' )
+			start--;
+		if ( depth == 0 || !das_sax_is( sax, sax->stack[--depth], path + start, seg - start ) )
+			return( 0 );
+		seg = start - 1;
+	}
+	return( 1 );
+
+}
+
+int das_xml_query( const struct das_view* view, int offset, int size, const char* query,
+		struct das_span* hits, int max ) {
+
+	// Elem, A/B or A/B@attr. Without @attr it is the element's text.
+	const char* at = strchr( query, '@' );
+	int path_len = at ? (int)( at - query ) : (int)strlen( query );
+	int attr_len = at ? (int)strlen( at + 1 ) : 0;
+	int count = 0, type = 0;
+	struct das_sax sax;
+	if ( path_len == 0 || ( at && attr_len == 0 ) || query[0] == '/' || query[path_len-1] == '/' )
+		return( -1 );
+	das_sax_init( &sax, view, offset, size );
+	while ( ( type = das_sax_next( &sax ) ) > DAS_SAX_END ) {
+		if ( at ? type != DAS_SAX_ATTR || !das_sax_is( &sax, sax.name, at + 1, attr_len )
+				: type != DAS_SAX_TEXT )
+			continue;
+		if ( !das_sax_match( &sax, query, path_len ) )
+			continue;
+		if ( count < max )
+			hits[count] = sax.value;
+		count++;
+	}
+	return( type == DAS_SAX_ERROR ? -1 : count );
+
+}
+
+int das_xml_splice( struct das_file* file, int shift, int xml_offset, int at, int old_len,
+		const unsigned char* src, int new_len ) {
+
+	// Rebuild the file with the view bytes [at, at+old_len) replaced. Bytes
+	// after the change move by whole bytes, so data at other shifts keeps its
+	// alignment. Then fix the XML's size prefix and the header's data size.
+	struct das_view old = das_view_init( file->data, (int)file->size, shift );
+	int delta = new_len - old_len, i = 0, n = (int)file->size + delta;
+	unsigned char* buf = NULL;
+	if ( xml_offset < 4 || at <= xml_offset || n < (int)DAS_HEADER_START + 1 ||
+			( buf = (unsigned char*)malloc( n ) ) == NULL ) {
+		fprintf( stderr, ":: ERROR: Cannot resize XML.\n" );
+		return( -1 );
+	}
+	memcpy( buf, file->data, at - 1 );
+	unsigned char cur = das_view_u8( &old, at - 1 ), next = 0;
+	for ( i = at - 1; i < n; i++ ) {
+		int j = i + 1;
+		if ( j == n )
+			next = das_view_u8( &old, 0 );
+		else if ( j < at )
+			next = das_view_u8( &old, j );
+		else if ( j < at + new_len )
+			next = src[j - at];
+		else
+			next = das_view_u8( &old, j - delta );
+		buf[i] = shift ? (unsigned char)( ( cur << shift ) | ( next >> ( 8 - shift ) ) ) : cur;
+		cur = next;
+	}
+
+	unsigned int xml_size = das_view_read_u32( &old, xml_offset - 4 ) + delta;
+	unsigned int data_size = 0;
+	for ( i = 3; i >= 0; i-- )
+		data_size = ( data_size << 8 ) + file->data[0xE + i];
+	data_size += delta;
+
+	// The new bytes live on the heap from here on
+	das_file_close( file );
+	file->data = buf;
+	file->size = n;
+	file->mapped = 0;
+	file->writable = 1;
+	file->dirty_count = 0;
+
+	struct das_view view = das_view_init( buf, n, shift );
+	unsigned char size_bytes[4] = { xml_size >> 24, xml_size >> 16, xml_size >> 8, xml_size };
+	das_view_write( &view, xml_offset - 4, size_bytes, 4 );
+	for ( i = 0; i < 4; i++ )
+		buf[0xE + i] = data_size >> ( 8 * i );
+	return( 0 );
+
+}
+
+int das_xml_edit( struct das_file* file, const char* query, const char* value,
+		char* out, size_t out_size ) {
+
+	// Last XML first and last hit first, so nothing moves under us
+	struct xml_hit* xmls = NULL;
+	struct das_span hits[DAS_XML_HITS_MAX];
+	int xml_count = das_find_xmls( file->data, (int)file->size, &xmls );
+	int len = (int)strlen( value ), total = 0, i = 0, h = 0, count = 0;
+	if ( strpbrk( value, "<>&\"'" ) != NULL ) {
+		fprintf( stderr, ":: ERROR: Value must not contain <>&\"'.\n" );
+		free( xmls );
+		return( -1 );
+	}
+	for ( i = xml_count - 1; i >= 0; i-- ) {
+		struct das_view view = das_view_init( file->data, (int)file->size, xmls[i].shift );
+		view.file = file;
+		int offset = xmls[i].offset;
+		int size = offset >= 4 ? (int)das_view_read_u32( &view, offset - 4 ) : 0;
+		if ( size <= 0 || size > (int)file->size - offset )
+			continue;
+		if ( ( count = das_xml_query( &view, offset, size, query, hits, DAS_XML_HITS_MAX ) ) == -1 ) {
+			fprintf( stderr, ":: ERROR: Bad query or XML at %.8X.\n", offset );
+			free( xmls );
+			return( -1 );
+		}
+		if ( count > DAS_XML_HITS_MAX ) {
+			fprintf( stderr, ":: ERROR: More than %d matches in the XML at %.8X.\n",
+				DAS_XML_HITS_MAX, offset );
+			free( xmls );
+			return( -1 );
+		}
+		for ( h = count - 1; h >= 0; h-- ) {
+			if ( hits[h].len == len ) {
+				das_view_write( &view, hits[h].offset, (const unsigned char*)value, len );
+			} else if ( das_xml_splice( file, xmls[i].shift, offset, hits[h].offset,
+					hits[h].len, (const unsigned char*)value, len ) == -1 ) {
+				free( xmls );
+				return( -1 );
+			} else {
+				view = das_view_init( file->data, (int)file->size, xmls[i].shift );
+				view.file = file;
+			}
+		}
+		total += count;
+	}
+	free( xmls );
+	if ( total == 0 ) {
+		fprintf( stderr, ":: ERROR: \"%s\" not found.\n", query );
+		return( -1 );
+	}
+	snprintf( out, out_size, "%d", total );
+	return( 0 );
+
+}
+
+int das_xml_get( const struct das_file* file, const char* query, char* out, size_t out_size ) {
+
+	// Every match in every XML, tab separated
+	struct das_xml_iter it;
+	struct xml_hit hit;
+	struct das_span hits[DAS_XML_HITS_MAX];
+	size_t len = 0;
+	int count = 0, total = 0, h = 0;
+	out[0] = '\0';
+	das_xml_iter_init( &it, file->data, (int)file->size );
+	while ( das_xml_iter_next( &it, &hit ) ) {
+		struct das_view view = das_view_init( file->data, (int)file->size, hit.shift );
+		int size = hit.offset >= 4 ? (int)das_view_read_u32( &view, hit.offset - 4 ) : 0;
+		if ( size <= 0 || size > (int)file->size - hit.offset )
+			continue;
+		if ( ( count = das_xml_query( &view, hit.offset, size, query, hits, DAS_XML_HITS_MAX ) ) == -1 ) {
+			fprintf( stderr, ":: ERROR: Bad query or XML at %.8X.\n", hit.offset );
+			return( -1 );
+		}
+		for ( h = 0; h < count && h < DAS_XML_HITS_MAX; h++, total++ ) {
+			if ( total > 0 && len + 1 < out_size )
+				out[len++] = '\t';
+			int n = hits[h].len;
+			if ( len + n >= out_size )
+				n = (int)( out_size - len - 1 );
+			das_view_read( &view, hits[h].offset, (unsigned char*)out + len, n );
+			len += n;
+			out[len] = '\0';
+		}
+	}
+	if ( total == 0 ) {
+		fprintf( stderr, ":: ERROR: \"%s\" not found.\n", query );
+		return( -1 );
+	}
+	return( 0 );
+
+}
+
+// Gear table, one random 64 bit value per byte value
+static unsigned long long das_gear[256];
+static pthread_once_t das_gear_once = PTHREAD_ONCE_INIT;
+
+static void das_gear_init( void ) {
+
+	// splitmix64 from a fixed seed, so chunk boundaries never change
+	unsigned long long x = 0x2545F4914F6CDD1DULL, z = 0;
+	int i = 0;
+	for ( i = 0; i < 256; i++ ) {
+		z = ( x += 0x9E3779B97F4A7C15ULL );
+		z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+		z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBULL;
+		das_gear[i] = z ^ ( z >> 31 );
+	}
+
+}
+
+size_t das_cdc_next( const unsigned char* data, size_t size, size_t pos, size_t min, size_t avg,
+		size_t max, int bits ) {
+
+	// End of the chunk starting at pos (FastCDC): the first byte past min
+	// where the top bits of the rolling hash are all zero, never past max.
+	// Before avg a cut needs two more zero bits, after it two less, which
+	// keeps chunks close to avg. The hash only sees the last 64 bytes, so
+	// cuts follow the content.
+	unsigned long long hash = 0;
+	unsigned long long hard = ~0ULL << ( 64 - bits - 2 ), easy = ~0ULL << ( 64 - bits + 2 );
+	size_t end = size - pos > max ? pos + max : size, i = 0;
+	size_t mid = size - pos > avg ? pos + avg : size;
+	pthread_once( &das_gear_once, das_gear_init );
+	if ( end - pos <= min )
+		return( end );
+	for ( i = pos + min; i < mid; i++ ) {
+		hash = ( hash << 1 ) + das_gear[data[i]];
+		if ( !( hash & hard ) )
+			return( i + 1 );
+	}
+	for ( ; i < end; i++ ) {
+		hash = ( hash << 1 ) + das_gear[data[i]];
+		if ( !( hash & easy ) )
+			return( i + 1 );
+	}
+	return( end );
+
+}
+
+int das_chunks( const unsigned char* data, size_t size, size_t min, size_t avg, size_t max, int bits,
+		struct das_chunk** chunks ) {
+
+	// The whole buffer as chunks, each with its CRC-32
+	int count = 0, alloc = 0;
+	size_t pos = 0, end = 0;
+	*chunks = NULL;
+	while ( pos < size ) {
+		if ( count == alloc ) {
+			alloc = alloc ? alloc * 2 : 1024;
+			struct das_chunk* tmp = (struct das_chunk*)realloc( *chunks, alloc * sizeof( struct das_chunk ) );
+			if ( tmp == NULL ) {
+				fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+				free( *chunks );
+				*chunks = NULL;
+				return( -1 );
+			}
+			*chunks = tmp;
+		}
+		end = das_cdc_next( data, size, pos, min, avg, max, bits );
+		(*chunks)[count].offset = pos;
+		(*chunks)[count].len = end - pos;
+		(*chunks)[count].hash = das_crc32( 0, data + pos, end - pos );
+		count++;
+		pos = end;
+	}
+	return( count );
+
+}
+
+static int das_map_init( struct das_map* map, int count ) {
+
+	map->cap = 16;
+	while ( map->cap < count * 2 )
+		map->cap *= 2;
+	map->count = 0;
+	map->key = (unsigned long long*)malloc( map->cap * sizeof( unsigned long long ) );
+	map->val = (int*)malloc( map->cap * sizeof( int ) );
+	if ( map->key == NULL || map->val == NULL ) {
+		fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+		free( map->key );
+		free( map->val );
+		map->key = NULL;
+		map->val = NULL;
+		return( -1 );
+	}
+	memset( map->val, 0xFF, map->cap * sizeof( int ) );
+	return( 0 );
+
+}
+
+static void das_map_free( struct das_map* map ) {
+
+	free( map->key );
+	free( map->val );
+	map->key = NULL;
+	map->val = NULL;
+
+}
+
+static int das_map_home( const struct das_map* map, unsigned long long key ) {
+
+	return( (int)( ( key * 0x9E3779B97F4A7C15ULL ) >> 32 ) & ( map->cap - 1 ) );
+
+}
+
+static int das_map_find( const struct das_map* map, unsigned long long key ) {
+
+	// Slot holding key, or the empty slot it would go in
+	int i = das_map_home( map, key );
+	while ( map->val[i] != -1 && map->key[i] != key )
+		i = ( i + 1 ) & ( map->cap - 1 );
+	return( i );
+
+}
+
+static int das_map_get( const struct das_map* map, unsigned long long key ) {
+
+	return( map->val[das_map_find( map, key )] );
+
+}
+
+static int das_map_put( struct das_map* map, unsigned long long key, int val ) {
+
+	// Kept at most half full
+	int i = 0;
+	if ( ( map->count + 1 ) * 2 > map->cap ) {
+		struct das_map bigger;
+		if ( das_map_init( &bigger, map->cap ) == -1 )
+			return( -1 );
+		for ( i = 0; i < map->cap; i++ )
+			if ( map->val[i] != -1 ) {
+				int slot = das_map_find( &bigger, map->key[i] );
+				bigger.key[slot] = map->key[i];
+				bigger.val[slot] = map->val[i];
+				bigger.count++;
+			}
+		das_map_free( map );
+		*map = bigger;
+	}
+	i = das_map_find( map, key );
+	if ( map->val[i] == -1 )
+		map->count++;
+	map->key[i] = key;
+	map->val[i] = val;
+	return( 0 );
+
+}
+
+static void das_map_del( struct das_map* map, unsigned long long key ) {
+
+	// Later keys of the same run move back into the gap, so lookups
+	// never stop early at it
+	int i = das_map_find( map, key ), j = i;
+	if ( map->val[i] == -1 )
+		return;
+	map->val[i] = -1;
+	map->count--;
+	for ( ;; ) {
+		j = ( j + 1 ) & ( map->cap - 1 );
+		if ( map->val[j] == -1 )
+			return;
+		int home = das_map_home( map, map->key[j] );
+		// j may fill i unless its home lies cyclically in ( i, j ]
+		if ( i <= j ? ( home > i && home <= j ) : ( home > i || home <= j ) )
+			continue;
+		map->key[i] = map->key[j];
+		map->val[i] = map->val[j];
+		map->val[j] = -1;
+		i = j;
+	}
+
+}
+
+static void das_diff_put( FILE* fp, const unsigned char* data, int len ) {
+
+	// Escaped, so every delta stays on one tab separated line
+	int i = 0;
+	for ( i = 0; i < len; i++ ) {
+		unsigned char c = data[i];
+		if ( c == '\t' )
+			fputs( "\\t", fp );
+		else if ( c == '\n' )
+			fputs( "\\n", fp );
+		else if ( c == '\r' )
+			fputs( "\\r", fp );
+		else if ( c == '\\' )
+			fputs( "\\\\", fp );
+		else if ( c < 0x20 || c >= 0x7F )
+			fprintf( fp, "\\x%.2X", c );
+		else
+			fputc( c, fp );
+	}
+
+}
+
+static void das_diff_put_view( FILE* fp, const struct das_view* view, struct das_span span ) {
+
+	unsigned char chunk[1024];
+	int at = 0, n = 0;
+	for ( at = 0; at < span.len; at += n ) {
+		n = span.len - at < (int)sizeof( chunk ) ? span.len - at : (int)sizeof( chunk );
+		das_view_read( view, span.offset + at, chunk, n );
+		das_diff_put( fp, chunk, n );
+	}
+
+}
+
+static void das_diff_put_item( FILE* fp, const struct das_item* item ) {
+
+	// Strings are padded with \0, the padding isn't part of the value
+	int len = item->value.len;
+	while ( len > 0 && item->value.ptr[len-1] == '\0' )
+		len--;
+	das_diff_put( fp, item->value.ptr, len );
+
+}
+
+static int das_diff_items( const struct das_file* file, const struct header* header,
+		struct das_item** items ) {
+
+	// Every FBHEADER item in file order
+	int count = 0, i = 0;
+	size_t offset = 0x24, end = DAS_HEADER_START + (size_t)header->size;
+	if ( end > file->size )
+		end = file->size;
+	count = ( file->data[0x20] << 24 ) | ( file->data[0x21] << 16 ) |
+		( file->data[0x22] << 8 ) | file->data[0x23];
+	if ( count < 0 || count > (int)( end / 6 ) ||
+			( *items = (struct das_item*)malloc( ( count + 1 ) * sizeof( struct das_item ) ) ) == NULL )
+		return( -1 );
+	for ( i = 0; i < count; i++ )
+		if ( das_item_next( file->data, end, &offset, &(*items)[i] ) == -1 )
+			break;
+	return( i );
+
+}
+
+static int das_diff_header( FILE* fp, const struct das_file* a, const struct header* ha,
+		const struct das_file* b, const struct header* hb ) {
+
+	// Items aligned by hash, and by how often that hash came before when
+	// it repeats. Returns the number of differences.
+	struct das_item* ia = NULL;
+	struct das_item* ib = NULL;
+	struct das_map keys, occ_a, occ_b;
+	int na = das_diff_items( a, ha, &ia ), nb = das_diff_items( b, hb, &ib );
+	int i = 0, n = 0, changes = 0;
+	char* matched = NULL;
+	if ( na == -1 || nb == -1 || das_map_init( &keys, na ) == -1 ) {
+		free( ia );
+		free( ib );
+		return( -1 );
+	}
+	das_map_init( &occ_a, na );
+	das_map_init( &occ_b, nb );
+	matched = (char*)calloc( na + 1, 1 );
+	if ( occ_a.val == NULL || occ_b.val == NULL || matched == NULL )
+		changes = -1;
+	for ( i = 0; i < na && changes != -1; i++ ) {
+		n = das_map_get( &occ_a, ia[i].hash ) + 1;
+		if ( das_map_put( &occ_a, ia[i].hash, n ) == -1 ||
+				das_map_put( &keys, ( (unsigned long long)n << 32 ) | ia[i].hash, i ) == -1 )
+			changes = -1;
+	}
+	for ( i = 0; i < nb && changes != -1; i++ ) {
+		n = das_map_get( &occ_b, ib[i].hash ) + 1;
+		if ( das_map_put( &occ_b, ib[i].hash, n ) == -1 ) {
+			changes = -1;
+			break;
+		}
+		int at = das_map_get( &keys, ( (unsigned long long)n << 32 ) | ib[i].hash );
+		if ( at != -1 ) {
+			matched[at] = 1;
+			if ( ia[at].value.len == ib[i].value.len &&
+					memcmp( ia[at].value.ptr, ib[i].value.ptr, ib[i].value.len ) == 0 )
+				continue;
+		}
+		fprintf( fp, "header\t%.8X\t", ib[i].hash );
+		if ( at != -1 )
+			das_diff_put_item( fp, &ia[at] );
+		else
+			fputc( '-', fp );
+		fputc( '\t', fp );
+		das_diff_put_item( fp, &ib[i] );
+		fputc( '\n', fp );
+		changes++;
+	}
+	for ( i = 0; i < na && changes != -1; i++ ) {
+		if ( matched[i] )
+			continue;
+		fprintf( fp, "header\t%.8X\t", ia[i].hash );
+		das_diff_put_item( fp, &ia[i] );
+		fputs( "\t-\n", fp );
+		changes++;
+	}
+	das_map_free( &keys );
+	das_map_free( &occ_a );
+	das_map_free( &occ_b );
+	free( matched );
+	free( ia );
+	free( ib );
+	return( changes );
+
+}
+
+static int das_diff_face( FILE* fp, const struct handle* va, const struct handle* vb ) {
+
+	// Fields are already aligned, das_find_values found them by anchor
+	int i = 0, changes = 0;
+	for ( i = 0; i < DAS_NUM_VALUES; i++ ) {
+		int in_a = va[i].offset != -1, in_b = vb[i].offset != -1;
+		if ( !in_a && !in_b )
+			continue;
+		if ( in_a && in_b && memcmp( &va[i].fp_val, &vb[i].fp_val, sizeof( float ) ) == 0 )
+			continue;
+		fprintf( fp, "face\t%d\t%s\t", i, das_fields[i].name );
+		if ( in_a )
+			fprintf( fp, "%.9g", va[i].fp_val );
+		else
+			fputc( '-', fp );
+		if ( in_b )
+			fprintf( fp, "\t%.9g\n", vb[i].fp_val );
+		else
+			fputs( "\t-\n", fp );
+		changes++;
+	}
+	return( changes );
+
+}
+
+static int das_diff_key( const struct das_sax* sax, int type, struct das_map* occ,
+		unsigned long long* key, int* nth ) {
+
+	// FNV-1a over the open elements' names, the token kind and attribute
+	// name, then mixed with how often that path came before
+	unsigned long long h = 0xCBF29CE484222325ULL;
+	int d = 0, k = 0;
+	for ( d = 0; d < sax->depth; d++ ) {
+		for ( k = 0; k < sax->stack[d].len; k++ )
+			h = ( h ^ das_view_u8( sax->view, sax->stack[d].offset + k ) ) * 0x100000001B3ULL;
+		h = ( h ^ '/' ) * 0x100000001B3ULL;
+	}
+	h = ( h ^ (unsigned int)type ) * 0x100000001B3ULL;
+	if ( type == DAS_SAX_ATTR )
+		for ( k = 0; k < sax->name.len; k++ )
+			h = ( h ^ das_view_u8( sax->view, sax->name.offset + k ) ) * 0x100000001B3ULL;
+	*nth = das_map_get( occ, h ) + 1;
+	if ( das_map_put( occ, h, *nth ) == -1 )
+		return( -1 );
+	*key = h ^ ( (unsigned long long)*nth * 0x9E3779B97F4A7C15ULL );
+	return( 0 );
+
+}
+
+static void das_diff_path( FILE* fp, int xml, const struct das_sax* sax, int type, int nth ) {
+
+	// xml N Parent/Elem, Parent/Elem@attr or Parent/Elem#text, [n] for
+	// the n-th repeat of the same path
+	int d = 0;
+	fprintf( fp, "xml\t%d\t", xml );
+	for ( d = 0; d < sax->depth; d++ ) {
+		if ( d > 0 )
+			fputc( '/', fp );
+		das_diff_put_view( fp, sax->view, sax->stack[d] );
+	}
+	if ( type == DAS_SAX_ATTR ) {
+		fputc( '@', fp );
+		das_diff_put_view( fp, sax->view, sax->name );
+	} else if ( type == DAS_SAX_TEXT ) {
+		fputs( "#text", fp );
+	}
+	if ( nth > 0 )
+		fprintf( fp, "[%d]", nth );
+	fputc( '\t', fp );
+
+}
+
+static int das_diff_span_eq( const struct das_view* va, struct das_span a,
+		const struct das_view* vb, struct das_span b ) {
+
+	int i = 0;
+	if ( a.len != b.len )
+		return( 0 );
+	for ( i = 0; i < a.len; i++ )
+		if ( das_view_u8( va, a.offset + i ) != das_view_u8( vb, b.offset + i ) )
+			return( 0 );
+	return( 1 );
+
+}
+
+static int das_diff_xml( FILE* fp, int xml, const struct das_view* va, int oa, int sa,
+		const struct das_view* vb, int ob, int sb ) {
+
+	// Elements, attributes and text aligned by their path. A is read into
+	// a map first, B is looked up in it, then A again for what B lacks.
+	// Returns the number of differences, -1 if either XML doesn't parse.
+	struct das_sax sax;
+	struct das_map keys, occ;
+	struct das_span* spans = NULL;
+	char* matched = NULL;
+	unsigned long long key = 0;
+	int type = 0, nth = 0, count = 0, alloc = 0, changes = 0, at = 0;
+	if ( das_map_init( &keys, 256 ) == -1 )
+		return( -1 );
+	if ( das_map_init( &occ, 256 ) == -1 ) {
+		das_map_free( &keys );
+		return( -1 );
+	}
+	das_sax_init( &sax, va, oa, sa );
+	while ( ( type = das_sax_next( &sax ) ) > DAS_SAX_END ) {
+		if ( type == DAS_SAX_CLOSE )
+			continue;
+		if ( count == alloc ) {
+			alloc = alloc ? alloc * 2 : 256;
+			struct das_span* tmp = (struct das_span*)realloc( spans, alloc * sizeof( struct das_span ) );
+			if ( tmp == NULL ) {
+				type = DAS_SAX_ERROR;
+				break;
+			}
+			spans = tmp;
+		}
+		if ( das_diff_key( &sax, type, &occ, &key, &nth ) == -1 ||
+				das_map_put( &keys, key, count ) == -1 ) {
+			type = DAS_SAX_ERROR;
+			break;
+		}
+		spans[count].offset = sax.value.offset;
+		spans[count].len = type == DAS_SAX_OPEN ? 0 : sax.value.len;
+		count++;
+	}
+	if ( type == DAS_SAX_ERROR || ( matched = (char*)calloc( count + 1, 1 ) ) == NULL )
+		changes = -1;
+
+	// B against A
+	das_map_free( &occ );
+	if ( changes != -1 && das_map_init( &occ, 256 ) == -1 )
+		changes = -1;
+	if ( changes != -1 ) {
+		das_sax_init( &sax, vb, ob, sb );
+		while ( ( type = das_sax_next( &sax ) ) > DAS_SAX_END ) {
+			if ( type == DAS_SAX_CLOSE )
+				continue;
+			struct das_span value = sax.value;
+			if ( type == DAS_SAX_OPEN )
+				value.len = 0;
+			if ( das_diff_key( &sax, type, &occ, &key, &nth ) == -1 ) {
+				type = DAS_SAX_ERROR;
+				break;
+			}
+			at = das_map_get( &keys, key );
+			if ( at != -1 ) {
+				matched[at] = 1;
+				if ( das_diff_span_eq( va, spans[at], vb, value ) )
+					continue;
+			}
+			das_diff_path( fp, xml, &sax, type, nth );
+			if ( at != -1 )
+				das_diff_put_view( fp, va, spans[at] );
+			else
+				fputc( '-', fp );
+			fputc( '\t', fp );
+			das_diff_put_view( fp, vb, value );
+			fputc( '\n', fp );
+			changes++;
+		}
+		if ( type == DAS_SAX_ERROR )
+			changes = -1;
+	}
+
+	// What only A has, the same walk as before so the paths come back
+	das_map_free( &occ );
+	if ( changes != -1 && das_map_init( &occ, 256 ) == -1 )
+		changes = -1;
+	if ( changes != -1 ) {
+		das_sax_init( &sax, va, oa, sa );
+		for ( at = 0; at < count && ( type = das_sax_next( &sax ) ) > DAS_SAX_END; ) {
+			if ( type == DAS_SAX_CLOSE )
+				continue;
+			if ( das_diff_key( &sax, type, &occ, &key, &nth ) == -1 ) {
+				changes = -1;
+				break;
+			}
+			if ( !matched[at] ) {
+				das_diff_path( fp, xml, &sax, type, nth );
+				das_diff_put_view( fp, va, spans[at] );
+				fputs( "\t-\n", fp );
+				changes++;
+			}
+			at++;
+		}
+	}
+	das_map_free( &occ );
+	das_map_free( &keys );
+	free( spans );
+	free( matched );
+	return( changes );
+
+}
+
+static unsigned char* das_diff_view( const struct das_diff_side* side ) {
+
+	// The whole save read at its face values' shift, so saves stored at
+	// different shifts still line up byte for byte
+	unsigned char* buf = (unsigned char*)malloc( side->file.size );
+	struct das_view view = das_view_init( side->file.data, (int)side->file.size, side->shift );
+	if ( buf == NULL ) {
+		fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+		return( NULL );
+	}
+	das_view_read( &view, 0, buf, (int)side->file.size );
+	return( buf );
+
+}
+
+static size_t das_diff_residue( const unsigned char* data, size_t start, size_t end,
+		const struct das_span* known, int count, unsigned char* out ) {
+
+	// The bytes of [start, end) outside every known region
+	size_t len = 0, at = start;
+	int i = 0;
+	while ( at < end ) {
+		for ( i = 0; i < count; i++ )
+			if ( at >= (size_t)known[i].offset && at < (size_t)known[i].offset + known[i].len )
+				break;
+		if ( i < count )
+			at = (size_t)known[i].offset + known[i].len;
+		else
+			out[len++] = data[at++];
+	}
+	return( len );
+
+}
+
+static int das_diff_raw( FILE* fp, const struct das_diff_side* a, const struct das_diff_side* b ) {
+
+	// Both saves as content defined chunks. Each chunk of B is looked up
+	// among A's chunks after the last match, so matches stay in order and
+	// the whole thing is linear. The gaps between matches are the changes;
+	// one that differs only inside regions diffed above is left out.
+	unsigned char* da = das_diff_view( a );
+	unsigned char* db = das_diff_view( b );
+	unsigned char* ra = NULL;
+	unsigned char* rb = NULL;
+	struct das_chunk* ca = NULL;
+	struct das_chunk* cb = NULL;
+	size_t size_a = a->file.size, size_b = b->file.size, a_end = 0, b_end = 0;
+	int count_a = da ? das_chunks( da, size_a, 64, 256, 1024, 8, &ca ) : -1;
+	int count_b = db ? das_chunks( db, size_b, 64, 256, 1024, 8, &cb ) : -1;
+	int* head = NULL;
+	int* next = NULL;
+	int cap = 16, i = 0, j = 0, cursor = 0, changes = 0;
+	while ( cap < count_a * 2 )
+		cap *= 2;
+	if ( count_a == -1 || count_b == -1 ||
+			( head = (int*)malloc( cap * sizeof( int ) ) ) == NULL ||
+			( next = (int*)malloc( ( count_a + 1 ) * sizeof( int ) ) ) == NULL ||
+			( ra = (unsigned char*)malloc( size_a ) ) == NULL ||
+			( rb = (unsigned char*)malloc( size_b ) ) == NULL ) {
+		changes = -1;
+		count_b = -1;
+	} else {
+		memset( head, 0xFF, cap * sizeof( int ) );
+		for ( i = count_a - 1; i >= 0; i-- ) {
+			int slot = ca[i].hash & ( cap - 1 );
+			next[i] = head[slot];
+			head[slot] = i;
+		}
+	}
+	for ( j = 0; j <= count_b; j++ ) {
+		int match = -1;
+		if ( j < count_b ) {
+			int slot = cb[j].hash & ( cap - 1 ), probe = 0, tries = 0;
+			// Chains are in file order, whatever is behind the cursor is done
+			while ( head[slot] != -1 && head[slot] < cursor )
+				head[slot] = next[head[slot]];
+			for ( probe = head[slot]; probe != -1 && tries < 8; probe = next[probe], tries++ )
+				if ( ca[probe].hash == cb[j].hash && ca[probe].len == cb[j].len &&
+						memcmp( da + ca[probe].offset, db + cb[j].offset, cb[j].len ) == 0 ) {
+					match = probe;
+					break;
+				}
+			if ( match == -1 )
+				continue;
+		}
+		size_t a_start = j < count_b ? ca[match].offset : size_a;
+		size_t b_start = j < count_b ? cb[j].offset : size_b;
+		if ( a_start > a_end || b_start > b_end ) {
+			size_t len_a = das_diff_residue( da, a_end, a_start, a->known, a->known_count, ra );
+			size_t len_b = das_diff_residue( db, b_end, b_start, b->known, b->known_count, rb );
+			if ( len_a != len_b || memcmp( ra, rb, len_a ) != 0 ) {
+				fprintf( fp, "raw\t%.8lX\t%lu\t%.8lX\t%lu\n", (unsigned long)a_end,
+					(unsigned long)( a_start - a_end ), (unsigned long)b_end,
+					(unsigned long)( b_start - b_end ) );
+				changes++;
+			}
+		}
+		if ( j < count_b ) {
+			a_end = ca[match].offset + ca[match].len;
+			b_end = cb[j].offset + cb[j].len;
+			cursor = match + 1;
+		}
+	}
+	free( da );
+	free( db );
+	free( ra );
+	free( rb );
+	free( ca );
+	free( cb );
+	free( head );
+	free( next );
+	return( changes );
+
+}
+
+static int das_diff_load( struct das_diff_side* side, const char* path ) {
+
+	// Face values and XMLs of one save, and room for the regions the
+	// structural diff covers: header, face block, then one per XML
+	struct das_view view;
+	int i = 0, lo = -1, hi = -1;
+	side->xmls = NULL;
+	side->known = NULL;
+	if ( das_file_open( &side->file, path, 0 ) == -1 )
+		return( -1 );
+	side->header = das_read_header( side->file.data, side->file.size );
+	if ( side->header.size == 0 ) {
+		fprintf( stderr, ":: ERROR: %s: Cannot read file header.\n", path );
+		das_file_close( &side->file );
+		return( -1 );
+	}
+	if ( das_find_values( &side->file, side->value, &view ) == -1 ||
+			( side->xml_count = das_find_xmls( side->file.data, (int)side->file.size, &side->xmls ) ) == -1 ||
+			( side->known = (struct das_span*)malloc( ( side->xml_count + 2 ) * sizeof( struct das_span ) ) ) == NULL ) {
+		free( side->xmls );
+		das_file_close( &side->file );
+		return( -1 );
+	}
+	side->shift = view.shift;
+	side->known[0].offset = 0;
+	side->known[0].len = DAS_HEADER_START + side->header.size + 1;
+	for ( i = 0; i < DAS_NUM_VALUES; i++ ) {
+		if ( side->value[i].offset == -1 )
+			continue;
+		if ( lo == -1 || side->value[i].offset < lo )
+			lo = side->value[i].offset;
+		if ( side->value[i].offset > hi )
+			hi = side->value[i].offset;
+	}
+	side->known[1].offset = lo == -1 ? 0 : lo;
+	side->known[1].len = lo == -1 ? 0 : hi + 4 - lo;
+	side->known_count = 2;
+	return( 0 );
+
+}
+
+static void das_diff_free( struct das_diff_side* side ) {
+
+	free( side->xmls );
+	free( side->known );
+	das_file_close( &side->file );
+
+}
+
+static int das_diff_xml_size( const struct das_diff_side* side, int i, struct das_view* view ) {
+
+	// Size of the i-th XML, 0 if its size prefix is bogus
+	*view = das_view_init( side->file.data, (int)side->file.size, side->xmls[i].shift );
+	int offset = side->xmls[i].offset;
+	int size = offset >= 4 ? (int)das_view_read_u32( view, offset - 4 ) : 0;
+	return( size <= 0 || size > (int)side->file.size - offset ? 0 : size );
+
+}
+
+static void das_diff_xml_known( struct das_diff_side* side, int i, int size ) {
+
+	// Size prefix through the last byte. The raw diff reads the save at the
+	// face values' shift, XMLs at another shift aren't covered there.
+	if ( side->xmls[i].shift != side->shift )
+		return;
+	int offset = side->xmls[i].offset - 4;
+	side->known[side->known_count].offset = offset < 0 ? 0 : offset;
+	side->known[side->known_count].len = side->xmls[i].offset + size - side->known[side->known_count].offset;
+	side->known_count++;
+
+}
+
+int das_diff( const char* path_a, const char* path_b, FILE* fp ) {
+
+	// Header items, face values, XMLs, then raw bytes for the rest.
+	// Prints one line per difference, returns their number.
+	struct das_diff_side a, b;
+	struct das_view view_a, view_b;
+	int changes = 0, n = 0, i = 0;
+	if ( das_diff_load( &a, path_a ) == -1 )
+		return( -1 );
+	if ( das_diff_load( &b, path_b ) == -1 ) {
+		das_diff_free( &a );
+		return( -1 );
+	}
+	if ( ( n = das_diff_header( fp, &a.file, &a.header, &b.file, &b.header ) ) == -1 )
+		changes = -1;
+	else
+		changes += n + das_diff_face( fp, a.value, b.value );
+
+	// XMLs pair up by their number, as in the xml_fileNN dumps. One that
+	// doesn't parse is left to the raw diff.
+	for ( i = 0; changes != -1 && ( i < a.xml_count || i < b.xml_count ); i++ ) {
+		int size_a = i < a.xml_count ? das_diff_xml_size( &a, i, &view_a ) : 0;
+		int size_b = i < b.xml_count ? das_diff_xml_size( &b, i, &view_b ) : 0;
+		if ( size_a == 0 || size_b == 0 ) {
+			if ( size_a != 0 || size_b != 0 ) {
+				fprintf( fp, "xml\t%d\t\t", i + 1 );
+				fprintf( fp, size_a ? "%d\t-\n" : "-\t%d\n", size_a ? size_a : size_b );
+				changes++;
+			}
+			continue;
+		}
+		n = das_diff_xml( fp, i + 1, &view_a, a.xmls[i].offset, size_a, &view_b, b.xmls[i].offset, size_b );
+		if ( n == -1 )
+			continue;
+		changes += n;
+		das_diff_xml_known( &a, i, size_a );
+		das_diff_xml_known( &b, i, size_b );
+	}
+
+	if ( changes != -1 ) {
+		n = das_diff_raw( fp, &a, &b );
+		changes = n == -1 ? -1 : changes + n;
+	}
+	das_diff_free( &a );
+	das_diff_free( &b );
+	return( changes );
+
+}
+
+int das_diff_main( int argc, char* argv[] ) {
+
+	// Pairs of saves from argv, or "A<tab>B" lines from stdin with "-".
+	// The differences of each pair come before its status line.
+	char line[8192];
+	int i = 0, total = 0, failed = 0, n = 0;
+	int from_stdin = argc == 1 && strcmp( argv[0], "-" ) == 0;
+	if ( !from_stdin && ( argc == 0 || argc % 2 != 0 ) ) {
+		fprintf( stderr, ":: ERROR: diff takes pairs of files.\n" );
+		das_batch_usage();
+		return( 2 );
+	}
+	for ( ;; ) {
+		const char* path_a = NULL;
+		const char* path_b = NULL;
+		if ( from_stdin ) {
+			if ( fgets( line, sizeof( line ), stdin ) == NULL )
+				break;
+			line[strcspn( line, "\r\n" )] = '\0';
+			char* tab = strchr( line, '\t' );
+			if ( line[0] == '\0' )
+				continue;
+			if ( tab == NULL ) {
+				fprintf( stderr, ":: ERROR: Expected \"A<tab>B\", got \"%s\".\n", line );
+				total++;
+				failed++;
+				continue;
+			}
+			*tab = '\0';
+			path_a = line;
+			path_b = tab + 1;
+		} else {
+			if ( i >= argc )
+				break;
+			path_a = argv[i++];
+			path_b = argv[i++];
+		}
+		total++;
+		if ( ( n = das_diff( path_a, path_b, stdout ) ) == -1 )
+			failed++;
+		if ( n == -1 )
+			printf( "fail\t%s\t%s\t\n", path_a, path_b );
+		else
+			printf( "ok\t%s\t%s\t%d\n", path_a, path_b, n );
+		fflush( stdout );
+	}
+
+	fprintf( stderr, ":: %d of %d pairs processed.\n", total - failed, total );
+	return( failed ? EXIT_FAILURE : EXIT_SUCCESS );
+
+}
+
+static const unsigned int das_sha256_k[64] = {
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+#define DAS_ROR( x, n ) ( ( (x) >> (n) ) | ( (x) << ( 32 - (n) ) ) )
+
+static void das_sha256_block( struct das_sha256* ctx, const unsigned char* p ) {
+
+	unsigned int w[64], s[8], t1 = 0, t2 = 0;
+	int i = 0;
+	for ( i = 0; i < 16; i++ )
+		w[i] = ( (unsigned int)p[i*4] << 24 ) | ( p[i*4+1] << 16 ) | ( p[i*4+2] << 8 ) | p[i*4+3];
+	for ( i = 16; i < 64; i++ )
+		w[i] = w[i-16] + ( DAS_ROR( w[i-15], 7 ) ^ DAS_ROR( w[i-15], 18 ) ^ ( w[i-15] >> 3 ) ) +
+			w[i-7] + ( DAS_ROR( w[i-2], 17 ) ^ DAS_ROR( w[i-2], 19 ) ^ ( w[i-2] >> 10 ) );
+	memcpy( s, ctx->state, sizeof( s ) );
+	for ( i = 0; i < 64; i++ ) {
+		t1 = s[7] + ( DAS_ROR( s[4], 6 ) ^ DAS_ROR( s[4], 11 ) ^ DAS_ROR( s[4], 25 ) ) +
+			( ( s[4] & s[5] ) ^ ( ~s[4] & s[6] ) ) + das_sha256_k[i] + w[i];
+		t2 = ( DAS_ROR( s[0], 2 ) ^ DAS_ROR( s[0], 13 ) ^ DAS_ROR( s[0], 22 ) ) +
+			( ( s[0] & s[1] ) ^ ( s[0] & s[2] ) ^ ( s[1] & s[2] ) );
+		memmove( s + 1, s, 7 * sizeof( unsigned int ) );
+		s[4] += t1;
+		s[0] = t1 + t2;
+	}
+	for ( i = 0; i < 8; i++ )
+		ctx->state[i] += s[i];
+
+}
+
+void das_sha256_init( struct das_sha256* ctx ) {
+
+	static const unsigned int init[8] = {
+		0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+	};
+	memcpy( ctx->state, init, sizeof( init ) );
+	ctx->fill = 0;
+	ctx->len = 0;
+
+}
+
+void das_sha256_update( struct das_sha256* ctx, const unsigned char* data, size_t size ) {
+
+	ctx->len += size;
+	if ( ctx->fill > 0 ) {
+		size_t n = (size_t)( 64 - ctx->fill );
+		if ( n > size )
+			n = size;
+		memcpy( ctx->buf + ctx->fill, data, n );
+		ctx->fill += (int)n;
+		data += n;
+		size -= n;
+		if ( ctx->fill < 64 )
+			return;
+		das_sha256_block( ctx, ctx->buf );
+		ctx->fill = 0;
+	}
+	for ( ; size >= 64; data += 64, size -= 64 )
+		das_sha256_block( ctx, data );
+	memcpy( ctx->buf, data, size );
+	ctx->fill = (int)size;
+
+}
+
+void das_sha256_final( struct das_sha256* ctx, unsigned char out[32] ) {
+
+	// 0x80, zeros, then the length in bits, big endian
+	unsigned long long bits = ctx->len * 8;
+	unsigned char pad[72] = { 0x80 };
+	int i = 0, n = ctx->fill < 56 ? 56 - ctx->fill : 120 - ctx->fill;
+	for ( i = 0; i < 8; i++ )
+		pad[n+i] = (unsigned char)( bits >> ( 56 - 8 * i ) );
+	das_sha256_update( ctx, pad, n + 8 );
+	for ( i = 0; i < 8; i++ ) {
+		out[i*4] = ctx->state[i] >> 24;
+		out[i*4+1] = ctx->state[i] >> 16;
+		out[i*4+2] = ctx->state[i] >> 8;
+		out[i*4+3] = ctx->state[i];
+	}
+
+}
+
+static void das_sha256( const unsigned char* data, size_t size, unsigned char out[32] ) {
+
+	struct das_sha256 ctx;
+	das_sha256_init( &ctx );
+	das_sha256_update( &ctx, data, size );
+	das_sha256_final( &ctx, out );
+
+}
+
+static void das_sha256_hex( const unsigned char sha[32], char hex[65] ) {
+
+	int i = 0;
+	for ( i = 0; i < 32; i++ )
+		sprintf( hex + i * 2, "%.2x", sha[i] );
+
+}
+
+static int das_store_put( const char* dir, const unsigned char* data, size_t size,
+		const unsigned char sha[32] ) {
+
+	// chunks/xx/<sha>, written once. Returns 1 if it is new.
+	char hex[65], path[4096];
+	struct stat sb;
+	das_sha256_hex( sha, hex );
+	snprintf( path, sizeof( path ), "%s/chunks/%.2s/%s", dir, hex, hex );
+	if ( stat( path, &sb ) == 0 && (size_t)sb.st_size == size )
+		return( 0 );
+	snprintf( path, sizeof( path ), "%s/chunks/%.2s", dir, hex );
+	if ( das_mkdir( path ) == -1 )
+		return( -1 );
+	snprintf( path, sizeof( path ), "%s/chunks/%.2s/%s", dir, hex, hex );
+	return( char_to_file( path, (unsigned char*)data, size ) == -1 ? -1 : 1 );
+
+}
+
+int das_archive_file( struct das_store* store, const char* path, char* out, size_t out_size ) {
+
+	// The save read at its first XML's shift is cut into chunks, so the
+	// payload chunks the same whatever shift a save happens to use
+	struct das_file file;
+	struct das_xml_iter it;
+	struct xml_hit hit = { .offset = 0, .shift = 0 };
+	struct das_manifest_head head;
+	struct das_manifest_rec* rec = NULL;
+	unsigned char* buf = NULL;
+	unsigned char* data = NULL;
+	char hex[65], man[4096];
+	const char* base = path;
+	const char* p = NULL;
+	size_t pos = 0, end = 0;
+	long long bytes_new = 0;
+	int count = 0, fresh = 0, ret = 0;
+	if ( das_file_open( &file, path, 0 ) == -1 )
+		return( -1 );
+	das_xml_iter_init( &it, file.data, (int)file.size );
+	if ( !das_xml_iter_next( &it, &hit ) )
+		hit.shift = 0;
+	// The manifest is built in place: head, then a record per chunk
+	if ( ( buf = (unsigned char*)malloc( file.size ) ) == NULL ||
+			( data = (unsigned char*)malloc( sizeof( head ) + ( file.size / DAS_CHUNK_MIN + 2 ) *
+				sizeof( struct das_manifest_rec ) ) ) == NULL ) {
+		fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+		free( buf );
+		das_file_close( &file );
+		return( -1 );
+	}
+	rec = (struct das_manifest_rec*)( data + sizeof( head ) );
+	struct das_view view = das_view_init( file.data, (int)file.size, hit.shift );
+	das_view_read( &view, 0, buf, (int)file.size );
+
+	memset( &head, 0, sizeof( head ) );
+	memcpy( head.magic, DAS_MANIFEST_MAGIC, 8 );
+	head.version = DAS_MANIFEST_VERSION;
+	head.size = file.size;
+	head.shift = hit.shift;
+	das_sha256( file.data, file.size, head.sha );
+	for ( p = path; *p; p++ )
+		if ( *p == '/' || *p == '\\' )
+			base = p + 1;
+	snprintf( head.name, sizeof( head.name ), "%s", base );
+
+	snprintf( man, sizeof( man ), "%s/chunks", store->dir );
+	ret = das_mkdir( store->dir ) == -1 || das_mkdir( man ) == -1 ? -1 : 0;
+	snprintf( man, sizeof( man ), "%s/saves", store->dir );
+	if ( ret == 0 && das_mkdir( man ) == -1 )
+		ret = -1;
+	for ( pos = 0; pos < file.size && ret == 0; pos = end ) {
+		end = das_cdc_next( buf, file.size, pos, DAS_CHUNK_MIN, DAS_CHUNK_AVG, DAS_CHUNK_MAX, DAS_CHUNK_BITS );
+		das_sha256( buf + pos, end - pos, rec[count].sha );
+		rec[count].len = (int)( end - pos );
+		rec[count].reserved = 0;
+		int put = das_store_put( store->dir, buf + pos, end - pos, rec[count].sha );
+		if ( put == -1 )
+			ret = -1;
+		if ( put == 1 ) {
+			fresh++;
+			bytes_new += end - pos;
+		}
+		count++;
+	}
+	head.count = count;
+
+	// The manifest goes last, once every chunk it names is on disk
+	das_sha256_hex( head.sha, hex );
+	snprintf( man, sizeof( man ), "%s/saves/%s.manifest", store->dir, hex );
+	memcpy( data, &head, sizeof( head ) );
+	if ( ret == 0 )
+		ret = char_to_file( man, data, sizeof( head ) + count * sizeof( struct das_manifest_rec ) );
+	if ( ret == 0 ) {
+		pthread_mutex_lock( &store->lock );
+		store->bytes_in += file.size;
+		store->bytes_new += bytes_new;
+		store->chunks += count;
+		store->chunks_new += fresh;
+		pthread_mutex_unlock( &store->lock );
+		snprintf( out, out_size, "%s\t%d chunks, %d new", hex, count, fresh );
+	}
+	free( data );
+	free( buf );
+	das_file_close( &file );
+	return( ret );
+
+}
+
+int das_restore_file( const char* dir, const char* id, const char* out_dir, char* out, size_t out_size ) {
+
+	// A manifest path, or the id archive printed
+	struct das_file man, chunk;
+	struct stat sb;
+	char path[4096], hex[65];
+	unsigned char sha[32];
+	unsigned char* view_buf = NULL;
+	unsigned char* data = NULL;
+	size_t pos = 0, i = 0;
+	int r = 0, ret = 0;
+	if ( stat( id, &sb ) == 0 && S_ISREG( sb.st_mode ) )
+		snprintf( path, sizeof( path ), "%s", id );
+	else
+		snprintf( path, sizeof( path ), "%s/saves/%s.manifest", dir, id );
+	if ( das_file_open( &man, path, 0 ) == -1 )
+		return( -1 );
+	const struct das_manifest_head* head = (const struct das_manifest_head*)man.data;
+	const struct das_manifest_rec* rec = (const struct das_manifest_rec*)( man.data + sizeof( *head ) );
+	if ( man.size < sizeof( *head ) || memcmp( head->magic, DAS_MANIFEST_MAGIC, 8 ) != 0 ||
+			head->version != DAS_MANIFEST_VERSION || head->count < 0 || head->size <= 0 ||
+			head->shift < 0 || head->shift > 7 || memchr( head->name, '\0', sizeof( head->name ) ) == NULL ||
+			man.size != sizeof( *head ) + head->count * sizeof( struct das_manifest_rec ) ) {
+		fprintf( stderr, ":: ERROR: %s is not a save manifest.\n", path );
+		das_file_close( &man );
+		return( -1 );
+	}
+	size_t size = (size_t)head->size;
+	if ( ( view_buf = (unsigned char*)malloc( size ) ) == NULL ||
+			( data = (unsigned char*)malloc( size ) ) == NULL ) {
+		fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+		free( view_buf );
+		das_file_close( &man );
+		return( -1 );
+	}
+
+	// Chunks back to back give the save as it was read at head->shift
+	for ( r = 0; r < head->count && ret == 0; r++ ) {
+		das_sha256_hex( rec[r].sha, hex );
+		snprintf( path, sizeof( path ), "%s/chunks/%.2s/%s", dir, hex, hex );
+		if ( das_file_open( &chunk, path, 0 ) == -1 ) {
+			ret = -1;
+			break;
+		}
+		if ( chunk.size != (size_t)rec[r].len || pos + chunk.size > size ) {
+			fprintf( stderr, ":: ERROR: Chunk %s is damaged.\n", hex );
+			ret = -1;
+		} else {
+			memcpy( view_buf + pos, chunk.data, chunk.size );
+			pos += chunk.size;
+		}
+		das_file_close( &chunk );
+	}
+	if ( ret == 0 && pos != size ) {
+		fprintf( stderr, ":: ERROR: %s is missing chunks.\n", id );
+		ret = -1;
+	}
+
+	// Undo the shift: file byte i is view byte i's low bits on top, the
+	// next view byte's high bits below (the last wraps to the first)
+	int s = head->shift;
+	for ( i = 0; i < size && ret == 0; i++ )
+		data[i] = s == 0 ? view_buf[i] : (unsigned char)( ( view_buf[i] << s ) |
+			( view_buf[i + 1 < size ? i + 1 : 0] >> ( 8 - s ) ) );
+	if ( ret == 0 ) {
+		das_sha256( data, size, sha );
+		if ( memcmp( sha, head->sha, 32 ) != 0 ) {
+			fprintf( stderr, ":: ERROR: %s doesn't restore to the archived save.\n", id );
+			ret = -1;
+		}
+	}
+	if ( ret == 0 ) {
+		if ( out_dir != NULL )
+			snprintf( out, out_size, "%s/%s", out_dir, head->name );
+		else
+			snprintf( out, out_size, "%s", head->name );
+		// Never over a save that is already there
+		if ( stat( out, &sb ) == 0 ) {
+			fprintf( stderr, ":: ERROR: \"%s\" already exists.\n", out );
+			ret = -1;
+		} else {
+			ret = char_to_file( out, data, size );
+		}
+	}
+	free( view_buf );
+	free( data );
+	das_file_close( &man );
+	return( ret );
+
+}
+
+void das_stats_add( struct das_stats_sum* sum, const char* path, int ret, const struct das_stats* stats ) {
+
+	// Reported as each file finishes, so with -j the order is completion order
+	int i = 0;
+	pthread_mutex_lock( &sum->lock );
+	sum->files++;
+	if ( ret != 0 )
+		sum->failed++;
+	for ( i = 0; i < DAS_NUM_STAGES; i++ )
+		sum->total.time[i] += stats->time[i];
+	sum->total.bytes_read += stats->bytes_read;
+	sum->total.bytes_scanned += stats->bytes_scanned;
+	sum->total.bytes_written += stats->bytes_written;
+	sum->total.anchors += stats->anchors;
+	sum->total.xmls += stats->xmls;
+	sum->total.allocs += stats->allocs;
+	if ( stats->shift >= 0 && stats->shift < 8 )
+		sum->shifts[stats->shift]++;
+	das_stats_print( sum, path, ret, stats );
+	pthread_mutex_unlock( &sum->lock );
+
+}
+
+static void das_json_mem( FILE* fp, const unsigned char* data, size_t len ) {
+
+	size_t i = 0;
+	fputc( '"', fp );
+	for ( i = 0; i < len; i++ ) {
+		if ( data[i] == '"' || data[i] == '\\' )
+			fprintf( fp, "\\%c", data[i] );
+		else if ( data[i] < 0x20 )
+			fprintf( fp, "\\u%.4x", data[i] );
+		else
+			fputc( data[i], fp );
+	}
+	fputc( '"', fp );
+
+}
+
+static void das_json_str( FILE* fp, const char* str ) {
+
+	das_json_mem( fp, (const unsigned char*)str, strlen( str ) );
+
+}
+
+void das_stats_print( const struct das_stats_sum* sum, const char* path, int ret, const struct das_stats* stats ) {
+
+	// One file, or the totals when path is NULL
+	static const char* stages[DAS_NUM_STAGES] = { "open", "align", "values", "xml", "write" };
+	int i = 0;
+	if ( sum->text ) {
+		if ( path != NULL )
+			fprintf( stderr, "::  %s:", path );
+		else
+			fprintf( stderr, "::  %d files (%d failed):", sum->files, sum->failed );
+		for ( i = 0; i < DAS_NUM_STAGES; i++ )
+			fprintf( stderr, "%s %s %.3f ms", i ? "," : "", stages[i], stats->time[i] * 1e3 );
+		fprintf( stderr, "; read %.2f MB, scanned %.2f MB, written %.2f MB; ",
+			stats->bytes_read / 1e6, stats->bytes_scanned / 1e6, stats->bytes_written / 1e6 );
+		if ( path != NULL ) {
+			fprintf( stderr, "shift %d, ", stats->shift );
+		} else {
+			fprintf( stderr, "shifts" );
+			for ( i = 0; i < 8; i++ )
+				if ( sum->shifts[i] )
+					fprintf( stderr, " %d:%d", i, sum->shifts[i] );
+			fprintf( stderr, ", " );
+		}
+		fprintf( stderr, "%d anchors, %d xmls, %d allocs\n", stats->anchors, stats->xmls, stats->allocs );
+	}
+	if ( sum->json != NULL ) {
+		if ( path != NULL ) {
+			fprintf( sum->json, "{\"file\":" );
+			das_json_str( sum->json, path );
+			fprintf( sum->json, ",\"ok\":%s", ret == 0 ? "true" : "false" );
+		} else {
+			fprintf( sum->json, "{\"total\":true,\"files\":%d,\"failed\":%d", sum->files, sum->failed );
+		}
+		for ( i = 0; i < DAS_NUM_STAGES; i++ )
+			fprintf( sum->json, ",\"%s_ms\":%.3f", stages[i], stats->time[i] * 1e3 );
+		fprintf( sum->json, ",\"bytes_read\":%lld,\"bytes_scanned\":%lld,\"bytes_written\":%lld",
+			stats->bytes_read, stats->bytes_scanned, stats->bytes_written );
+		if ( path != NULL ) {
+			fprintf( sum->json, ",\"shift\":%d", stats->shift );
+		} else {
+			fprintf( sum->json, ",\"shifts\":[" );
+			for ( i = 0; i < 8; i++ )
+				fprintf( sum->json, "%s%d", i ? "," : "", sum->shifts[i] );
+			fprintf( sum->json, "]" );
+		}
+		fprintf( sum->json, ",\"anchors\":%d,\"xmls\":%d,\"allocs\":%d}\n",
+			stats->anchors, stats->xmls, stats->allocs );
+	}
+
+}
+
+#ifdef __linux__
+static unsigned long long das_cache_key( dev_t dev, ino_t ino ) {
+
+	return( ( (unsigned long long)dev << 40 ) ^ (unsigned long long)ino );
+
+}
+
+static int das_cache_same( const struct das_cache_entry* e, const struct stat* sb ) {
+
+	return( e->dev == sb->st_dev && e->ino == sb->st_ino && e->size == sb->st_size &&
+		e->mtime.tv_sec == sb->st_mtim.tv_sec && e->mtime.tv_nsec == sb->st_mtim.tv_nsec );
+
+}
+
+static void das_cache_entry_free( struct das_cache_entry* e ) {
+
+	das_file_close( &e->file );
+	free( e->xml );
+	free( e );
+
+}
+
+static int das_cache_init( struct das_cache* cache, int cap, int workers ) {
+
+	// Every worker holds at most one entry, so cap + workers slots always
+	// leave room for a new one once the unused ones are evicted
+	pthread_mutex_init( &cache->lock, NULL );
+	cache->cap = cap;
+	cache->slots = cap + workers;
+	cache->count = 0;
+	cache->head = NULL;
+	cache->tail = NULL;
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->slot = (struct das_cache_entry**)calloc( cache->slots, sizeof( struct das_cache_entry* ) );
+	if ( cache->slot == NULL ) {
+		fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+		return( -1 );
+	}
+	if ( das_map_init( &cache->map, cache->slots ) == -1 ) {
+		free( cache->slot );
+		return( -1 );
+	}
+	return( 0 );
+
+}
+
+static void das_cache_unlink( struct das_cache* cache, struct das_cache_entry* e ) {
+
+	if ( e->prev != NULL )
+		e->prev->next = e->next;
+	else
+		cache->head = e->next;
+	if ( e->next != NULL )
+		e->next->prev = e->prev;
+	else
+		cache->tail = e->prev;
+	e->prev = NULL;
+	e->next = NULL;
+
+}
+
+static void das_cache_push( struct das_cache* cache, struct das_cache_entry* e ) {
+
+	e->prev = NULL;
+	e->next = cache->head;
+	if ( cache->head != NULL )
+		cache->head->prev = e;
+	else
+		cache->tail = e;
+	cache->head = e;
+
+}
+
+static void das_cache_drop( struct das_cache* cache, struct das_cache_entry* e ) {
+
+	// Called locked. Entries still in use are freed by their last user
+	das_map_del( &cache->map, e->key );
+	cache->slot[e->slot] = NULL;
+	das_cache_unlink( cache, e );
+	cache->count--;
+	e->slot = -1;
+	if ( e->refs == 0 )
+		das_cache_entry_free( e );
+
+}
+
+static void das_cache_free( struct das_cache* cache ) {
+
+	while ( cache->head != NULL )
+		das_cache_drop( cache, cache->head );
+	das_map_free( &cache->map );
+	free( cache->slot );
+	pthread_mutex_destroy( &cache->lock );
+
+}
+
+static struct das_cache_entry* das_cache_load( const char* path, const struct stat* sb, const char** error ) {
+
+	// Header, face value offsets and XML places, everything a request
+	// reads without going back to the file
+	int hit_count = 0, i = 0;
+	struct xml_hit* hits = NULL;
+	struct das_view view;
+	struct das_cache_entry* e = (struct das_cache_entry*)calloc( 1, sizeof( struct das_cache_entry ) );
+	if ( e == NULL ) {
+		*error = "Memory allocation error";
+		return( NULL );
+	}
+	e->key = das_cache_key( sb->st_dev, sb->st_ino );
+	e->dev = sb->st_dev;
+	e->ino = sb->st_ino;
+	e->size = sb->st_size;
+	e->mtime = sb->st_mtim;
+	e->slot = -1;
+	if ( das_file_open( &e->file, path, 0 ) == -1 ) {
+		*error = "Cannot open file";
+		free( e );
+		return( NULL );
+	}
+	if ( e->file.size > 2000000 || e->file.size < 100000 ) {
+		*error = "File size is off. Not a save file";
+		das_cache_entry_free( e );
+		return( NULL );
+	}
+	e->header = das_read_header( e->file.data, e->file.size );
+	if ( e->header.size == 0 ) {
+		*error = "Cannot read file header";
+		das_cache_entry_free( e );
+		return( NULL );
+	}
+	if ( ( hit_count = das_find_xmls( e->file.data, (int)e->file.size, &hits ) ) == -1 ||
+			( e->xml = (struct das_cache_xml*)malloc( ( hit_count + 1 ) * sizeof( struct das_cache_xml ) ) ) == NULL ) {
+		*error = "Memory allocation error";
+		free( hits );
+		das_cache_entry_free( e );
+		return( NULL );
+	}
+	e->face = das_face_scan( &e->file, hits, hit_count, e->value, &view ) == 0;
+	e->shift = e->face ? view.shift : -1;
+
+	// Only hits with a size that fits the file are XMLs, like das_dump_xmls
+	for ( i = 0; i < hit_count; i++ ) {
+		struct das_view xv = das_view_init( e->file.data, (int)e->file.size, hits[i].shift );
+		int size = hits[i].offset >= 4 ? (int)das_view_read_u32( &xv, hits[i].offset - 4 ) : 0;
+		if ( size <= 0 || size > (int)e->file.size - hits[i].offset )
+			continue;
+		e->xml[e->xml_count].offset = hits[i].offset;
+		e->xml[e->xml_count].shift = hits[i].shift;
+		e->xml[e->xml_count].size = size;
+		e->xml_count++;
+	}
+	free( hits );
+	return( e );
+
+}
+
+static struct das_cache_entry* das_cache_get( struct das_cache* cache, const char* path, const char** error ) {
+
+	// The entry for path with a reference held, parsed again when the
+	// file is not the one that was cached
+	struct stat sb;
+	struct das_cache_entry* e = NULL;
+	struct das_cache_entry* p = NULL;
+	int slot = -1;
+	if ( stat( path, &sb ) == -1 ) {
+		*error = "Cannot stat file";
+		return( NULL );
+	}
+	if ( !S_ISREG( sb.st_mode ) ) {
+		*error = "Not a file";
+		return( NULL );
+	}
+	unsigned long long key = das_cache_key( sb.st_dev, sb.st_ino );
+	pthread_mutex_lock( &cache->lock );
+	if ( ( slot = das_map_get( &cache->map, key ) ) != -1 ) {
+		e = cache->slot[slot];
+		if ( das_cache_same( e, &sb ) ) {
+			e->refs++;
+			das_cache_unlink( cache, e );
+			das_cache_push( cache, e );
+			cache->hits++;
+			pthread_mutex_unlock( &cache->lock );
+			return( e );
+		}
+		das_cache_drop( cache, e );
 	}
+	cache->misses++;
+	pthread_mutex_unlock( &cache->lock );
 
-	// Shift the bits back to the original
-	unsigned char tbit = ( data[filesize - 1] << 8 ) | data[0];
-	for ( i = 0; i < filesize - 1; i++ )
-		data[i] = ( data[i] << 8 ) | data[i+1];
-	data[filesize - 1] = tbit;
+	// Parsed unlocked, other requests go on meanwhile
+	if ( ( e = das_cache_load( path, &sb, error ) ) == NULL )
+		return( NULL );
+	e->refs = 1;
+	pthread_mutex_lock( &cache->lock );
 
-	// Write the xmls to file
-	// The xml is unformatted, we will add newlines, but thats it for now.
-	for ( i = 0; i < xml_count; i++ ) {
-		char fname[16];
-		snprintf( fname, 16, "xml_file%.2d.xml", i + 1 );
-		xml_mem_to_file( xml.data[i], xml.size[i], fname );
+	// Another worker may have loaded the same file in the meantime
+	if ( ( slot = das_map_get( &cache->map, key ) ) != -1 ) {
+		p = cache->slot[slot];
+		if ( das_cache_same( p, &sb ) ) {
+			p->refs++;
+			pthread_mutex_unlock( &cache->lock );
+			das_cache_entry_free( e );
+			return( p );
+		}
+		das_cache_drop( cache, p );
 	}
 
-	// Cleanup and return
-	int return_val = xml.shift_amount[0];
-	for ( i = 0; i < xml_count; i++ )
-		free( xml.data[i] );
-	free( xml.size );
-	free( xml.offset );
-	free( xml.shift_amount );
-	free( xml.data );
-	return( return_val );
-
-}
\ No newline at end of file
+	// Evict from the cold end, skipping entries in use
+	for ( p = cache->tail; p != NULL && cache->count >= cache->cap; ) {
+		struct das_cache_entry* prev = p->prev;
+		if ( p->refs == 0 )
+			das_cache_drop( cache, p );
+		p = prev;
+	}
+	for ( slot = 0; slot < cache->slots; slot++ )
+		if ( cache->slot[slot] == NULL )
+			break;
+	if ( slot < cache->slots && das_map_put( &cache->map, key, slot ) == 0 ) {
+		cache->slot[slot] = e;
+		e->slot = slot;
+		das_cache_push( cache, e );
+		cache->count++;
+	}
+	pthread_mutex_unlock( &cache->lock );
+	return( e );
+
+}
+
+static void das_cache_release( struct das_cache* cache, struct das_cache_entry* e ) {
+
+	pthread_mutex_lock( &cache->lock );
+	int gone = --e->refs == 0 && e->slot == -1;
+	pthread_mutex_unlock( &cache->lock );
+	if ( gone )
+		das_cache_entry_free( e );
+
+}
+
+static void das_utf8_put( char** out, char* end, unsigned int c ) {
+
+	// \uXXXX of a request string, surrogates are taken as they are
+	char buf[3];
+	int len = 0, i = 0;
+	if ( c < 0x80 ) {
+		buf[len++] = (char)c;
+	} else if ( c < 0x800 ) {
+		buf[len++] = (char)( 0xC0 | ( c >> 6 ) );
+		buf[len++] = (char)( 0x80 | ( c & 0x3F ) );
+	} else {
+		buf[len++] = (char)( 0xE0 | ( c >> 12 ) );
+		buf[len++] = (char)( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+		buf[len++] = (char)( 0x80 | ( c & 0x3F ) );
+	}
+	for ( i = 0; i < len && *out < end; i++ )
+		*( *out )++ = buf[i];
+
+}
+
+static const char* das_request_string( const char* p, char* out, size_t size ) {
+
+	// p is past the opening quote. Returns the end, or NULL if the string
+	// is bad or doesn't fit
+	char* o = out;
+	char* end = out + size - 1;
+	while ( *p != '"' ) {
+		if ( *p == '\0' || (unsigned char)*p < 0x20 || o >= end )
+			return( NULL );
+		if ( *p != '\\' ) {
+			*o++ = *p++;
+			continue;
+		}
+		p++;
+		switch ( *p ) {
+			case '"': case '\\': case '/':
+				*o++ = *p;
+				break;
+			case 'b': *o++ = '\b'; break;
+			case 'f': *o++ = '\f'; break;
+			case 'n': *o++ = '\n'; break;
+			case 'r': *o++ = '\r'; break;
+			case 't': *o++ = '\t'; break;
+			case 'u': {
+				unsigned int c = 0;
+				int i = 0;
+				for ( i = 1; i <= 4; i++ ) {
+					if ( !isxdigit( (unsigned char)p[i] ) )
+						return( NULL );
+					c = c * 16 + ( isdigit( (unsigned char)p[i] ) ? p[i] - '0' : ( p[i] | 0x20 ) - 'a' + 10 );
+				}
+				if ( c == 0 )
+					return( NULL );
+				das_utf8_put( &o, end, c );
+				p += 4;
+				break;
+			}
+			default:
+				return( NULL );
+		}
+		p++;
+	}
+	*o = '\0';
+	return( p + 1 );
+
+}
+
+static int das_request_parse( const char* line, struct das_request* req ) {
+
+	// One flat JSON object: string keys, values that are strings, numbers,
+	// true, false or null. Non string values are kept as written
+	const char* p = line;
+	req->count = 0;
+	while ( isspace( (unsigned char)*p ) )
+		p++;
+	if ( *p++ != '{' )
+		return( -1 );
+	while ( isspace( (unsigned char)*p ) )
+		p++;
+	if ( *p == '}' )
+		return( 0 );
+	for ( ;; ) {
+		if ( req->count == DAS_SERVE_FIELDS )
+			return( -1 );
+		int n = req->count;
+		while ( isspace( (unsigned char)*p ) )
+			p++;
+		if ( *p != '"' || ( p = das_request_string( p + 1, req->key[n], sizeof( req->key[n] ) ) ) == NULL )
+			return( -1 );
+		while ( isspace( (unsigned char)*p ) )
+			p++;
+		if ( *p++ != ':' )
+			return( -1 );
+		while ( isspace( (unsigned char)*p ) )
+			p++;
+		if ( *p == '"' ) {
+			if ( ( p = das_request_string( p + 1, req->value[n], sizeof( req->value[n] ) ) ) == NULL )
+				return( -1 );
+			req->string[n] = 1;
+		} else {
+			size_t len = strcspn( p, ",} \t\r\n" );
+			if ( len == 0 || len >= sizeof( req->value[n] ) )
+				return( -1 );
+			memcpy( req->value[n], p, len );
+			req->value[n][len] = '\0';
+			req->string[n] = 0;
+			p += len;
+		}
+		req->count++;
+		while ( isspace( (unsigned char)*p ) )
+			p++;
+		if ( *p == '}' )
+			break;
+		if ( *p++ != ',' )
+			return( -1 );
+	}
+	p++;
+	while ( isspace( (unsigned char)*p ) )
+		p++;
+	return( *p == '\0' ? 0 : -1 );
+
+}
+
+static const char* das_request_get( const struct das_request* req, const char* key ) {
+
+	int i = 0;
+	for ( i = 0; i < req->count; i++ )
+		if ( strcmp( req->key[i], key ) == 0 )
+			return( req->value[i] );
+	return( NULL );
+
+}
+
+static void das_json_float( FILE* fp, float val ) {
+
+	if ( isfinite( val ) )
+		fprintf( fp, "%.9g", val );
+	else
+		fputs( "null", fp );
+
+}
+
+static const char* das_serve_header( const struct das_cache_entry* e, FILE* fp ) {
+
+	const struct header* h = &e->header;
+	int i = 0;
+	fputs( ",\"name\":", fp );
+	das_json_str( fp, h->player_name );
+	fputs( ",\"race\":", fp );
+	das_json_str( fp, h->player_race );
+	fputs( ",\"gender\":", fp );
+	das_json_str( fp, h->player_gender );
+	fputs( ",\"class\":", fp );
+	das_json_str( fp, h->player_class );
+	fprintf( fp, ",\"level\":%d,\"location\":", h->player_level );
+	das_json_str( fp, h->player_location );
+	fputs( ",\"area\":", fp );
+	das_json_str( fp, h->area_id );
+	fputs( ",\"player_id\":", fp );
+	das_json_str( fp, h->player_id );
+	fputs( ",\"build\":", fp );
+	das_json_str( fp, h->build_number );
+	fprintf( fp, ",\"patch\":%d,\"play_time\":", h->patch_number );
+	das_json_float( fp, h->total_play_time );
+	fprintf( fp, ",\"timestamp\":%lld,\"items\":%d,\"checksum\":%u,\"data_checksum\":%u,\"addons\":[",
+		h->timestamp, h->item_count, (unsigned int)h->checksum, (unsigned int)h->data_checksum );
+	for ( i = 0; i < h->addon_count; i++ ) {
+		if ( i > 0 )
+			fputc( ',', fp );
+		das_json_str( fp, h->addons[i] );
+	}
+	fputc( ']', fp );
+	return( NULL );
+
+}
+
+static const char* das_serve_face( const struct das_cache_entry* e, FILE* fp ) {
+
+	int i = 0, n = 0;
+	if ( !e->face )
+		return( "Could not find face data" );
+	fprintf( fp, ",\"shift\":%d,\"values\":[", e->shift );
+	for ( i = 0; i < DAS_NUM_VALUES; i++ ) {
+		if ( e->value[i].offset == -1 )
+			continue;
+		fprintf( fp, "%s{\"id\":%d,\"name\":", n++ ? "," : "", i );
+		das_json_str( fp, e->value[i].name );
+		fputs( ",\"value\":", fp );
+		das_json_float( fp, e->value[i].fp_val );
+		fputc( '}', fp );
+	}
+	fputc( ']', fp );
+	return( NULL );
+
+}
+
+static const char* das_serve_xml( const struct das_cache_entry* e, const struct das_request* req, FILE* fp ) {
+
+	// Every XML, or only "index"
+	const char* arg = das_request_get( req, "index" );
+	int first = 0, last = e->xml_count, i = 0;
+	if ( arg != NULL ) {
+		first = atoi( arg );
+		if ( first < 0 || first >= e->xml_count )
+			return( "XML index out of range" );
+		last = first + 1;
+	}
+	fputs( ",\"xmls\":[", fp );
+	for ( i = first; i < last; i++ ) {
+		const struct das_cache_xml* xml = &e->xml[i];
+		unsigned char* buf = (unsigned char*)malloc( xml->size );
+		if ( buf == NULL )
+			return( "Memory allocation error" );
+		struct das_view view = das_view_init( e->file.data, (int)e->file.size, xml->shift );
+		das_view_read( &view, xml->offset, buf, xml->size );
+		fprintf( fp, "%s{\"index\":%d,\"offset\":%d,\"shift\":%d,\"xml\":", i > first ? "," : "",
+			i, xml->offset, xml->shift );
+		das_json_mem( fp, buf, xml->size );
+		fputc( '}', fp );
+		free( buf );
+	}
+	fputc( ']', fp );
+	return( NULL );
+
+}
+
+static const char* das_serve_apply( const struct das_cache_entry* e, const char* path,
+		const struct das_request* req, FILE* fp ) {
+
+	// The cached offsets say where the preset goes, only the copy that
+	// is written is opened again
+	const char* preset_path = das_request_get( req, "preset" );
+	const char* out_arg = das_request_get( req, "out" );
+	const char* fix = das_request_get( req, "fix_checksums" );
+	struct das_face_preset preset;
+	struct das_face_write writes[DAS_NUM_VALUES];
+	struct das_file file;
+	char out[4096];
+	if ( preset_path == NULL )
+		return( "Missing \"preset\"" );
+	if ( !e->face )
+		return( "Could not find face data" );
+	if ( das_face_load( preset_path, &preset ) == -1 )
+		return( "Cannot read preset" );
+	if ( out_arg != NULL )
+		snprintf( out, sizeof( out ), "%s", out_arg );
+	else
+		das_out_path( out, sizeof( out ), NULL, path, ".NEW" );
+	if ( das_file_open( &file, path, 1 ) == -1 )
+		return( "Cannot open file" );
+	if ( file.size != e->file.size ) {
+		das_file_close( &file );
+		return( "File changed while reading" );
+	}
+	struct das_view view = das_view_init( file.data, (int)file.size, e->shift );
+	view.file = &file;
+	int count = das_face_resolve( &preset, e->value, writes );
+	das_face_apply( &view, writes, count );
+	if ( fix != NULL && strcmp( fix, "true" ) == 0 && das_checksum_fix( &file ) == -1 ) {
+		das_file_close( &file );
+		return( "Cannot fix checksums" );
+	}
+	int ret = das_file_write( &file, out );
+	das_file_close( &file );
+	if ( ret == -1 )
+		return( "Cannot write file" );
+	fprintf( fp, ",\"writes\":%d,\"out\":", count );
+	das_json_str( fp, out );
+	return( NULL );
+
+}
+
+static void das_serve_handle( struct das_server* server, const char* line, FILE* fp ) {
+
+	// {"id":..,"ok":true,...} or {"id":..,"ok":false,"error":"..."}, the
+	// id is echoed as it was sent
+	struct das_request req;
+	struct das_cache_entry* e = NULL;
+	const char* error = NULL;
+	char* body = NULL;
+	size_t body_len = 0;
+	int i = 0;
+	if ( das_request_parse( line, &req ) == -1 ) {
+		fputs( "{\"ok\":false,\"error\":\"Bad request\"}\n", fp );
+		return;
+	}
+	fputc( '{', fp );
+	for ( i = 0; i < req.count; i++ ) {
+		if ( strcmp( req.key[i], "id" ) != 0 )
+			continue;
+		fputs( "\"id\":", fp );
+		if ( req.string[i] )
+			das_json_str( fp, req.value[i] );
+		else
+			fputs( req.value[i], fp );
+		fputc( ',', fp );
+		break;
+	}
+	FILE* out = open_memstream( &body, &body_len );
+	if ( out == NULL ) {
+		fputs( "\"ok\":false,\"error\":\"Memory allocation error\"}\n", fp );
+		return;
+	}
+	const char* cmd = das_request_get( &req, "cmd" );
+	const char* path = das_request_get( &req, "path" );
+	if ( cmd == NULL ) {
+		error = "Missing \"cmd\"";
+	} else if ( strcmp( cmd, "ping" ) == 0 ) {
+	} else if ( strcmp( cmd, "stats" ) == 0 ) {
+		pthread_mutex_lock( &server->cache.lock );
+		fprintf( out, ",\"workers\":%d,\"cached\":%d,\"cache\":%d,\"hits\":%lld,\"misses\":%lld",
+			server->workers, server->cache.count, server->cache.cap, server->cache.hits,
+			server->cache.misses );
+		pthread_mutex_unlock( &server->cache.lock );
+	} else if ( strcmp( cmd, "header" ) != 0 && strcmp( cmd, "face" ) != 0 &&
+			strcmp( cmd, "xml" ) != 0 && strcmp( cmd, "apply" ) != 0 ) {
+		error = "Unknown command";
+	} else if ( path == NULL ) {
+		error = "Missing \"path\"";
+	} else if ( ( e = das_cache_get( &server->cache, path, &error ) ) != NULL ) {
+		if ( strcmp( cmd, "header" ) == 0 )
+			error = das_serve_header( e, out );
+		else if ( strcmp( cmd, "face" ) == 0 )
+			error = das_serve_face( e, out );
+		else if ( strcmp( cmd, "xml" ) == 0 )
+			error = das_serve_xml( e, &req, out );
+		else
+			error = das_serve_apply( e, path, &req, out );
+		das_cache_release( &server->cache, e );
+	}
+	fclose( out );
+	if ( error != NULL ) {
+		fputs( "\"ok\":false,\"error\":", fp );
+		das_json_str( fp, error );
+	} else {
+		fputs( "\"ok\":true", fp );
+		fwrite( body, 1, body_len, fp );
+	}
+	fputs( "}\n", fp );
+	free( body );
+
+}
+
+static void* das_serve_worker( void* arg ) {
+
+	struct das_server* server = (struct das_server*)arg;
+	for ( ;; ) {
+		pthread_mutex_lock( &server->lock );
+		while ( server->head == NULL && !server->stop )
+			pthread_cond_wait( &server->cond, &server->lock );
+		struct das_job* job = server->head;
+		if ( job == NULL ) {
+			pthread_mutex_unlock( &server->lock );
+			break;
+		}
+		if ( ( server->head = job->next ) == NULL )
+			server->tail = NULL;
+		pthread_mutex_unlock( &server->lock );
+
+		char* reply = NULL;
+		size_t len = 0;
+		FILE* fp = open_memstream( &reply, &len );
+		if ( fp != NULL ) {
+			das_serve_handle( server, job->line, fp );
+			fclose( fp );
+		}
+
+		// Replies are queued as their jobs finish, so with -j above 1 a
+		// connection gets them out of request order (clients match them by
+		// id). The job's reference to the connection moves to the ready list
+		struct das_conn* conn = job->conn;
+		pthread_mutex_lock( &server->lock );
+		conn->jobs--;
+		if ( reply != NULL && !conn->closed ) {
+			if ( conn->out_len + len > conn->out_alloc ) {
+				size_t alloc = conn->out_alloc ? conn->out_alloc : 4096;
+				while ( alloc < conn->out_len + len )
+					alloc *= 2;
+				char* tmp = (char*)realloc( conn->out, alloc );
+				if ( tmp != NULL ) {
+					conn->out = tmp;
+					conn->out_alloc = alloc;
+				}
+			}
+			if ( conn->out_len + len <= conn->out_alloc ) {
+				memcpy( conn->out + conn->out_len, reply, len );
+				conn->out_len += len;
+			}
+		}
+		if ( !conn->ready ) {
+			conn->ready = 1;
+			conn->ready_next = server->ready;
+			server->ready = conn;
+		} else {
+			conn->refs--;
+		}
+		pthread_mutex_unlock( &server->lock );
+		unsigned long long one = 1;
+		if ( write( server->wake_fd, &one, sizeof( one ) ) == -1 && errno != EAGAIN )
+			fprintf( stderr, ":: ERROR: Cannot wake the event loop.\n" );
+		free( reply );
+		free( job->line );
+		free( job );
+	}
+	return( NULL );
+
+}
+
+static void das_conn_unref( struct das_server* server, struct das_conn* conn ) {
+
+	pthread_mutex_lock( &server->lock );
+	int gone = --conn->refs == 0;
+	pthread_mutex_unlock( &server->lock );
+	if ( gone ) {
+		free( conn->in );
+		free( conn->out );
+		free( conn );
+	}
+
+}
+
+static void das_conn_close( struct das_server* server, struct das_conn* conn ) {
+
+	// Replies still being worked on are dropped when they arrive
+	epoll_ctl( server->epfd, EPOLL_CTL_DEL, conn->fd, NULL );
+	close( conn->fd );
+	pthread_mutex_lock( &server->lock );
+	conn->closed = 1;
+	pthread_mutex_unlock( &server->lock );
+	if ( conn->prev != NULL )
+		conn->prev->next = conn->next;
+	else
+		server->conns = conn->next;
+	if ( conn->next != NULL )
+		conn->next->prev = conn->prev;
+	das_conn_unref( server, conn );
+
+}
+
+static void das_conn_flush( struct das_server* server, struct das_conn* conn ) {
+
+	// Send what fits, wait for EPOLLOUT for the rest. Closed once the
+	// client hung up and every reply went out
+	int broken = 0, done = 0;
+	pthread_mutex_lock( &server->lock );
+	while ( conn->out_sent < conn->out_len ) {
+		ssize_t n = send( conn->fd, conn->out + conn->out_sent, conn->out_len - conn->out_sent,
+			MSG_NOSIGNAL | MSG_DONTWAIT );
+		if ( n > 0 )
+			conn->out_sent += n;
+		else if ( n == -1 && errno == EINTR )
+			continue;
+		else {
+			broken = n == -1 && errno != EAGAIN && errno != EWOULDBLOCK;
+			break;
+		}
+	}
+	if ( conn->out_sent == conn->out_len )
+		conn->out_sent = conn->out_len = 0;
+	int events = ( conn->eof ? 0 : EPOLLIN ) | ( conn->out_len > 0 ? EPOLLOUT : 0 );
+	done = broken || ( conn->eof && conn->jobs == 0 && conn->out_len == 0 );
+	pthread_mutex_unlock( &server->lock );
+	if ( done ) {
+		das_conn_close( server, conn );
+	} else if ( events != conn->events ) {
+		struct epoll_event ev = { .events = events, .data.ptr = conn };
+		epoll_ctl( server->epfd, EPOLL_CTL_MOD, conn->fd, &ev );
+		conn->events = events;
+	}
+
+}
+
+static int das_conn_queue( struct das_server* server, struct das_conn* conn, const char* line, int len ) {
+
+	struct das_job* job = (struct das_job*)malloc( sizeof( struct das_job ) );
+	char* copy = (char*)malloc( len + 1 );
+	if ( job == NULL || copy == NULL ) {
+		free( job );
+		free( copy );
+		return( -1 );
+	}
+	memcpy( copy, line, len );
+	copy[len] = '\0';
+	job->conn = conn;
+	job->line = copy;
+	job->next = NULL;
+	pthread_mutex_lock( &server->lock );
+	conn->refs++;
+	conn->jobs++;
+	if ( server->tail != NULL )
+		server->tail->next = job;
+	else
+		server->head = job;
+	server->tail = job;
+	pthread_cond_signal( &server->cond );
+	pthread_mutex_unlock( &server->lock );
+	return( 0 );
+
+}
+
+static void das_conn_read( struct das_server* server, struct das_conn* conn ) {
+
+	// Every complete line is a request, a line that never ends within
+	// DAS_SERVE_LINE_MAX ends the connection
+	for ( ;; ) {
+		if ( conn->in_len == DAS_SERVE_LINE_MAX ) {
+			static const char msg[] = "{\"ok\":false,\"error\":\"Request too long\"}\n";
+			pthread_mutex_lock( &server->lock );
+			char* tmp = (char*)realloc( conn->out, conn->out_len + sizeof( msg ) );
+			if ( tmp != NULL ) {
+				conn->out = tmp;
+				conn->out_alloc = conn->out_len + sizeof( msg );
+				memcpy( conn->out + conn->out_len, msg, sizeof( msg ) - 1 );
+				conn->out_len += sizeof( msg ) - 1;
+			}
+			pthread_mutex_unlock( &server->lock );
+			conn->in_len = 0;
+			conn->eof = 1;
+			break;
+		}
+		ssize_t n = recv( conn->fd, conn->in + conn->in_len, DAS_SERVE_LINE_MAX - conn->in_len, 0 );
+		if ( n == -1 && errno == EINTR )
+			continue;
+		if ( n <= 0 ) {
+			if ( n == 0 || ( errno != EAGAIN && errno != EWOULDBLOCK ) )
+				conn->eof = 1;
+			break;
+		}
+		int start = 0, i = conn->in_len;
+		conn->in_len += n;
+		for ( ; i < conn->in_len; i++ ) {
+			if ( conn->in[i] != '\n' )
+				continue;
+			int len = i - start;
+			if ( len > 0 && conn->in[start + len - 1] == '\r' )
+				len--;
+			if ( len > 0 && das_conn_queue( server, conn, conn->in + start, len ) == -1 )
+				fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+			start = i + 1;
+		}
+		memmove( conn->in, conn->in + start, conn->in_len - start );
+		conn->in_len -= start;
+	}
+	das_conn_flush( server, conn );
+
+}
+
+static void das_conn_accept( struct das_server* server ) {
+
+	for ( ;; ) {
+		int fd = accept4( server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC );
+		if ( fd == -1 ) {
+			if ( errno == EINTR )
+				continue;
+			return;
+		}
+		struct das_conn* conn = (struct das_conn*)calloc( 1, sizeof( struct das_conn ) );
+		if ( conn == NULL || ( conn->in = (char*)malloc( DAS_SERVE_LINE_MAX ) ) == NULL ) {
+			fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+			free( conn );
+			close( fd );
+			continue;
+		}
+		conn->fd = fd;
+		conn->refs = 1;
+		conn->events = EPOLLIN;
+		struct epoll_event ev = { .events = EPOLLIN, .data.ptr = conn };
+		if ( epoll_ctl( server->epfd, EPOLL_CTL_ADD, fd, &ev ) == -1 ) {
+			free( conn->in );
+			free( conn );
+			close( fd );
+			continue;
+		}
+		conn->next = server->conns;
+		if ( server->conns != NULL )
+			server->conns->prev = conn;
+		server->conns = conn;
+	}
+
+}
+
+static int das_serve_listen( const char* path ) {
+
+	// Refuse to take over a socket someone still answers on, a stale
+	// one from a crashed server is removed
+	struct sockaddr_un addr;
+	struct stat sb;
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sun_family = AF_UNIX;
+	if ( strlen( path ) >= sizeof( addr.sun_path ) ) {
+		fprintf( stderr, ":: ERROR: Socket path \"%s\" is too long.\n", path );
+		return( -1 );
+	}
+	memcpy( addr.sun_path, path, strlen( path ) );
+	int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	if ( fd == -1 ) {
+		fprintf( stderr, ":: ERROR: Cannot create socket.\n" );
+		return( -1 );
+	}
+	if ( connect( fd, (struct sockaddr*)&addr, sizeof( addr ) ) == 0 ) {
+		fprintf( stderr, ":: ERROR: Something is already serving on \"%s\"\n", path );
+		close( fd );
+		return( -1 );
+	}
+	close( fd );
+	if ( lstat( path, &sb ) == 0 ) {
+		if ( !S_ISSOCK( sb.st_mode ) ) {
+			fprintf( stderr, ":: ERROR: \"%s\" exists and is not a socket.\n", path );
+			return( -1 );
+		}
+		unlink( path );
+	}
+	fd = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+	if ( fd == -1 || bind( fd, (struct sockaddr*)&addr, sizeof( addr ) ) == -1 ||
+			listen( fd, 128 ) == -1 ) {
+		fprintf( stderr, ":: ERROR: Cannot listen on \"%s\"\n", path );
+		if ( fd != -1 )
+			close( fd );
+		return( -1 );
+	}
+	return( fd );
+
+}
+#endif
+
+int das_serve( const struct das_batch* batch ) {
+
+#ifndef __linux__
+	fprintf( stderr, ":: ERROR: serve is only available on Linux.\n" );
+	return( -1 );
+#else
+	struct das_server server;
+	struct epoll_event events[DAS_SERVE_EVENTS];
+	pthread_t* worker = NULL;
+	sigset_t mask;
+	int i = 0, started = 0, ret = 0;
+	memset( &server, 0, sizeof( server ) );
+	server.batch = batch;
+	server.workers = batch->jobs;
+	if ( server.workers == 0 ) {
+#ifdef _SC_NPROCESSORS_ONLN
+		server.workers = (int)sysconf( _SC_NPROCESSORS_ONLN );
+#else
+		server.workers = 1;
+#endif
+	}
+	if ( server.workers < 1 )
+		server.workers = 1;
+	server.epfd = server.wake_fd = server.signal_fd = -1;
+	if ( ( server.listen_fd = das_serve_listen( batch->socket ) ) == -1 )
+		return( -1 );
+	if ( das_cache_init( &server.cache, batch->cache, server.workers ) == -1 ||
+			( worker = (pthread_t*)malloc( server.workers * sizeof( pthread_t ) ) ) == NULL ) {
+		fprintf( stderr, ":: ERROR: Memory allocation error.\n" );
+		close( server.listen_fd );
+		unlink( batch->socket );
+		return( -1 );
+	}
+	pthread_mutex_init( &server.lock, NULL );
+	pthread_cond_init( &server.cond, NULL );
+
+	// SIGINT and SIGTERM arrive through the loop, blocked before any
+	// worker exists so no thread gets them
+	sigemptyset( &mask );
+	sigaddset( &mask, SIGINT );
+	sigaddset( &mask, SIGTERM );
+	pthread_sigmask( SIG_BLOCK, &mask, NULL );
+	server.signal_fd = signalfd( -1, &mask, SFD_NONBLOCK | SFD_CLOEXEC );
+	server.wake_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	server.epfd = epoll_create1( EPOLL_CLOEXEC );
+	struct epoll_event ev = { .events = EPOLLIN };
+	ev.data.ptr = &server.listen_fd;
+	if ( server.signal_fd == -1 || server.wake_fd == -1 || server.epfd == -1 ||
+			epoll_ctl( server.epfd, EPOLL_CTL_ADD, server.listen_fd, &ev ) == -1 )
+		ret = -1;
+	ev.data.ptr = &server.wake_fd;
+	if ( ret == 0 && epoll_ctl( server.epfd, EPOLL_CTL_ADD, server.wake_fd, &ev ) == -1 )
+		ret = -1;
+	ev.data.ptr = &server.signal_fd;
+	if ( ret == 0 && epoll_ctl( server.epfd, EPOLL_CTL_ADD, server.signal_fd, &ev ) == -1 )
+		ret = -1;
+	if ( ret == -1 )
+		fprintf( stderr, ":: ERROR: Cannot set up the event loop.\n" );
+
+	// Resolve the scanner once, before anyone races for it
+	das_scan_init();
+	for ( started = 0; ret == 0 && started < server.workers; started++ )
+		if ( pthread_create( &worker[started], NULL, das_serve_worker, &server ) != 0 )
+			break;
+	if ( ret == 0 && started == 0 ) {
+		fprintf( stderr, ":: ERROR: Cannot start worker threads.\n" );
+		ret = -1;
+	}
+	if ( ret == 0 )
+		fprintf( stderr, ":: Serving on %s, %d workers, %d saves cached.\n", batch->socket,
+			started, batch->cache );
+
+	while ( ret == 0 && !server.stop ) {
+		int n = epoll_wait( server.epfd, events, DAS_SERVE_EVENTS, -1 );
+		if ( n == -1 ) {
+			if ( errno == EINTR )
+				continue;
+			fprintf( stderr, ":: ERROR: epoll_wait failed.\n" );
+			ret = -1;
+			break;
+		}
+		for ( i = 0; i < n; i++ ) {
+			void* ptr = events[i].data.ptr;
+			if ( ptr == &server.listen_fd ) {
+				das_conn_accept( &server );
+			} else if ( ptr == &server.signal_fd ) {
+				struct signalfd_siginfo info;
+				if ( read( server.signal_fd, &info, sizeof( info ) ) == sizeof( info ) )
+					server.stop = 1;
+			} else if ( ptr == &server.wake_fd ) {
+				unsigned long long count = 0;
+				if ( read( server.wake_fd, &count, sizeof( count ) ) == -1 && errno != EAGAIN )
+					ret = -1;
+			} else {
+				struct das_conn* conn = (struct das_conn*)ptr;
+				if ( events[i].events & ( EPOLLIN | EPOLLHUP | EPOLLERR ) )
+					das_conn_read( &server, conn );
+				else
+					das_conn_flush( &server, conn );
+			}
+		}
+
+		// Connections with new replies, each holding a reference
+		pthread_mutex_lock( &server.lock );
+		struct das_conn* ready = server.ready;
+		server.ready = NULL;
+		struct das_conn* conn = NULL;
+		for ( conn = ready; conn != NULL; conn = conn->ready_next )
+			conn->ready = 0;
+		pthread_mutex_unlock( &server.lock );
+		while ( ready != NULL ) {
+			conn = ready;
+			ready = conn->ready_next;
+			if ( !conn->closed )
+				das_conn_flush( &server, conn );
+			das_conn_unref( &server, conn );
+		}
+	}
+
+	// Queued requests are dropped, the ones being answered finish first
+	pthread_mutex_lock( &server.lock );
+	server.stop = 1;
+	struct das_job* job = server.head;
+	server.head = server.tail = NULL;
+	pthread_cond_broadcast( &server.cond );
+	pthread_mutex_unlock( &server.lock );
+	for ( i = 0; i < started; i++ )
+		pthread_join( worker[i], NULL );
+	while ( job != NULL ) {
+		struct das_job* next = job->next;
+		pthread_mutex_lock( &server.lock );
+		job->conn->jobs--;
+		pthread_mutex_unlock( &server.lock );
+		das_conn_unref( &server, job->conn );
+		free( job->line );
+		free( job );
+		job = next;
+	}
+	while ( server.ready != NULL ) {
+		struct das_conn* conn = server.ready;
+		server.ready = conn->ready_next;
+		conn->ready = 0;
+		das_conn_unref( &server, conn );
+	}
+	while ( server.conns != NULL )
+		das_conn_close( &server, server.conns );
+	das_cache_free( &server.cache );
+	free( worker );
+	if ( server.epfd != -1 )
+		close( server.epfd );
+	if ( server.wake_fd != -1 )
+		close( server.wake_fd );
+	if ( server.signal_fd != -1 )
+		close( server.signal_fd );
+	close( server.listen_fd );
+	unlink( batch->socket );
+	pthread_cond_destroy( &server.cond );
+	pthread_mutex_destroy( &server.lock );
+	pthread_sigmask( SIG_UNBLOCK, &mask, NULL );
+	fprintf( stderr, ":: Stopped.\n" );
+	return( ret );
+#endif
+
+}
+
+// The red of each RGB triplet, green and blue follow it
+static const int das_colors[DAS_NUM_COLORS] = {
+	1, 5, 8, 12, 17, 20, 24, 27, 30, 33, 36, 39, 42, 45, 48, 51
+};
+
+static int das_color_push( struct das_color_plan* plan, const struct das_color_op* op ) {
+
+	// A matrix right after a matrix is folded into it: the new one is
+	// applied to what the old one gives, so M = N * M and t = N * t + u
+	struct das_color_op* last = plan->count ? &plan->op[plan->count - 1] : NULL;
+	int r = 0, c = 0;
+	if ( op->type == DAS_COLOR_MATRIX && last != NULL && last->type == DAS_COLOR_MATRIX ) {
+		float m[12];
+		for ( r = 0; r < 3; r++ ) {
+			for ( c = 0; c < 3; c++ )
+				m[r * 3 + c] = op->m[r * 3] * last->m[c] + op->m[r * 3 + 1] * last->m[3 + c] +
+					op->m[r * 3 + 2] * last->m[6 + c];
+			m[9 + r] = op->m[r * 3] * last->m[9] + op->m[r * 3 + 1] * last->m[10] +
+				op->m[r * 3 + 2] * last->m[11] + op->m[9 + r];
+		}
+		memcpy( last->m, m, sizeof( m ) );
+		return( 0 );
+	}
+	if ( plan->count == DAS_COLOR_OPS )
+		return( -1 );
+	plan->op[plan->count++] = *op;
+	return( 0 );
+
+}
+
+int das_color_parse( struct das_color_plan* plan, const char* arg ) {
+
+	// NAME=ARGS, ARGS a comma separated list of numbers
+	const char* eq = strchr( arg, '=' );
+	char name[16] = "";
+	float v[4] = { 0, 0, 0, 0 };
+	int n = 0, i = 0;
+	snprintf( name, sizeof( name ), "%.*s", eq ? (int)( eq - arg ) : (int)strlen( arg ), arg );
+	if ( eq != NULL ) {
+		const char* p = eq + 1;
+		for ( n = 0; n < 4; n++ ) {
+			char* end = NULL;
+			v[n] = strtof( p, &end );
+			if ( end == p || !isfinite( v[n] ) )
+				return( -1 );
+			p = end;
+			if ( *p == '\0' ) {
+				n++;
+				break;
+			}
+			if ( *p++ != ',' )
+				return( -1 );
+		}
+		if ( *p != '\0' && n == 4 )
+			return( -1 );
+	}
+
+	// Everything linear starts from the identity
+	struct das_color_op op = { .type = DAS_COLOR_MATRIX, .min = 0, .max = 1 };
+	memset( op.m, 0, sizeof( op.m ) );
+	op.m[0] = op.m[4] = op.m[8] = 1;
+	if ( strcmp( name, "brightness" ) == 0 && n == 1 ) {
+		op.m[0] = op.m[4] = op.m[8] = v[0];
+	} else if ( strcmp( name, "saturation" ) == 0 && n == 1 ) {
+		// Toward or away from the Rec. 709 luma of the color
+		const float luma[3] = { 0.2126f, 0.7152f, 0.0722f };
+		for ( i = 0; i < 9; i++ )
+			op.m[i] = ( 1 - v[0] ) * luma[i % 3] + ( i % 4 == 0 ? v[0] : 0 );
+	} else if ( strcmp( name, "hue" ) == 0 && n == 1 ) {
+		// Rotation about the gray axis, so grays stay gray
+		float a = v[0] * 3.14159265f / 180, c = cosf( a ), s = sinf( a ) * 0.57735027f;
+		float k = ( 1 - c ) / 3;
+		op.m[0] = op.m[4] = op.m[8] = c + k;
+		op.m[1] = op.m[5] = op.m[6] = k - s;
+		op.m[2] = op.m[3] = op.m[7] = k + s;
+	} else if ( strcmp( name, "blend" ) == 0 && n == 4 ) {
+		op.m[0] = op.m[4] = op.m[8] = 1 - v[3];
+		for ( i = 0; i < 3; i++ )
+			op.m[9 + i] = v[3] * v[i];
+	} else if ( strcmp( name, "clamp" ) == 0 && n == 2 && v[0] <= v[1] ) {
+		op.type = DAS_COLOR_CLAMP;
+		op.min = v[0];
+		op.max = v[1];
+	} else if ( strcmp( name, "linear" ) == 0 && eq == NULL ) {
+		op.type = DAS_COLOR_LINEAR;
+	} else if ( strcmp( name, "srgb" ) == 0 && eq == NULL ) {
+		op.type = DAS_COLOR_SRGB;
+	} else {
+		return( -1 );
+	}
+	return( das_color_push( plan, &op ) );
+
+}
+
+int das_color_only( struct das_color_plan* plan, const char* list ) {
+
+	// Each name picks every triplet whose name (without " COLOR RED")
+	// has it, ignoring case: hair is hair, spec, scalp and facial hair
+	const char* p = list;
+	while ( *p ) {
+		int len = (int)strcspn( p, "," ), c = 0, found = 0;
+		for ( c = 0; c < DAS_NUM_COLORS && len > 0; c++ ) {
+			const char* name = das_fields[das_colors[c]].name;
+			int name_len = (int)( strstr( name, " COLOR" ) - name ), d = 0, k = 0;
+			for ( d = 0; d + len <= name_len; d++ ) {
+				for ( k = 0; k < len; k++ )
+					if ( toupper( (unsigned char)p[k] ) != name[d + k] )
+						break;
+				if ( k == len ) {
+					plan->mask |= 1u << c;
+					found = 1;
+					break;
+				}
+			}
+		}
+		if ( !found )
+			return( -1 );
+		p += len;
+		if ( *p == ',' )
+			p++;
+	}
+	return( 0 );
+
+}
+
+static float das_color_transfer( int type, float x ) {
+
+	// The sRGB curve, values past 0..1 are mirrored around 0 and extended
+	float a = x < 0 ? -x : x;
+	if ( type == DAS_COLOR_LINEAR )
+		a = a <= 0.04045f ? a / 12.92f : powf( ( a + 0.055f ) / 1.055f, 2.4f );
+	else
+		a = a <= 0.0031308f ? a * 12.92f : 1.055f * powf( a, 1 / 2.4f ) - 0.055f;
+	return( x < 0 ? -a : a );
+
+}
+
+static void das_color_run_scalar( const struct das_color_plan* plan, float* r, float* g, float* b ) {
+
+	int i = 0, o = 0;
+	for ( i = 0; i < DAS_NUM_COLORS; i++ ) {
+		float x = r[i], y = g[i], z = b[i];
+		for ( o = 0; o < plan->count; o++ ) {
+			const struct das_color_op* op = &plan->op[o];
+			if ( op->type == DAS_COLOR_MATRIX ) {
+				float nx = op->m[0] * x + op->m[1] * y + op->m[2] * z + op->m[9];
+				float ny = op->m[3] * x + op->m[4] * y + op->m[5] * z + op->m[10];
+				z = op->m[6] * x + op->m[7] * y + op->m[8] * z + op->m[11];
+				x = nx;
+				y = ny;
+			} else if ( op->type == DAS_COLOR_CLAMP ) {
+				x = x < op->min ? op->min : x > op->max ? op->max : x;
+				y = y < op->min ? op->min : y > op->max ? op->max : y;
+				z = z < op->min ? op->min : z > op->max ? op->max : z;
+			} else {
+				x = das_color_transfer( op->type, x );
+				y = das_color_transfer( op->type, y );
+				z = das_color_transfer( op->type, z );
+			}
+		}
+		r[i] = x;
+		g[i] = y;
+		b[i] = z;
+	}
+
+}
+
+#ifdef DAS_SCAN_SIMD
+__attribute__(( target( "sse2" ) ))
+static void das_color_run_sse2( const struct das_color_plan* plan, float* r, float* g, float* b ) {
+
+	// Four triplets per register, every op applied before they are stored
+	int i = 0, o = 0, k = 0;
+	for ( i = 0; i < DAS_NUM_COLORS; i += 4 ) {
+		__m128 x = _mm_loadu_ps( r + i ), y = _mm_loadu_ps( g + i ), z = _mm_loadu_ps( b + i );
+		for ( o = 0; o < plan->count; o++ ) {
+			const struct das_color_op* op = &plan->op[o];
+			if ( op->type == DAS_COLOR_MATRIX ) {
+				const float* m = op->m;
+				__m128 nx = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( m[0] ), x ),
+					_mm_mul_ps( _mm_set1_ps( m[1] ), y ) ),
+					_mm_add_ps( _mm_mul_ps( _mm_set1_ps( m[2] ), z ), _mm_set1_ps( m[9] ) ) );
+				__m128 ny = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( m[3] ), x ),
+					_mm_mul_ps( _mm_set1_ps( m[4] ), y ) ),
+					_mm_add_ps( _mm_mul_ps( _mm_set1_ps( m[5] ), z ), _mm_set1_ps( m[10] ) ) );
+				z = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( m[6] ), x ),
+					_mm_mul_ps( _mm_set1_ps( m[7] ), y ) ),
+					_mm_add_ps( _mm_mul_ps( _mm_set1_ps( m[8] ), z ), _mm_set1_ps( m[11] ) ) );
+				x = nx;
+				y = ny;
+			} else if ( op->type == DAS_COLOR_CLAMP ) {
+				__m128 lo = _mm_set1_ps( op->min ), hi = _mm_set1_ps( op->max );
+				x = _mm_min_ps( _mm_max_ps( x, lo ), hi );
+				y = _mm_min_ps( _mm_max_ps( y, lo ), hi );
+				z = _mm_min_ps( _mm_max_ps( z, lo ), hi );
+			} else {
+				// No vector pow, the curve goes lane by lane
+				float t[12];
+				_mm_storeu_ps( t, x );
+				_mm_storeu_ps( t + 4, y );
+				_mm_storeu_ps( t + 8, z );
+				for ( k = 0; k < 12; k++ )
+					t[k] = das_color_transfer( op->type, t[k] );
+				x = _mm_loadu_ps( t );
+				y = _mm_loadu_ps( t + 4 );
+				z = _mm_loadu_ps( t + 8 );
+			}
+		}
+		_mm_storeu_ps( r + i, x );
+		_mm_storeu_ps( g + i, y );
+		_mm_storeu_ps( b + i, z );
+	}
+
+}
+#endif
+
+int das_color_apply( const struct das_color_plan* plan, struct handle* value, struct das_view* view ) {
+
+	// Triplets missing any of their values are left alone. Results are
+	// clamped to each value's min/max like set-face, only the values
+	// that changed are written. Returns the number written
+	float plane[3][DAS_NUM_COLORS];
+	int lane[DAS_NUM_COLORS];
+	int count = 0, c = 0, k = 0, written = 0;
+	for ( c = 0; c < DAS_NUM_COLORS; c++ ) {
+		const struct handle* hb = &value[das_colors[c]];
+		if ( !( plan->mask & ( 1u << c ) ) ||
+				hb[0].offset == -1 || hb[1].offset == -1 || hb[2].offset == -1 )
+			continue;
+		for ( k = 0; k < 3; k++ )
+			plane[k][count] = hb[k].fp_val;
+		lane[count++] = c;
+	}
+	for ( c = count; c < DAS_NUM_COLORS; c++ )
+		plane[0][c] = plane[1][c] = plane[2][c] = 0;
+#ifdef DAS_SCAN_SIMD
+	if ( __builtin_cpu_supports( "sse2" ) )
+		das_color_run_sse2( plan, plane[0], plane[1], plane[2] );
+	else
+#endif
+		das_color_run_scalar( plan, plane[0], plane[1], plane[2] );
+
+	for ( c = 0; c < count; c++ ) {
+		for ( k = 0; k < 3; k++ ) {
+			struct handle* hb = &value[das_colors[lane[c]] + k];
+			float val = plane[k][c];
+			if ( !( val >= hb->min ) )
+				val = hb->min;
+			else if ( val > hb->max )
+				val = hb->max;
+			if ( val == hb->fp_val )
+				continue;
+			das_view_write_f32( view, hb->offset, val );
+			hb->fp_val = val;
+			written++;
+		}
+	}
+	return( written );
+
+}